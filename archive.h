@@ -0,0 +1,49 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: Entries of archive stream of more files shared by client and server
+ */
+
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#define ARCHIVE_HEADER 10                   //nameLen(2) size(8), big endian, name and data of file follow
+#define ARCHIVE_MANIFEST (16 * 1024 * 1024) //max bytes of list of file names sent with request
+
+/*Stream is ended by header with nameLen 0, its size is number of sent files*/
+
+/**
+ * @description - Write header of archive entry
+ * @param char *out - memory of ARCHIVE_HEADER bytes
+ * @param size_t nameLen - bytes of file name, 0 in the last header
+ * @param uint64_t size - bytes of file / number of sent files in the last header
+ * @return void
+ */
+static inline void archiveHeader(char *out, size_t nameLen, uint64_t size) {
+
+    uint16_t len = htobe16((uint16_t) nameLen);
+    uint64_t bytes = htobe64(size);
+    memcpy(out, &len, 2);
+    memcpy(out + 2, &bytes, 8);
+}
+
+/**
+ * @description - Read header of archive entry
+ * @param const char *in - ARCHIVE_HEADER bytes
+ * @param uint64_t *size - bytes of file / number of sent files in the last header
+ * @return size_t - bytes of file name, 0 in the last header
+ */
+static inline size_t readArchive(const char *in, uint64_t *size) {
+
+    uint16_t len;
+    uint64_t bytes;
+    memcpy(&len, in, 2);
+    memcpy(&bytes, in + 2, 8);
+    *size = be64toh(bytes);
+    return be16toh(len);
+}
+
+#endif //ARCHIVE_H
@@ -0,0 +1,912 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: Coroutine engine of client, thousands of transfers run on reactors of few threads
+ */
+
+#ifndef ASYNC_H
+#define ASYNC_H
+
+#include <coroutine>
+#include <exception>
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include "frame.h"
+#include "buffers.h"
+
+/*Opcodes of ReqAns used by engine*/
+#define ASYNC_UP 0
+#define ASYNC_DOWN 1
+#define ASYNC_ACK 2
+#define ASYNC_NAME 4000     //max bytes of file name, request fits MAX_BUFF_SIZE of server
+#define ASYNC_EVENTS 256    //events taken by one epoll_wait
+#define ASYNC_CLOSE (1 << 30)   //wakeups written to reactor of closed pool, all idle workers end
+#define ASYNC_IDLE 1000     //ms, idle connection of pool is closed, so it does not hold worker of server
+
+/*One file transferred by engine, it must stay valid until it is finished*/
+struct AsyncOp{
+    int type;               //ASYNC_UP / ASYNC_DOWN
+    std::string filename;   //name on server, local file too unless memory is used
+    const char *input;      //data of upload, NULL = file is read
+    size_t inputLen;
+    std::string *output;    //data of download, NULL = file is written
+    void (*done)(AsyncOp *op);  //called by reactor thread when transfer ends, engine never touches op after, may be NULL
+    void *arg;              //data of caller for done
+    long size;              //bytes of transferred file, set by engine
+    int status;             //ReqAns code of server's answer, -1 when there was none
+    const char *error;      //why transfer failed, NULL on success
+};
+
+/*Coroutine returning EXIT_SUCCESS / EXIT_FAILURE, it starts suspended and resumes its awaiter when it ends*/
+struct Task{
+    struct promise_type{
+        int result;
+        std::coroutine_handle<> waiter;     //coroutine awaiting this one, NULL for top level one
+
+        /*Ended coroutine transfers control to its waiter, so nested awaits need no stack*/
+        struct Final{
+            bool await_ready() const noexcept { return false; }
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept {
+                std::coroutine_handle<> waiter = h.promise().waiter;
+                return waiter ? waiter : std::noop_coroutine();
+            }
+            void await_resume() const noexcept {}
+        };
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        Final final_suspend() noexcept { return {}; }
+        void return_value(int res) { result = res; }
+        void unhandled_exception() { std::terminate(); }
+    };
+
+    std::coroutine_handle<promise_type> h;
+
+    explicit Task(std::coroutine_handle<promise_type> handle) : h(handle) {}
+    Task(Task &&other) noexcept : h(other.h) { other.h = nullptr; }
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+    ~Task() {
+        if(h){
+            h.destroy();
+        }
+    }
+
+    /*Awaiting coroutine starts this one and continues by its result*/
+    bool await_ready() const noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> waiter) noexcept {
+        h.promise().waiter = waiter;
+        return h;
+    }
+    int await_resume() const noexcept { return h.promise().result; }
+};
+
+/*Connection of one worker coroutine, it lives as long as reactor so late events never point to freed memory*/
+struct AsyncSocket{
+    int fd;                             //-1 when not connected
+    bool keepAlive;                     //server keeps connection opened after the last answer
+    bool reused;                        //connection served some transfer before, server may have closed it since
+    bool answered;                      //some byte of response to current request was received
+    std::coroutine_handle<> waiter;     //coroutine suspended until socket is ready, NULL when none waits
+    std::coroutine_handle<> worker;     //worker suspended until file is submitted
+    std::chrono::steady_clock::time_point idleSince;
+};
+
+struct AsyncPool;
+
+/*Event loop of one thread, it resumes coroutines whose sockets got ready*/
+struct Reactor{
+    AsyncPool *pool;
+    int epoll;
+    int wake;                           //eventfd, its counter is number of idle workers to be resumed
+    int running;                        //worker coroutines not finished yet
+    int spare;                          //idle workers nobody woke yet, guarded by mutex of pool
+    std::deque<AsyncSocket> sockets;    //one per worker coroutine, addresses are stable
+    std::vector<AsyncSocket *> idle;    //sockets of workers waiting for submitted file
+    std::chrono::steady_clock::time_point swept;    //last scan of idle connections
+};
+
+/*Pooled connections of reactors of all threads, files are submitted by any thread*/
+struct AsyncPool{
+    struct sockaddr_storage addr;
+    socklen_t addrLen;
+    std::mutex mtx;
+    std::condition_variable finished;   //notified when no submitted file is left
+    std::deque<AsyncOp *> queue;        //submitted files not taken by any worker yet
+    size_t pending;                     //submitted files not finished yet
+    bool closing;                       //idle workers end instead of waiting
+    size_t nextReactor;                 //search for idle worker starts here, so reactors take turns
+    std::vector<Reactor *> reactors;
+    std::vector<std::thread> threads;
+};
+
+/*Suspends coroutine until its socket reports change, edge triggered event comes after failed syscall*/
+struct Readiness{
+    AsyncSocket *s;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) noexcept { s->waiter = h; }
+    void await_resume() const noexcept {}
+};
+
+/*Suspends worker until some file is submitted or pool is closed, events of its socket do not resume it*/
+struct Idle{
+    Reactor *r;
+    AsyncSocket *s;
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        s->worker = h;
+        s->idleSince = std::chrono::steady_clock::now();
+        r->idle.push_back(s);
+    }
+    void await_resume() const noexcept {}
+};
+
+/**
+ * @description - Wait for readiness of socket, wakeup may be spurious so syscall is always retried
+ * @param AsyncSocket *s - socket of awaiting coroutine
+ * @return Readiness - awaitable
+ */
+static inline Readiness readiness(AsyncSocket *s) {
+
+    return Readiness{s};
+}
+
+/**
+ * @description - Get text of failed answer of server, same as client prints for its ReqAns
+ * @param int status - ReqAns code
+ * @return const char * - error of transfer
+ */
+static inline const char *asyncStatus(int status) {
+
+    static const char *texts[] = {"Operation FAILED", "Operation FAILED", "Operation FAILED", "Operation FAILED",
+                                  "File NOT FOUND", "Unrecognized request", "Too long request",
+                                  "Incomplete request sent", "Server is currently busy, try again"};
+    return status >= 0 && status < (int)(sizeof(texts) / sizeof(texts[0])) ? texts[status] : texts[0];
+}
+
+/**
+ * @description - Connect socket of worker without blocking, it is registered to epoll for both directions once
+ * @param AsyncPool *pool - address of server
+ * @param AsyncSocket *s - not connected socket
+ * @param int epoll - epoll of reactor
+ * @return Task - EXIT_SUCCESS when connected
+ */
+static inline Task asyncConnect(AsyncPool *pool, AsyncSocket *s, int epoll) {
+
+    int fd = socket(pool->addr.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd == -1){
+        co_return EXIT_FAILURE;
+    }
+    tuneSocket(fd);
+    int yes = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, (void *)&yes, sizeof(yes));     //requests are small, ignore failure
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    ev.data.ptr = s;
+    if(epoll_ctl(epoll, EPOLL_CTL_ADD, fd, &ev) == -1){
+        close(fd);
+        co_return EXIT_FAILURE;
+    }
+    s->fd = fd;
+    s->keepAlive = true;
+    s->reused = false;
+
+    if(connect(fd, (struct sockaddr *)&pool->addr, pool->addrLen) == -1){
+        if(errno != EINPROGRESS){
+            close(fd);
+            s->fd = -1;
+            co_return EXIT_FAILURE;
+        }
+        struct sockaddr_storage peer;
+        socklen_t peerLen = sizeof(peer);
+        int err = 0;
+        socklen_t errLen = sizeof(err);
+        do{     //spurious wakeup leaves connect in progress, peer is unknown yet
+            co_await readiness(s);
+            if(getsockopt(fd, SOL_SOCKET, SO_ERROR, (void *)&err, &errLen) == -1){
+                err = errno;
+            }
+        } while(err == 0 && getpeername(fd, (struct sockaddr *)&peer, &peerLen) == -1 && errno == ENOTCONN);
+        if(err != 0){
+            close(fd);
+            s->fd = -1;
+            co_return EXIT_FAILURE;
+        }
+    }
+    co_return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Send all bytes, data must stay valid while coroutine is suspended
+ * @param AsyncSocket *s - connected socket
+ * @param const char *data - bytes to send
+ * @param size_t len - number of bytes
+ * @return Task - EXIT_SUCCESS when all bytes were sent
+ */
+static inline Task asyncSend(AsyncSocket *s, const char *data, size_t len) {
+
+    size_t sent = 0;
+    while(sent < len){
+        ssize_t n = send(s->fd, data + sent, len - sent, MSG_NOSIGNAL);
+        if(n > 0){
+            sent += (size_t) n;
+        }
+        else if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            co_await readiness(s);
+        }
+        else if(n == -1 && errno == EINTR){
+            continue;
+        }
+        else{
+            co_return EXIT_FAILURE;
+        }
+    }
+    co_return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Receive exact number of bytes, data must stay valid while coroutine is suspended
+ * @param AsyncSocket *s - connected socket
+ * @param char *data - memory for received bytes
+ * @param size_t len - number of bytes
+ * @return Task - EXIT_FAILURE when connection ended or failed before
+ */
+static inline Task asyncRecv(AsyncSocket *s, char *data, size_t len) {
+
+    size_t got = 0;
+    while(got < len){
+        ssize_t n = recv(s->fd, data + got, len - got, 0);
+        if(n > 0){
+            got += (size_t) n;
+        }
+        else if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            co_await readiness(s);
+        }
+        else if(n == -1 && errno == EINTR){
+            continue;
+        }
+        else{
+            co_return EXIT_FAILURE;
+        }
+    }
+    co_return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Receive data of download and write them to file
+ *                Buffer of thread is used just between recv and pwrite, never across suspension
+ * @param AsyncSocket *s - connected socket
+ * @param int fd - opened file
+ * @param long length - bytes of data
+ * @return Task - EXIT_SUCCESS when all data were written
+ */
+static inline Task asyncReceiveFile(AsyncSocket *s, int fd, long length) {
+
+    char *buffer = threadBuffer();
+    if(buffer == NULL){
+        co_return EXIT_FAILURE;
+    }
+    long got = 0;
+    while(got < length){
+        long left = length - got;
+        ssize_t n = recv(s->fd, buffer, (size_t) left < bufferSize() ? (size_t) left : bufferSize(), 0);
+        if(n > 0){
+            for(ssize_t written = 0; written < n;){
+                ssize_t w = pwrite(fd, buffer + written, (size_t)(n - written), got + written);
+                if(w == -1 && errno == EINTR){
+                    continue;
+                }
+                if(w <= 0){
+                    co_return EXIT_FAILURE;
+                }
+                written += w;
+            }
+            got += n;
+        }
+        else if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            co_await readiness(s);
+        }
+        else if(n == -1 && errno == EINTR){
+            continue;
+        }
+        else{
+            co_return EXIT_FAILURE;
+        }
+    }
+    co_return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Read file and send its data, unsent rest of buffer is read again after wakeup
+ *                so buffer of thread is shared by all coroutines and never held across suspension
+ * @param AsyncSocket *s - connected socket
+ * @param int fd - opened file
+ * @param long length - bytes of data
+ * @return Task - EXIT_SUCCESS when all data were sent
+ */
+static inline Task asyncSendFile(AsyncSocket *s, int fd, long length) {
+
+    char *buffer = threadBuffer();
+    if(buffer == NULL){
+        co_return EXIT_FAILURE;
+    }
+    long sent = 0;
+    while(sent < length){
+        long left = length - sent;
+        ssize_t r = pread(fd, buffer, (size_t) left < bufferSize() ? (size_t) left : bufferSize(), sent);
+        if(r == -1 && errno == EINTR){
+            continue;
+        }
+        if(r <= 0){
+            co_return EXIT_FAILURE;     //file was shortened while sent
+        }
+        ssize_t n = send(s->fd, buffer, (size_t) r, MSG_NOSIGNAL);
+        if(n > 0){
+            sent += n;
+        }
+        else if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            co_await readiness(s);
+        }
+        else if(n == -1 && errno == EINTR){
+            continue;
+        }
+        else{
+            co_return EXIT_FAILURE;
+        }
+    }
+    co_return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Send binary request of file, connection is asked to stay opened
+ * @param AsyncSocket *s - connected socket
+ * @param int type - ASYNC_UP / ASYNC_DOWN
+ * @param const std::string &filename - name of file on server
+ * @param long length - bytes of upload, 0 for download
+ * @return Task - EXIT_SUCCESS when request was sent
+ */
+static inline Task asyncRequest(AsyncSocket *s, int type, const std::string &filename, long length) {
+
+    char request[FRAME_HEADER_SIZE + ASYNC_NAME];
+    Frame f;
+    memset(&f, 0, sizeof(f));
+    f.version = FRAME_VERSION;
+    f.opcode = (uint8_t) type;
+    f.flags = FRAME_KEEPALIVE;
+    f.nameLen = (uint16_t) filename.length();
+    f.length = (uint64_t) length;
+    frameEncode(request, &f);
+    memcpy(request + FRAME_HEADER_SIZE, filename.data(), filename.length());
+    co_return co_await asyncSend(s, request, FRAME_HEADER_SIZE + filename.length());
+}
+
+/**
+ * @description - Receive binary response, text status is sent by server which refused connection
+ * @param AsyncSocket *s - connected socket, keepAlive is set by response
+ * @param AsyncOp *op - status and error are set when transfer can't continue
+ * @param Frame *f - received header
+ * @return Task - EXIT_SUCCESS when server answered ACK
+ */
+static inline Task asyncResponse(AsyncSocket *s, AsyncOp *op, Frame *f) {
+
+    char header[FRAME_HEADER_SIZE];
+    if(co_await asyncRecv(s, header, 1) == EXIT_FAILURE){
+        s->keepAlive = false;
+        op->error = "NOT entire response was received";
+        co_return EXIT_FAILURE;
+    }
+    s->answered = true;
+    if((unsigned char) header[0] != FRAME_MAGIC){
+        s->keepAlive = false;
+        op->status = header[0] >= '0' && header[0] <= '9' ? header[0] - '0' : -1;
+        op->error = op->status == -1 ? "Unexpected response" : asyncStatus(op->status);
+        co_return EXIT_FAILURE;
+    }
+    if(co_await asyncRecv(s, header + 1, FRAME_HEADER_SIZE - 1) == EXIT_FAILURE){
+        s->keepAlive = false;
+        op->error = "NOT entire response was received";
+        co_return EXIT_FAILURE;
+    }
+    frameDecode(header, f);
+    s->keepAlive = (f->flags & FRAME_KEEPALIVE) != 0;
+    op->status = f->opcode;
+    if(f->version != FRAME_VERSION){
+        s->keepAlive = false;
+        op->error = "Unexpected response";
+        co_return EXIT_FAILURE;
+    }
+    if(f->opcode != ASYNC_ACK){
+        op->error = asyncStatus(f->opcode);
+        co_return EXIT_FAILURE;
+    }
+    co_return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Download file over connection of worker
+ * @param AsyncSocket *s - connected socket, keepAlive tells whether it can be reused
+ * @param AsyncOp *op - downloaded file
+ * @return Task - EXIT_SUCCESS when file was downloaded
+ */
+static inline Task asyncDownload(AsyncSocket *s, AsyncOp *op) {
+
+    if(co_await asyncRequest(s, ASYNC_DOWN, op->filename, 0) == EXIT_FAILURE){
+        s->keepAlive = false;
+        op->error = "Sending request FAILED";
+        co_return EXIT_FAILURE;
+    }
+    Frame f;
+    if(co_await asyncResponse(s, op, &f) == EXIT_FAILURE){
+        co_return EXIT_FAILURE;
+    }
+    if(op->output != NULL){     //data go straight to memory of caller
+        op->output->resize((size_t) f.length);
+        if(co_await asyncRecv(s, &(*op->output)[0], (size_t) f.length) == EXIT_FAILURE){
+            s->keepAlive = false;
+            op->error = "Downloading FAILED, NOT entire file was downloaded";
+            co_return EXIT_FAILURE;
+        }
+        op->size = (long) f.length;
+        co_return EXIT_SUCCESS;
+    }
+    int fd = open(op->filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd == -1){
+        s->keepAlive = false;   //data are on the way, connection can't be reused
+        op->error = "Unable to create a file";
+        co_return EXIT_FAILURE;
+    }
+    int res = co_await asyncReceiveFile(s, fd, (long) f.length);
+    close(fd);
+    if(res == EXIT_FAILURE){
+        s->keepAlive = false;
+        op->error = "Downloading FAILED, NOT entire file was downloaded";
+        co_return EXIT_FAILURE;
+    }
+    op->size = (long) f.length;
+    co_return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Upload file over connection of worker, data are sent after server accepts request
+ * @param AsyncSocket *s - connected socket, keepAlive tells whether it can be reused
+ * @param AsyncOp *op - uploaded file / memory
+ * @return Task - EXIT_SUCCESS when server confirmed the whole file
+ */
+static inline Task asyncUpload(AsyncSocket *s, AsyncOp *op) {
+
+    int fd = -1;
+    long length = (long) op->inputLen;
+    if(op->input == NULL){
+        struct stat st;
+        fd = open(op->filename.c_str(), O_RDONLY | O_CLOEXEC);
+        if(fd == -1 || fstat(fd, &st) == -1){
+            if(fd != -1){
+                close(fd);
+            }
+            op->error = "Unable to open file or file does not exist";
+            co_return EXIT_FAILURE;
+        }
+        length = (long) st.st_size;
+    }
+    if(co_await asyncRequest(s, ASYNC_UP, op->filename, length) == EXIT_FAILURE){
+        if(fd != -1){
+            close(fd);
+        }
+        s->keepAlive = false;
+        op->error = "Sending request FAILED";
+        co_return EXIT_FAILURE;
+    }
+    Frame f;
+    if(co_await asyncResponse(s, op, &f) == EXIT_FAILURE){
+        if(fd != -1){
+            close(fd);
+        }
+        co_return EXIT_FAILURE;
+    }
+    int res;
+    if(fd == -1){   //memory of caller stays valid until transfer is finished
+        res = co_await asyncSend(s, op->input, op->inputLen);
+    }
+    else{
+        res = co_await asyncSendFile(s, fd, length);
+        close(fd);
+    }
+    if(res == EXIT_FAILURE){
+        s->keepAlive = false;
+        op->error = "Uploading FAILED, NOT entire file was sent";
+        co_return EXIT_FAILURE;
+    }
+    if(co_await asyncResponse(s, op, &f) == EXIT_FAILURE){
+        co_return EXIT_FAILURE;
+    }
+    op->size = length;
+    co_return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Transfer one file over pooled connection of worker, which is opened when needed
+ *                Server may close idle connection of pool, so request failed on reused one is repeated on new one
+ * @param AsyncPool *pool - address of server
+ * @param Reactor *r - reactor of thread
+ * @param AsyncSocket *s - socket of worker
+ * @param AsyncOp *op - transferred file, its size, status and error are set
+ * @return Task - EXIT_SUCCESS when file was transferred
+ */
+static inline Task asyncRun(AsyncPool *pool, Reactor *r, AsyncSocket *s, AsyncOp *op) {
+
+    op->size = 0;
+    op->status = -1;
+    op->error = NULL;
+    if(op->filename.empty() || op->filename.length() > ASYNC_NAME){
+        op->error = "Too long request";
+        co_return EXIT_FAILURE;
+    }
+    for(int attempt = 0;; attempt++){
+        if(s->fd == -1 && co_await asyncConnect(pool, s, r->epoll) == EXIT_FAILURE){
+            op->error = "Unable to connect to server";
+            co_return EXIT_FAILURE;
+        }
+        bool reused = s->reused;
+        s->answered = false;
+        int res;
+        if(op->type == ASYNC_DOWN){
+            res = co_await asyncDownload(s, op);
+        }
+        else{
+            res = co_await asyncUpload(s, op);
+        }
+        s->reused = true;
+        if(!s->keepAlive){
+            close(s->fd);   //removes it from epoll
+            s->fd = -1;
+        }
+        if(res == EXIT_FAILURE && reused && !s->answered && s->fd == -1 && attempt == 0){
+            op->error = NULL;
+            continue;
+        }
+        co_return res;
+    }
+}
+
+/**
+ * @description - Take next submitted file, worker finding none is counted as spare one of its reactor
+ * @param Reactor *r - reactor of worker
+ * @param bool *end - set when pool is closing and no file is left
+ * @return AsyncOp * - taken file, NULL when worker has to wait or end
+ */
+static inline AsyncOp *asyncTake(Reactor *r, bool *end) {
+
+    std::lock_guard<std::mutex> lock(r->pool->mtx);
+    *end = false;
+    if(!r->pool->queue.empty()){
+        AsyncOp *op = r->pool->queue.front();
+        r->pool->queue.pop_front();
+        return op;
+    }
+    if(r->pool->closing){
+        *end = true;
+        return NULL;
+    }
+    r->spare++;     //counted before worker suspends, so submitting thread can't miss it
+    return NULL;
+}
+
+/**
+ * @description - Report finished file to its caller and to threads waiting for the pool
+ * @param AsyncPool *pool - pool of file
+ * @param AsyncOp *op - finished file, it is not touched after done
+ * @return void
+ */
+static inline void asyncFinish(AsyncPool *pool, AsyncOp *op) {
+
+    if(op->done != NULL){
+        op->done(op);
+    }
+    std::lock_guard<std::mutex> lock(pool->mtx);
+    if(--pool->pending == 0){
+        pool->finished.notify_all();
+    }
+}
+
+/**
+ * @description - Transfer submitted files until pool is closed, one kept-alive connection serves all of them
+ * @param Reactor *r - reactor of thread, running is decremented at the end
+ * @param AsyncSocket *s - socket of this worker
+ * @return Task - EXIT_SUCCESS
+ */
+static inline Task asyncWorker(Reactor *r, AsyncSocket *s) {
+
+    while(1){
+        bool end;
+        AsyncOp *op = asyncTake(r, &end);
+        if(end){
+            break;
+        }
+        if(op == NULL){
+            co_await Idle{r, s};
+            continue;
+        }
+        co_await asyncRun(r->pool, r, s, op);
+        asyncFinish(r->pool, op);
+    }
+    if(s->fd != -1){
+        close(s->fd);
+        s->fd = -1;
+    }
+    r->running--;
+    co_return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Close connections of workers idle for ASYNC_IDLE, worker of server in default mode is freed
+ *                Idle workers are scanned 4 times per ASYNC_IDLE at most, not after every event
+ * @param Reactor *r - reactor of thread
+ * @return int - ms to wait for events until next scan, -1 = no idle connection is opened
+ */
+static inline int asyncIdle(Reactor *r) {
+
+    std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+    long elapsed = (long) std::chrono::duration_cast<std::chrono::milliseconds>(now - r->swept).count();
+    if(elapsed < ASYNC_IDLE / 4){
+        return r->idle.empty() ? -1 : (int)(ASYNC_IDLE / 4 - elapsed);
+    }
+    r->swept = now;
+    bool opened = false;
+    for(size_t i = 0; i < r->idle.size(); i++){
+        AsyncSocket *s = r->idle[i];
+        if(s->fd == -1){
+            continue;
+        }
+        if(std::chrono::duration_cast<std::chrono::milliseconds>(now - s->idleSince).count() >= ASYNC_IDLE){
+            close(s->fd);   //removes it from epoll
+            s->fd = -1;
+        }
+        else{
+            opened = true;
+        }
+    }
+    return opened ? ASYNC_IDLE / 4 : -1;
+}
+
+/**
+ * @description - Run worker coroutines of one thread until pool is closed
+ *                Counter of wake eventfd tells how many idle workers were given a file by submitting threads
+ * @param Reactor *r - reactor of thread
+ * @param int workers - number of coroutines, every one has own connection
+ * @return void
+ */
+static inline void asyncThread(Reactor *r, int workers) {
+
+    std::vector<Task> tasks;
+    for(int i = 0; i < workers; i++){
+        r->sockets.push_back(AsyncSocket{-1, true, false, false, nullptr, nullptr, std::chrono::steady_clock::now()});
+        tasks.push_back(asyncWorker(r, &r->sockets.back()));
+    }
+    for(size_t i = 0; i < tasks.size(); i++){
+        tasks[i].h.resume();
+    }
+
+    struct epoll_event events[ASYNC_EVENTS];
+    while(r->running > 0){
+        int n = epoll_wait(r->epoll, events, ASYNC_EVENTS, asyncIdle(r));
+        if(n == -1 && errno == EINTR){
+            continue;
+        }
+        if(n == -1){
+            break;
+        }
+        for(int i = 0; i < n; i++){
+            if(events[i].data.ptr == NULL){
+                uint64_t wakeups = 0;
+                if(read(r->wake, &wakeups, sizeof(wakeups)) != sizeof(wakeups)){
+                    continue;
+                }
+                while(wakeups > 0 && !r->idle.empty()){
+                    std::coroutine_handle<> worker = r->idle.back()->worker;
+                    r->idle.pop_back();
+                    wakeups--;
+                    worker.resume();
+                }
+                continue;
+            }
+            AsyncSocket *s = (AsyncSocket *) events[i].data.ptr;
+            std::coroutine_handle<> waiter = s->waiter;
+            if(waiter){
+                s->waiter = nullptr;
+                waiter.resume();
+            }
+        }
+    }
+}
+
+/**
+ * @description - Wake reactor of pool, its idle workers look for submitted files
+ * @param Reactor *r - woken reactor
+ * @param uint64_t wakeups - number of workers to be resumed
+ * @return void
+ */
+static inline void asyncWake(Reactor *r, uint64_t wakeups) {
+
+    while(write(r->wake, &wakeups, sizeof(wakeups)) == -1 && errno == EINTR){}
+}
+
+/**
+ * @description - Start reactor threads of pool, their workers open connections when first file comes
+ * @param std::string host - domain name or IP address of server
+ * @param unsigned short int port - port of server
+ * @param int connections - max connections of pool, one per worker coroutine
+ * @param int threads - number of reactor threads, 0 = one per core
+ * @return AsyncPool * - pool, NULL when server address is unknown or reactor can't be created
+ */
+static inline AsyncPool *asyncCreate(std::string host, unsigned short int port, int connections, int threads) {
+
+    struct addrinfo hints, *res;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(connections < 1 || getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0){
+        return NULL;
+    }
+    AsyncPool *pool = new AsyncPool;
+    memcpy(&pool->addr, res->ai_addr, res->ai_addrlen);
+    pool->addrLen = res->ai_addrlen;
+    freeaddrinfo(res);
+    pool->pending = 0;
+    pool->closing = false;
+    pool->nextReactor = 0;
+
+    //every transfer holds one descriptor for connection and one for file
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) == 0){
+        limit.rlim_cur = limit.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &limit);
+    }
+
+    if(threads <= 0){
+        threads = (int) std::thread::hardware_concurrency();
+    }
+    threads = threads < 1 ? 1 : threads > connections ? connections : threads;
+
+    for(int i = 0; i < threads; i++){
+        Reactor *r = new Reactor;
+        r->pool = pool;
+        r->running = (i + 1) * connections / threads - i * connections / threads;
+        r->spare = 0;
+        r->swept = std::chrono::steady_clock::now();
+        r->epoll = epoll_create1(EPOLL_CLOEXEC);
+        r->wake = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        struct epoll_event ev;
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = NULL;     //wakeup, sockets point to their AsyncSocket
+        pool->reactors.push_back(r);
+        if(r->epoll == -1 || r->wake == -1 || epoll_ctl(r->epoll, EPOLL_CTL_ADD, r->wake, &ev) == -1){
+            for(size_t j = 0; j < pool->reactors.size(); j++){
+                Reactor *created = pool->reactors[j];
+                if(created->epoll != -1){ close(created->epoll); }
+                if(created->wake != -1){ close(created->wake); }
+                delete created;
+            }
+            delete pool;
+            return NULL;
+        }
+    }
+    for(size_t i = 0; i < pool->reactors.size(); i++){
+        pool->threads.push_back(std::thread(&asyncThread, pool->reactors[i], pool->reactors[i]->running));
+    }
+    return pool;
+}
+
+/**
+ * @description - Submit file to pool, thread safe, it may be called by done of other file too
+ * @param AsyncPool *pool - running pool
+ * @param AsyncOp *op - file, it must stay valid until it is finished
+ * @return void
+ */
+static inline void asyncSubmit(AsyncPool *pool, AsyncOp *op) {
+
+    Reactor *woken = NULL;
+    {
+        std::lock_guard<std::mutex> lock(pool->mtx);
+        pool->queue.push_back(op);
+        pool->pending++;
+
+        //busy workers take the file when they end otherwise
+        size_t count = pool->reactors.size();
+        for(size_t i = 0; i < count; i++){
+            Reactor *r = pool->reactors[(pool->nextReactor + i) % count];
+            if(r->spare > 0){
+                r->spare--;
+                woken = r;
+                pool->nextReactor = (pool->nextReactor + i + 1) % count;
+                break;
+            }
+        }
+    }
+    if(woken != NULL){
+        asyncWake(woken, 1);
+    }
+}
+
+/**
+ * @description - Wait until all submitted files are finished, it must not be called by done
+ * @param AsyncPool *pool - running pool
+ * @return void
+ */
+static inline void asyncWait(AsyncPool *pool) {
+
+    std::unique_lock<std::mutex> lock(pool->mtx);
+    pool->finished.wait(lock, [pool]{ return pool->pending == 0; });
+}
+
+/**
+ * @description - Finish submitted files, close connections and end reactor threads of pool
+ * @param AsyncPool *pool - running pool, it is freed
+ * @return void
+ */
+static inline void asyncClose(AsyncPool *pool) {
+
+    asyncWait(pool);
+    {
+        std::lock_guard<std::mutex> lock(pool->mtx);
+        pool->closing = true;
+    }
+    for(size_t i = 0; i < pool->reactors.size(); i++){
+        asyncWake(pool->reactors[i], ASYNC_CLOSE);
+    }
+    for(size_t i = 0; i < pool->threads.size(); i++){
+        pool->threads[i].join();
+    }
+    for(size_t i = 0; i < pool->reactors.size(); i++){
+        close(pool->reactors[i]->epoll);
+        close(pool->reactors[i]->wake);
+        delete pool->reactors[i];
+    }
+    delete pool;
+}
+
+/**
+ * @description - Transfer files by pool of worker coroutines spread over reactors of more threads
+ *                Every worker has own connection reused by its files, size, status and error of files are set
+ * @param std::string host - domain name or IP address of server
+ * @param unsigned short int port - port of server
+ * @param std::vector<AsyncOp> &ops - files to be transferred
+ * @param int concurrency - number of transfers running at once
+ * @param int threads - number of reactor threads, 0 = one per core
+ * @return int - EXIT_SUCCESS when pool was started, results are in ops
+ */
+static inline int asyncTransfer(std::string host, unsigned short int port, std::vector<AsyncOp> &ops,
+                                int concurrency, int threads) {
+
+    if(ops.empty()){
+        return EXIT_SUCCESS;
+    }
+    AsyncPool *pool = asyncCreate(host, port, concurrency < (int) ops.size() ? concurrency : (int) ops.size(), threads);
+    if(pool == NULL){
+        return EXIT_FAILURE;
+    }
+    for(size_t i = 0; i < ops.size(); i++){
+        asyncSubmit(pool, &ops[i]);
+    }
+    asyncClose(pool);
+    return EXIT_SUCCESS;
+}
+
+#endif //ASYNC_H
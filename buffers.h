@@ -0,0 +1,211 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: Pool of transfer buffers and tuning of socket buffers shared by client and server
+ */
+
+#ifndef BUFFERS_H
+#define BUFFERS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <mutex>
+#include <vector>
+
+#define BUFFER_MIN (64 * 1024)          //smallest transfer buffer
+#define BUFFER_MAX (4 * 1024 * 1024)    //biggest transfer buffer
+#define BUFFER_DEFAULT (256 * 1024)
+#define BUFFER_SLAB (2 * 1024 * 1024)   //slabs are multiples of huge page
+#define BUFFER_LOCAL 16                 //free buffers kept by one thread, the rest is returned to pool
+
+/*Slabs carved to buffers of the same size, free buffers are shared by all threads*/
+struct BufferPool{
+    std::mutex mtx;
+    size_t size;                //bytes of one buffer
+    std::vector<char *> free;   //buffers returned by threads
+    BufferPool() : size(BUFFER_DEFAULT) {}
+};
+
+/**
+ * @description - Get pool of process, it lives until the process ends
+ * @return BufferPool & - pool of transfer buffers
+ */
+static inline BufferPool &bufferPool() {
+
+    static BufferPool pool;     //built once, thread safe
+    return pool;
+}
+
+/*Free buffers of one thread, they are returned to pool when thread ends*/
+struct BufferCache{
+    std::vector<char *> free;
+    ~BufferCache() {
+        BufferPool &pool = bufferPool();
+        std::lock_guard<std::mutex> lock(pool.mtx);
+        pool.free.insert(pool.free.end(), free.begin(), free.end());
+    }
+};
+
+/**
+ * @description - Get freelist of calling thread
+ * @return BufferCache & - free buffers of thread
+ */
+static inline BufferCache &bufferCache() {
+
+    static thread_local BufferCache cache;
+    return cache;
+}
+
+/**
+ * @description - Set size of transfer buffers, must be called before first buffer is acquired
+ * @param size_t size - requested bytes, clamped to BUFFER_MIN .. BUFFER_MAX and rounded to 4 KiB
+ * @return size_t - used size
+ */
+static inline size_t bufferInit(size_t size) {
+
+    size = (size + 4095) & ~(size_t) 4095;
+    size = size < BUFFER_MIN ? BUFFER_MIN : size > BUFFER_MAX ? BUFFER_MAX : size;
+    bufferPool().size = size;
+    return size;
+}
+
+/**
+ * @description - Get size of transfer buffers
+ * @return size_t - bytes of one buffer
+ */
+static inline size_t bufferSize() {
+
+    return bufferPool().size;
+}
+
+/**
+ * @description - Map new slab, huge pages are used when reserved, otherwise transparent ones are asked for
+ * @param size_t len - bytes of slab, multiple of BUFFER_SLAB
+ * @return char * - slab, NULL on failure
+ */
+static inline char *bufferSlab(size_t len) {
+
+    void *slab = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    slab = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if(slab != MAP_FAILED){
+        return (char *) slab;
+    }
+#endif
+    slab = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(slab == MAP_FAILED){
+        return NULL;
+    }
+#ifdef MADV_HUGEPAGE
+    madvise(slab, len, MADV_HUGEPAGE);     //just a hint, ignore failure
+#endif
+    return (char *) slab;
+}
+
+/**
+ * @description - Take transfer buffer from freelist of thread, it is refilled from pool or new slab
+ *                Content of buffer is not zeroed, it is always overwritten by received or read data
+ * @return char * - buffer of bufferSize() bytes, NULL when no memory is left
+ */
+static inline char *bufferAcquire() {
+
+    BufferCache &cache = bufferCache();
+    if(cache.free.empty()){
+        size_t size = bufferSize();
+        BufferPool &pool = bufferPool();
+        std::lock_guard<std::mutex> lock(pool.mtx);
+
+        //half of thread's freelist is refilled at once, so the lock is not taken by every buffer
+        while(!pool.free.empty() && cache.free.size() < BUFFER_LOCAL / 2){
+            cache.free.push_back(pool.free.back());
+            pool.free.pop_back();
+        }
+        if(cache.free.empty()){
+            size_t len = (size + BUFFER_SLAB - 1) / BUFFER_SLAB * BUFFER_SLAB;
+            char *slab = bufferSlab(len);
+            if(slab == NULL){
+                return NULL;
+            }
+            for(size_t off = 0; off + size <= len; off += size){
+                cache.free.push_back(slab + off);
+            }
+        }
+    }
+    char *buffer = cache.free.back();
+    cache.free.pop_back();
+    return buffer;
+}
+
+/**
+ * @description - Return transfer buffer to freelist of thread, it may be acquired by other thread than released
+ * @param char *buffer - buffer from bufferAcquire, NULL is ignored
+ * @return void
+ */
+static inline void bufferRelease(char *buffer) {
+
+    if(buffer == NULL){
+        return;
+    }
+    BufferCache &cache = bufferCache();
+    cache.free.push_back(buffer);
+
+    //surplus of thread which releases more than it acquires goes back to pool
+    if(cache.free.size() > BUFFER_LOCAL){
+        BufferPool &pool = bufferPool();
+        std::lock_guard<std::mutex> lock(pool.mtx);
+        while(cache.free.size() > BUFFER_LOCAL / 2){
+            pool.free.push_back(cache.free.back());
+            cache.free.pop_back();
+        }
+    }
+}
+
+/**
+ * @description - Get buffer of calling thread for data used just within one call, it is never released
+ * @return char * - buffer of bufferSize() bytes, NULL when no memory is left
+ */
+static inline char *threadBuffer() {
+
+    static thread_local char *buffer = bufferAcquire();
+    return buffer;
+}
+
+/**
+ * @description - Read max size of socket buffer reachable by kernel autotuning
+ * @param const char *path - /proc/sys/net/ipv4/tcp_wmem or tcp_rmem, lines "min default max"
+ * @return long - max bytes, -1 when unknown
+ */
+static inline long autotuneMax(const char *path) {
+
+    FILE *f = fopen(path, "r");
+    if(f == NULL){
+        return -1;
+    }
+    long min, def, max;
+    int fields = fscanf(f, "%ld %ld %ld", &min, &def, &max);
+    fclose(f);
+    return fields == 3 ? max : -1;
+}
+
+/**
+ * @description - Make socket buffers hold two transfer buffers, so one is in flight while next is filled
+ *                Kernel autotuning is kept when it can grow the buffer enough, setting size would turn it off
+ *                Has to be called before connect / listen, so window scale is negotiated for the size
+ * @param int socket - socket of transfers
+ * @return void
+ */
+static inline void tuneSocket(int socket) {
+
+    static const long sendMax = autotuneMax("/proc/sys/net/ipv4/tcp_wmem");     //read once, thread safe
+    static const long recvMax = autotuneMax("/proc/sys/net/ipv4/tcp_rmem");
+    int want = (int)(2 * bufferSize());
+    if(sendMax != -1 && sendMax < want){
+        setsockopt(socket, SOL_SOCKET, SO_SNDBUF, (void *)&want, sizeof(want));    //capped by wmem_max, ignore failure
+    }
+    if(recvMax != -1 && recvMax < want){
+        setsockopt(socket, SOL_SOCKET, SO_RCVBUF, (void *)&want, sizeof(want));
+    }
+}
+
+#endif //BUFFERS_H
@@ -0,0 +1,93 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: CRC32C checksum of transferred data shared by client and server
+ */
+
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include <stdint.h>
+#include <string.h>
+#include <stddef.h>
+
+#define CRC32C_POLY 0x82F63B78  //reversed Castagnoli polynomial
+
+/*Table of software CRC32C, one entry per byte value*/
+struct Crc32cTable{
+    uint32_t entry[256];
+    Crc32cTable() {
+        for(uint32_t i = 0; i < 256; i++){
+            uint32_t crc = i;
+            for(int bit = 0; bit < 8; bit++){
+                crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLY : 0);
+            }
+            entry[i] = crc;
+        }
+    }
+};
+
+/**
+ * @description - Continue CRC32C by table, byte after byte
+ * @param uint32_t crc - inverted checksum of previous data
+ * @param const unsigned char *p - next data
+ * @param size_t len - bytes of data
+ * @return uint32_t - inverted checksum including data
+ */
+static inline uint32_t crc32cSoft(uint32_t crc, const unsigned char *p, size_t len) {
+
+    static const Crc32cTable table;     //built once, thread safe
+    while(len-- > 0){
+        crc = table.entry[(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+
+/**
+ * @description - Continue CRC32C by crc32 instruction of SSE4.2, 8 bytes at once
+ * @param uint32_t crc - inverted checksum of previous data
+ * @param const unsigned char *p - next data
+ * @param size_t len - bytes of data
+ * @return uint32_t - inverted checksum including data
+ */
+__attribute__((target("sse4.2")))
+static inline uint32_t crc32cHard(uint32_t crc, const unsigned char *p, size_t len) {
+
+    uint64_t crc64 = crc;
+    while(len >= 8){
+        uint64_t word;
+        memcpy(&word, p, 8);    //data needn't be aligned
+        crc64 = _mm_crc32_u64(crc64, word);
+        p += 8;
+        len -= 8;
+    }
+    crc = (uint32_t) crc64;
+    while(len-- > 0){
+        crc = _mm_crc32_u8(crc, *p++);
+    }
+    return crc;
+}
+#endif
+
+/**
+ * @description - Continue checksum of stream by next data, instruction of CPU is used when available
+ * @param uint32_t crc - checksum of previous data, 0 at the beginning of stream
+ * @param const char *data - next data of stream
+ * @param size_t len - bytes of data
+ * @return uint32_t - checksum of stream including data
+ */
+static inline uint32_t crc32c(uint32_t crc, const char *data, size_t len) {
+
+    const unsigned char *p = (const unsigned char *) data;
+#if defined(__x86_64__)
+    static const bool hard = __builtin_cpu_supports("sse4.2");
+    if(hard){
+        return ~crc32cHard(~crc, p, len);
+    }
+#endif
+    return ~crc32cSoft(~crc, p, len);
+}
+
+#endif //CHECKSUM_H
@@ -11,17 +11,58 @@
 #include <getopt.h>
 #include <string.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <fstream>
 #include <arpa/inet.h> //inet_addr
 #include <fcntl.h>
 #include <unistd.h>
 #include <sstream>
 #include <netdb.h> //gethostbyname
+#include <signal.h>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
+#include <iomanip>
+#include <dirent.h>
+#include <unordered_map>
+#include <sys/stat.h>
+#include <sys/mman.h>
 //#include <sys/sendfile.h>     //not supported on freeBSD
 
+#ifndef URING
+#define URING 1         //build with -DURING=0 when kernel headers have no io_uring
+#endif
+
+#if URING
+#include "uring.h"
+#endif
+
+#include "frame.h"
+#include "encoding.h"
+#include "checksum.h"
+#include "dedup.h"
+#include "delta.h"
+#include "buffers.h"
+#include "archive.h"
+#include "clientlib.h"
+
 #define EXIT_SUCCESS 0
 #define EXIT_FAILURE 1
 #define MAX_BUFF_SIZE 4096
+#define PIPELINE_DEPTH 8    //requests sent ahead of responses on persistent connection
+#define PARALLEL_CONNECTIONS 4  //connections of batch transfer
+#define RANGE_CHUNK (8 * 1024 * 1024)   //min bytes requested by one stream of parallel download
+
+/*Globals declarations*/
+bool uringMode = false; //transfer data by io_uring
+int compressLevel = 0;  //level of Encoding:deflate, 0 = data are not encoded
+bool checksumMode = false;  //transferred data are verified by CRC32C of server
+bool dedupMode = false; //uploads send just chunks server does not have
+bool deltaMode = false; //uploads send just blocks which differ from server's copy
+std::mutex connectMtx;  //gethostbyname is not thread safe
 
 using namespace std;
 
@@ -35,7 +76,86 @@ enum ReqAns{
     Unknown,    //if server received unrecognized request
     TooLong,    //request was too long
     Incomplete, //request was incomplete
-    Overloaded  //server is overloaded
+    Overloaded, //server is overloaded
+    Archive     //archive operation, more files are received in one stream
+};
+
+/*One file to be transferred*/
+struct Op{
+    ReqAns type;        //Up or Down
+    string filename;
+    long size;          //size of uploaded or downloaded file
+    uint32_t crc;       //CRC32C of sent data of upload
+};
+
+/*Connection to the server reused by following transfers*/
+struct Session{
+    string host;
+    unsigned short int port;
+    int socket;         //-1 when not connected
+    bool keepAlive;     //server keeps connection opened
+    bool binary;        //server accepts binary requests on this connection
+    bool encoded;       //server understands Encoding:deflate
+    int depth;          //max requests sent ahead of their responses
+    int done;           //successful transfers
+    int failed;         //failed transfers
+    long bytes;         //bytes of successful transfers
+};
+
+/*Files waiting for one connection of batch, idle connections steal from its back*/
+struct WorkQueue{
+    std::mutex mtx;
+    std::deque<Op> ops;
+};
+
+/*Files transferred by pool of connections*/
+struct Batch{
+    string host;
+    unsigned short int port;
+    int depth;
+    vector<WorkQueue *> queues;     //one queue per connection
+    std::mutex mtx;                 //guards results
+    int done;
+    int failed;
+    long bytes;
+};
+
+/*Requests sent ahead of their responses on persistent connection*/
+struct Pipeline{
+    int socket;
+    vector<Op> *ops;
+    size_t depth;       //max requests waiting for response
+    bool binary;        //requests and responses are binary frames
+    bool encoded;       //data are sent as encoded blocks
+    size_t sent;        //index of next request to be sent
+    size_t answered;    //index of next response to be received
+    bool failed;        //sending failed, nothing more will be sent
+    bool aborted;       //receiving failed, sender has to stop
+    std::mutex mtx;
+    std::condition_variable cond;
+};
+
+/*Signatures of blocks of server's copy of uploaded file*/
+struct Signatures{
+    string records;     //DELTA_RECORD bytes per block
+    std::unordered_multimap<uint32_t, uint32_t> weak;  //weak checksum -> block
+    vector<bool> tags;  //16 bit tags of weak checksums, most windows are rejected by them
+    size_t block;       //bytes of block
+    long size;          //size of server's copy
+    size_t blocks;
+};
+
+/*One file downloaded by more streams, every stream fetches chunks by ranged requests*/
+struct RangedDownload{
+    string host;
+    unsigned short int port;
+    string filename;
+    int file;           //preallocated file, chunks are written by pwrite
+    long size;          //size of whole file
+    long chunk;         //bytes of one chunk
+    long next;          //offset of next chunk to be fetched
+    bool failed;        //some chunk failed, other streams stop
+    std::mutex mtx;
 };
 
 /*--------Prototypes---------*/
@@ -44,21 +164,68 @@ int createConnection(string host, unsigned short int port, int *socket_desc);
 long fileSizeFunc(string filename);
 int sendRequest(int socket, string request);
 int receiveResponse(int socket, char *buffer);
-int download(int socket_desc, string request, string filename);
-int upload(int socket_desc, string request, string filename);
+int sendFrame(int socket, ReqAns type, int flags, string filename, long length);
+int receiveFrame(int socket, Frame *f);
+int checkStatus(int status_code);
+int download(int socket_desc, string request, Op &op, Session *s);
+int upload(int socket_desc, string request, Op &op, Session *s);
+int receiveData(int socket_desc, string filename, long fileSize, uint32_t *crc);
+int sendData(int socket_desc, string filename, off_t offset, long length, uint32_t *crc);
+int receiveBlocks(int socket_desc, string filename, long fileSize, uint32_t *crc);
+int sendBlocks(int socket_desc, string filename, off_t offset, long length, uint32_t *crc);
+int receiveChecksum(int socket_desc, bool binary, uint32_t crc, bool *keepAlive);
+int verifyChecksum(long digest, uint32_t crc);
+int chunkFile(string filename, long fileSize, string &list);
+int sendChunks(int socket_desc, string filename, const string &list, Session *s);
+int sendBytes(int socket_desc, const char *data, size_t len);
+int sendDelta(int socket_desc, string filename, long fileSize, const char *response);
+long findBlock(const Signatures &sig, uint32_t sum, const char *data, size_t len);
+int deltaCopy(int socket_desc, string &out, uint32_t first, uint32_t count);
+int deltaData(int socket_desc, string &out, const char *data, size_t len);
+string partName(string path);
+int resumeDownload(int socket_desc, Op &op);
+int readManifest(string manifest, vector<Op> &ops);
+int listDirectory(string dir, vector<Op> &ops);
+int transferBatch(string host, unsigned short int port, vector<Op> &ops, int depth, int parallel);
+void batchWorker(Batch *b, size_t id);
+bool takeWork(Batch *b, size_t id, vector<Op> &work);
+int transferFiles(Session *s, vector<Op> &ops);
+size_t pipelineOps(Session *s, vector<Op> &ops, size_t first);
+void sendRequests(Pipeline *pl);
+int receiveOp(int socket_desc, Op &op, bool binary);
+long uringTransfer(int in, bool inSocket, int out, bool outSocket, off_t offset, long length, uint32_t *crc);
+long parseAttribute(const char *response, string name);
+int rangedDownload(string host, unsigned short int port, Op &op, int streams);
+void rangeWorker(RangedDownload *rd, int socket_desc);
+int receiveRange(int socket_desc, int fd, off_t offset, long length, uint32_t *crc);
+int readNames(string manifest, string &names);
+int downloadArchive(int socket_desc, string pattern, const string &names);
+int unpackArchive(int socket_desc, long *files, long *bytes);
+int fillArchive(int socket_desc, char *buffer, size_t *pos, size_t *len, size_t need);
+int asyncBatch(string host, unsigned short int port, vector<Op> &ops, int concurrency);
 
 int main(int argc, char *argv[]) {
     int socket_desc = 0;
     unsigned short int port = 0;
     string host;
-    string filename;
-    bool p, h, d, u;
-    p = h = d = u = false;
+    vector<Op> ops;
+    int depth = PIPELINE_DEPTH;
+    int parallel = PARALLEL_CONNECTIONS;
+    int streams = 1;
+    int concurrency = 0;    //transfers of coroutine engine, 0 = engine is not used
+    bool resume = false;
+    long bufferKiB = BUFFER_DEFAULT / 1024;
+    string manifest;
+    string dir;
+    string pattern;     //files of archive
+    string archiveList;
+    bool p, h;
+    p = h = false;
 
     //check arguments -p -h; optional -d -u
     int option;
     opterr = 0; // getopt will not print it's error messages
-    while ((option = getopt(argc, argv, "p:h:d:u:")) != -1) {
+    while ((option = getopt(argc, argv, "p:h:d:u:iP:l:D:j:s:rz:cxyB:a:A:C:")) != -1) {
         switch (option) {
             case 'p':
                 try {
@@ -74,18 +241,85 @@ int main(int argc, char *argv[]) {
                 h = true;
                 break;
             case 'd':
-                filename = optarg;
-                d = true;
+                ops.push_back(Op{Down, optarg, 0, 0});
                 break;
             case 'u':
-                filename = optarg;
-                u = true;
+                ops.push_back(Op{Up, optarg, 0, 0});
+                break;
+            case 'i':
+#if URING
+                uringMode = true;
+#else
+                cerr << "Client was built without io_uring" << endl;
+#endif
+                break;
+            case 'P':
+                istringstream (optarg) >> depth;
+                break;
+            case 'l':
+                manifest = optarg;
+                break;
+            case 'D':
+                dir = optarg;
+                break;
+            case 'j':
+                istringstream (optarg) >> parallel;
+                break;
+            case 's':
+                istringstream (optarg) >> streams;
+                break;
+            case 'r':
+                resume = true;
+                break;
+            case 'z':
+                istringstream (optarg) >> compressLevel;
+                break;
+            case 'c':
+                checksumMode = true;
+                break;
+            case 'x':
+                dedupMode = true;
+                break;
+            case 'y':
+                deltaMode = true;
+                break;
+            case 'B':
+                istringstream (optarg) >> bufferKiB;
+                break;
+            case 'a':
+                pattern = optarg;
+                break;
+            case 'A':
+                archiveList = optarg;
+                break;
+            case 'C':
+                istringstream (optarg) >> concurrency;
                 break;
             default:
                 cerr << "Wrong arguments" << endl;
                 cerr << "HELP:" << endl;
-                cerr << "./client -p <port_number> -h <host_addr> -d/-u <filename>" << endl;
-                cerr << " -d -> download file from server\n -u -> upload file to server\n\n";
+                cerr << "./client -p <port_number> -h <host_addr> -d/-u <filename> [-d/-u <filename> ...] [-l <manifest>]"
+                     << " [-D <directory>] [-j <connections>] [-P <depth>] [-s <streams>] [-r] [-z <level>] [-c] [-x] [-y] [-B <KiB>] [-i]" << endl;
+                cerr << "./client -p <port_number> -h <host_addr> -C <transfers> -d/-u <filename> [...] [-l <manifest>] [-D <directory>] [-B <KiB>]" << endl;
+                cerr << "./client -p <port_number> -h <host_addr> -a <pattern> / -A <list> [-B <KiB>]" << endl;
+                cerr << " -d -> download file from server\n -u -> upload file to server\n";
+                cerr << " -l -> transfer files listed in manifest, lines 'd <filename>' or 'u <filename>', - is stdin\n";
+                cerr << " -D -> upload all files of directory and its subdirectories\n";
+                cerr << " -j -> number of parallel connections transferring more files (default: " << PARALLEL_CONNECTIONS << ")\n";
+                cerr << " -s -> download single file by more parallel connections, each fetches its chunks\n";
+                cerr << " -r -> resume interrupted transfer of single file, just missing bytes are sent\n";
+                cerr << " -P -> more files are transferred over one connection, number of requests sent ahead (default: "
+                     << PIPELINE_DEPTH << ")\n";
+                cerr << " -z -> compress transferred data by Encoding:deflate of level 1-9 when server understands it\n";
+                cerr << " -c -> verify transferred data by CRC32C computed by server\n";
+                cerr << " -x -> upload just chunks of files server does not have yet\n";
+                cerr << " -y -> upload just blocks of files which differ from server's copy\n";
+                cerr << " -B -> size of transfer buffers, " << BUFFER_MIN / 1024 << "-" << BUFFER_MAX / 1024
+                     << " (default: " << BUFFER_DEFAULT / 1024 << ")\n";
+                cerr << " -a -> download files matching pattern (f.e. '*.txt') by one archive stream\n";
+                cerr << " -A -> download files listed in file, one name per line, - is stdin, by one archive stream\n";
+                cerr << " -C -> transfer files by coroutines, number of transfers running at once, each has own connection\n";
+                cerr << " -i -> transfer data by io_uring\n\n";
                 return EXIT_FAILURE;
         }
     }
@@ -93,14 +327,85 @@ int main(int argc, char *argv[]) {
         cerr << "-p and -h arguments are required" << endl;
         return EXIT_FAILURE;
     }
-    if (d && u) {
-        cerr << "only -d or -u argument allowed" << endl;
+    if (manifest != "" && readManifest(manifest, ops) == EXIT_FAILURE) {
+        return EXIT_FAILURE;
+    }
+    if (dir != "" && listDirectory(dir, ops) == EXIT_FAILURE) {
         return EXIT_FAILURE;
     }
-    if (!d && !u) {
+    if (ops.empty() && pattern == "" && archiveList == "") {
         cerr << "-d or -u argument is required" << endl;
         return EXIT_FAILURE;
     }
+    if (depth < 1) {
+        cerr << "-P expects positive number" << endl;
+        return EXIT_FAILURE;
+    }
+    if (parallel < 1) {
+        cerr << "-j expects positive number" << endl;
+        return EXIT_FAILURE;
+    }
+    if (streams < 1) {
+        cerr << "-s expects positive number" << endl;
+        return EXIT_FAILURE;
+    }
+    if (concurrency < 0) {
+        cerr << "-C expects positive number" << endl;
+        return EXIT_FAILURE;
+    }
+    if (compressLevel < 0 || compressLevel > 9) {
+        cerr << "-z expects level 0-9" << endl;
+        return EXIT_FAILURE;
+    }
+    if (bufferKiB < BUFFER_MIN / 1024 || bufferKiB > BUFFER_MAX / 1024) {
+        cerr << "-B expects size " << BUFFER_MIN / 1024 << "-" << BUFFER_MAX / 1024 << " KiB" << endl;
+        return EXIT_FAILURE;
+    }
+    bufferInit((size_t) bufferKiB * 1024);
+    if (resume && (ops.size() > 1 || streams > 1)) {
+        cerr << "-r can be used just for transfer of single file by one stream" << endl;
+        return EXIT_FAILURE;
+    }
+
+    //server closing connection while requests are sent must not kill the client
+    signal(SIGPIPE, SIG_IGN);
+
+    //many small files come in one stream, without request per file
+    if (pattern != "" || archiveList != "") {
+        string names;
+        if (!ops.empty() || (pattern != "" && archiveList != "")) {
+            cerr << "-a / -A can't be combined with other transfers" << endl;
+            return EXIT_FAILURE;
+        }
+        if (archiveList != "" && readNames(archiveList, names) == EXIT_FAILURE) {
+            return EXIT_FAILURE;
+        }
+        if (createConnection(host, port, &socket_desc) == EXIT_FAILURE) {
+            return EXIT_FAILURE;
+        }
+        int res = downloadArchive(socket_desc, pattern, names);
+        close(socket_desc);
+        return res;
+    }
+
+    //thousands of transfers are multiplexed by coroutines on few threads
+    if (concurrency > 0) {
+        if (compressLevel > 0 || checksumMode || dedupMode || deltaMode || resume || streams > 1 || uringMode) {
+            cerr << "-C transfers raw data, it can't be combined with -z, -c, -x, -y, -r, -s or -i" << endl;
+            return EXIT_FAILURE;
+        }
+        return asyncBatch(host, port, ops, concurrency);
+    }
+
+    //more files are spread over persistent connections
+    if (ops.size() > 1) {
+        return transferBatch(host, port, ops, depth, parallel);
+    }
+
+    //large file is split among more streams
+    if (streams > 1 && ops[0].type == Down) {
+        return rangedDownload(host, port, ops[0], streams);
+    }
 
     //create connection
     if (createConnection(host, port, &socket_desc) == EXIT_FAILURE) {
@@ -110,20 +415,28 @@ int main(int argc, char *argv[]) {
     //create request
     string request;
     ostringstream strOp;
-    if(d){ strOp << Down; }
-    else { strOp << Up;   }
+    strOp << ops[0].type;
     request.append(strOp.str());
-    request.append("\nFile:" + filename);
+    request.append("\nFile:" + ops[0].filename);
+
+    if (ops[0].type == Down && resume) { //download continuing partial file
 
-    if (d) { //download
+        if (resumeDownload(socket_desc, ops[0]) == EXIT_FAILURE) {
+            return EXIT_FAILURE;
+        }
+    }
+    else if (ops[0].type == Down) { //download
 
-        if (download(socket_desc, request, filename) == EXIT_FAILURE) {
+        if (download(socket_desc, request, ops[0], NULL) == EXIT_FAILURE) {
             return EXIT_FAILURE;
         }
     }
     else { //upload
 
-        if (upload(socket_desc, request, filename) == EXIT_FAILURE) {
+        if (resume) {
+            request.append("\nResume:1");  //server continues partial file and tells offset
+        }
+        if (upload(socket_desc, request, ops[0], NULL) == EXIT_FAILURE) {
             return EXIT_FAILURE;
         }
     }
@@ -162,11 +475,16 @@ int ipv6Connection(string host, unsigned short int port, int *socket_desc){
     addr.sin6_port = htons(port);
     memcpy(&addr.sin6_addr.s6_addr, server->h_addr_list[0], (size_t)server->h_length);
 
+    tuneSocket(*socket_desc);   //before connect, so window scale fits the size
     if((connect( *socket_desc, (struct sockaddr*) &addr, sizeof(addr) )) < 0){
         cerr << "Unable to connect" << endl;
         return EXIT_FAILURE;
     }
 
+    //pipelined requests and small files are sent at once, without waiting for ACK of previous segment
+    int yes = 1;
+    setsockopt(*socket_desc, IPPROTO_TCP, TCP_NODELAY, (void *)&yes, sizeof(yes));
+
     return EXIT_SUCCESS;
 }
 
@@ -204,11 +522,16 @@ int createConnection(string host, unsigned short int port, int *socket_desc) {
     addr.sin_port = htons(port);
     memcpy(&addr.sin_addr.s_addr, server->h_addr_list[0], (size_t)server->h_length);
 
+    tuneSocket(*socket_desc);   //before connect, so window scale fits the size
     if((connect( *socket_desc, (struct sockaddr*) &addr, sizeof(addr) )) < 0){
         cerr << "Unable to connect" << endl;
         return EXIT_FAILURE;
     }
 
+    //pipelined requests and small files are sent at once, without waiting for ACK of previous segment
+    int yes = 1;
+    setsockopt(*socket_desc, IPPROTO_TCP, TCP_NODELAY, (void *)&yes, sizeof(yes));
+
     return EXIT_SUCCESS;
 }
 
@@ -270,25 +593,32 @@ int sendRequest(int socket, string request) {
  * @return int - success = 0, failure = 1
  */
 int receiveResponse(int socket, char *buffer) {
-    memset(buffer, 0, MAX_BUFF_SIZE);
+    buffer[0] = '\0';  //attributes are searched even in failed response, nothing else has to be zeroed
     bool entireMsg = false;
     int received =0;
     int total = 0;
 
-    while(true){
-
-        received =(int) recv(socket, buffer, (size_t)(MAX_BUFF_SIZE - total), 0);
-
-        string str(buffer);
+    while(total < MAX_BUFF_SIZE - 1){
 
-        if(str.find("\n\n") != string::npos){
-            entireMsg = true;
-            break;
-        }
+        //just peek, data following the response have to stay in socket
+        received =(int) recv(socket, buffer + total, (size_t)(MAX_BUFF_SIZE - 1 - total), MSG_PEEK);
         if (received <= 0){
             break;
         }
-        total += received;
+        buffer[total + received] = '\0';   //just peeked part is searched
+
+        char *end = strstr(buffer + (total > 0 ? total - 1 : 0), "\n\n");
+        if(end == NULL){ //consume peeked part and wait for the rest
+            total += (int) recv(socket, buffer + total, (size_t) received, 0);
+            continue;
+        }
+
+        //consume response with its terminating zero
+        int msgLen = (int)(end - buffer) + 3;
+        recv(socket, buffer + total, (size_t)(msgLen - total), MSG_WAITALL);
+        buffer[msgLen - 1] = '\0';
+        entireMsg = true;
+        break;
     }
 
     if(!entireMsg){
@@ -296,7 +626,82 @@ int receiveResponse(int socket, char *buffer) {
         return EXIT_FAILURE;
     }
 
-    int status_code = buffer[0] - '0';
+    return checkStatus(buffer[0] - '0');
+}
+
+/**
+ * @description - Send binary request, its header is followed by file name
+ * @param int socket - opened socket to the server
+ * @param ReqAns type - Up or Down
+ * @param int flags - FRAME_* flags of request
+ * @param string filename - name of transferred file
+ * @param long length - length of uploaded file
+ * @return int - success = 0, failure = 1
+ */
+int sendFrame(int socket, ReqAns type, int flags, string filename, long length) {
+
+    if(filename.length() > MAX_BUFF_SIZE - 1 - FRAME_HEADER_SIZE){
+        cerr << "Too long request" << endl;
+        return EXIT_FAILURE;
+    }
+
+    char buffer[MAX_BUFF_SIZE];
+    Frame f;
+    f.version = FRAME_VERSION;
+    f.opcode = (uint8_t) type;
+    f.flags = (uint8_t) flags;
+    f.nameLen = (uint16_t) filename.length();
+    f.length = length > 0 ? (uint64_t) length : 0;
+    f.offset = 0;
+    f.size = 0;
+    frameEncode(buffer, &f);
+    memcpy(buffer + FRAME_HEADER_SIZE, filename.data(), filename.length());
+
+    size_t requestLen = FRAME_HEADER_SIZE + filename.length();
+    size_t sent = 0;
+    while(sent < requestLen){
+        ssize_t bytes = send(socket, buffer + sent, requestLen - sent, 0);
+        if(bytes <= 0){
+            cerr << "Sending request FAILED" << endl;
+            return EXIT_FAILURE;
+        }
+        sent += (size_t) bytes;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Receive binary response and determine the situation
+ * @param int socket - opened socket to the server
+ * @param Frame *f - received header, its flags are cleared when nothing was received
+ * @return int - success = 0, failure = 1
+ */
+int receiveFrame(int socket, Frame *f) {
+
+    char buffer[FRAME_HEADER_SIZE];
+    memset(f, 0, sizeof(*f));
+
+    if(recv(socket, buffer, FRAME_HEADER_SIZE, MSG_WAITALL) != FRAME_HEADER_SIZE
+       || (unsigned char) buffer[0] != FRAME_MAGIC){
+        cerr << "NOT entire response was received" << endl;
+        return EXIT_FAILURE;
+    }
+    frameDecode(buffer, f);
+    if(f->version != FRAME_VERSION){
+        cerr << "Unsupported version of response" << endl;
+        f->flags = 0;
+        return EXIT_FAILURE;
+    }
+    return checkStatus(f->opcode);
+}
+
+/**
+ * @description - Report result of operation received from server
+ * @param int status_code - ReqAns result
+ * @return int - success = 0, failure = 1
+ */
+int checkStatus(int status_code) {
+
     switch (status_code){
         case ACK:
             return EXIT_SUCCESS;
@@ -328,11 +733,18 @@ int receiveResponse(int socket, char *buffer) {
  * @description - Handle download operation
  * @param int socket_desc - opened socket to server
  * @param string request - request which will be sent to server
- * @param string filename - name of file to download
+ * @param Op &op - file to download, its size is set
+ * @param Session *s - keepAlive, binary and encoded are set by response of server, may be NULL
  * @return int - success = 0, failure = 1
  */
-int download(int socket_desc, string request, string filename) {
+int download(int socket_desc, string request, Op &op, Session *s) {
 
+    if(compressLevel > 0){
+        request.append("\nEncoding:deflate");
+    }
+    if(checksumMode){
+        request.append("\nChecksum:crc32c");
+    }
     request.append("\n\n");
     if(sendRequest(socket_desc, request) == EXIT_FAILURE){
         return EXIT_FAILURE;
@@ -340,18 +752,69 @@ int download(int socket_desc, string request, string filename) {
 
     char buffer[MAX_BUFF_SIZE];
 
-    if(receiveResponse(socket_desc, buffer) == EXIT_FAILURE){
+    int res = receiveResponse(socket_desc, buffer);
+    bool encoded = strstr(buffer, "Encoding:deflate") != NULL;
+    if(s != NULL){
+        s->keepAlive = strstr(buffer, "Connection:keep-alive") != NULL;
+        s->binary = strstr(buffer, "Binary:1") != NULL;
+        s->encoded = encoded;
+    }
+    if(res == EXIT_FAILURE){
         return EXIT_FAILURE;
     }
 
     //get file size
-    string str(buffer);
-    size_t index = str.find("Length:");
-    size_t end = (str.substr(index)).find("\n");
-    long fileSize;
-    istringstream (str.substr(index + 7, end - 7)) >> fileSize;
+    long fileSize = parseAttribute(buffer, "Length:");
+
+    //receive file itself, server which does not understand encoding sends it raw
+    uint32_t crc = 0;
+    uint32_t *sum = checksumMode ? &crc : NULL;
+    res = encoded ? receiveBlocks(socket_desc, op.filename, fileSize, sum) : receiveData(socket_desc, op.filename, fileSize, sum);
+    if(res == EXIT_FAILURE){
+        if(s != NULL){
+            s->keepAlive = false; //rest of file is still in the stream
+        }
+        return EXIT_FAILURE;
+    }
+
+    //server which computes checksum sends it in final ACK
+    if(strstr(buffer, "Checksum:crc32c") != NULL
+       && receiveChecksum(socket_desc, false, crc, s != NULL ? &s->keepAlive : NULL) == EXIT_FAILURE){
+        return EXIT_FAILURE;
+    }
+    op.size = fileSize;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Receive data of downloaded file, nothing behind them is read
+ * @param int socket_desc - opened socket to server
+ * @param string filename - name of file to download
+ * @param long fileSize - length of file announced by server
+ * @param uint32_t *crc - checksum updated by received data, may be NULL
+ * @return int - success = 0, failure = 1
+ */
+int receiveData(int socket_desc, string filename, long fileSize, uint32_t *crc) {
+#if URING
+    if(uringMode){
+        int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd == -1){
+            cerr << "Unable to create a file" << endl;
+            return EXIT_FAILURE;
+        }
+        long received = uringTransfer(socket_desc, true, fd, false, 0, fileSize, crc);
+        close(fd);
+        if(received != -1){
+            if(received != fileSize){
+                cerr << "Downloading FAILED, NOT entire file was downloaded" << endl;
+                return EXIT_FAILURE;
+            }
+            return EXIT_SUCCESS;
+        }
+        //io_uring is not available, receive by recv() below
+    }
+#endif
 
-    //receive file itself
     ofstream file; //has automatically ios::out flag
     file.open(filename, ios::binary);
     if( !file.is_open() ){
@@ -359,17 +822,25 @@ int download(int socket_desc, string request, string filename) {
         return EXIT_FAILURE;
     }
 
-    int bytes = 0;
+    char *buffer = threadBuffer();
+    if(buffer == NULL){
+        cerr << "Not enough memory for buffer" << endl;
+        return EXIT_FAILURE;
+    }
+    long bytes = 0;
     int received = 0;
     while(bytes != fileSize) {
 
-        memset(buffer, 0, sizeof(buffer));
-
-        received = (int) recv(socket_desc, buffer, MAX_BUFF_SIZE, 0);
+        //next response may follow the data
+        long left = fileSize - bytes;
+        received = (int) recv(socket_desc, buffer, left < (long) bufferSize() ? (size_t) left : bufferSize(), 0);
 
         if (received <= 0) {
             break;
         }
+        if(crc != NULL){
+            *crc = crc32c(*crc, buffer, (size_t) received);
+        }
         file.write(buffer, received);
         bytes += received;
     }
@@ -388,12 +859,13 @@ int download(int socket_desc, string request, string filename) {
  * @description - Handle upload operation
  * @param int socket_desc - opened socket to server
  * @param string request - request which will be sent to server
- * @param string filename - name of file to upload
+ * @param Op &op - file to upload, its size is set
+ * @param Session *s - keepAlive, binary and encoded are set by responses of server, may be NULL
  * @return int - success = 0, failure = 1
  */
-int upload(int socket_desc, string request, string filename) {
+int upload(int socket_desc, string request, Op &op, Session *s) {
 
-    long fileSize = fileSizeFunc(filename);
+    long fileSize = op.size = fileSizeFunc(op.filename);
     if(fileSize == -1){
         cerr << "Unable to open file or file does not exist" << endl;
         return EXIT_FAILURE;
@@ -401,6 +873,26 @@ int upload(int socket_desc, string request, string filename) {
     ostringstream strSize;
     strSize << fileSize;
 
+    if(compressLevel > 0){
+        request.append("\nEncoding:deflate");
+    }
+    if(checksumMode){
+        request.append("\nChecksum:crc32c");
+    }
+
+    //deduplicated upload announces number of chunks, their list is sent when server repeats it
+    string list;
+    if(dedupMode){
+        if(chunkFile(op.filename, fileSize, list) == EXIT_FAILURE){
+            return EXIT_FAILURE;
+        }
+        ostringstream strChunks;
+        strChunks << list.size() / CHUNK_RECORD;
+        request.append("\nChunks:"+strChunks.str());
+    }
+    if(deltaMode){
+        request.append("\nDelta:1");
+    }
     request.append("\nLength:"+strSize.str()+"\n\n");
 
     if(sendRequest(socket_desc, request) == EXIT_FAILURE) {
@@ -409,49 +901,1606 @@ int upload(int socket_desc, string request, string filename) {
 
     char buffer[MAX_BUFF_SIZE];
 
-    if(receiveResponse(socket_desc, buffer) == EXIT_FAILURE){
+    int res = receiveResponse(socket_desc, buffer);
+    bool encoded = strstr(buffer, "Encoding:deflate") != NULL;
+    if(s != NULL){
+        s->keepAlive = strstr(buffer, "Connection:keep-alive") != NULL;
+        s->binary = strstr(buffer, "Binary:1") != NULL;
+        s->encoded = encoded;
+    }
+    if(res == EXIT_FAILURE){
         return EXIT_FAILURE;
     }
 
-    /*if(sendfile(socket_desc, upload_file, 0, (size_t)fileSize) == -1){    //not supported on freeBSD
-        cerr << "Uploading file FAILED" << endl;
+    //resumed upload sends just data missing on server
+    long offset = parseAttribute(buffer, "Offset:");
+    if(offset < 0 || offset > fileSize){
+        offset = 0;
+    }
+    if(offset > 0){
+        cout << "Upload resumed at byte " << offset << endl;
+    }
+
+    //server which does not understand encoding expects raw data, the one which does not know chunks expects whole file
+    uint32_t crc = 0;
+    uint32_t *sum = checksumMode ? &crc : NULL;
+    if(dedupMode && parseAttribute(buffer, "Chunks:") == (long)(list.size() / CHUNK_RECORD)){
+        res = sendChunks(socket_desc, op.filename, list, s);
+    }
+    else if(deltaMode && parseAttribute(buffer, "Delta:") > 0){    //server has old copy of file
+        res = sendDelta(socket_desc, op.filename, fileSize, buffer);
+    }
+    else{
+        res = encoded ? sendBlocks(socket_desc, op.filename, (off_t) offset, fileSize - offset, sum)
+                      : sendData(socket_desc, op.filename, (off_t) offset, fileSize - offset, sum);
+    }
+    if(res == EXIT_FAILURE){
+        if(s != NULL){
+            s->keepAlive = false;
+        }
         return EXIT_FAILURE;
-    }*/
-    int upload_file = open(filename.c_str(), O_RDONLY); //should exist, because fileSize was successful
+    }
 
-    ssize_t bytes_read = 0;
-    ssize_t bytes_written = 0;
+    res = receiveResponse(socket_desc, buffer);
+    if(s != NULL){
+        s->keepAlive = strstr(buffer, "Connection:keep-alive") != NULL;
+    }
+    if(res == EXIT_FAILURE || verifyChecksum(parseAttribute(buffer, "Crc32c:"), crc) == EXIT_FAILURE){
+        return EXIT_FAILURE;
+    }
+    cout << "Upload was successful" << endl;
+
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Split file to chunks by content and hash them, boundaries do not move when data are inserted before
+ * @param string filename - name of file to upload
+ * @param long fileSize - size of file
+ * @param string &list - records of chunks in order of file, CHUNK_RECORD bytes each
+ * @return int - success = 0, failure = 1
+ */
+int chunkFile(string filename, long fileSize, string &list) {
+
+    list.clear();
+    if(fileSize == 0){
+        return EXIT_SUCCESS;
+    }
+    int fd = open(filename.c_str(), O_RDONLY);
+    void *map = fd == -1 ? MAP_FAILED : mmap(NULL, (size_t) fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(fd != -1){
+        close(fd);
+    }
+    if(map == MAP_FAILED){
+        cerr << "Unable to open file or file does not exist" << endl;
+        return EXIT_FAILURE;
+    }
+    madvise(map, (size_t) fileSize, MADV_SEQUENTIAL);
+
+    const char *data = (const char *) map;
+    unsigned char hash[CHUNK_HASH];
+    char record[CHUNK_RECORD];
+    for(size_t offset = 0; offset < (size_t) fileSize; ){
+        size_t len = chunkLength(data + offset, (size_t) fileSize - offset);
+        SHA256((const unsigned char *)(data + offset), len, hash);
+        chunkRecord(record, hash, len);
+        list.append(record, CHUNK_RECORD);
+        offset += len;
+    }
+    munmap(map, (size_t) fileSize);
+    return EXIT_SUCCESS;
+}
 
-    while (1) {
+/**
+ * @description - Send chunk list, receive bitmap of chunks server does not have and send just them
+ * @param int socket_desc - opened socket to server, server repeated Chunks
+ * @param string filename - name of file to upload
+ * @param const string &list - records of chunks made by chunkFile
+ * @param Session *s - connection reused by next transfers, may be NULL
+ * @return int - success = 0, failure = 1
+ */
+int sendChunks(int socket_desc, string filename, const string &list, Session *s) {
 
-        memset(buffer, 0, sizeof(buffer));
+    if(sendBytes(socket_desc, list.data(), list.size()) == EXIT_FAILURE){
+        return EXIT_FAILURE;
+    }
 
-        bytes_read = read(upload_file, buffer, sizeof(buffer));
-        if (bytes_read == 0) { break; } //whole file is read
+    char buffer[MAX_BUFF_SIZE];
+    int res = receiveResponse(socket_desc, buffer);
+    if(s != NULL){
+        s->keepAlive = strstr(buffer, "Connection:keep-alive") != NULL;
+    }
+    if(res == EXIT_FAILURE){
+        return EXIT_FAILURE;
+    }
 
-        if (bytes_read < 0) {
-            cerr << "Reading from file FAILED" << endl;
-            return EXIT_FAILURE;
-        }
+    //bit i set = server wants chunk i
+    size_t n = list.size() / CHUNK_RECORD;
+    long bitmapLen = parseAttribute(buffer, "Length:");
+    string bitmap((n + 7) / 8, '\0');
+    if(bitmapLen != (long) bitmap.size()
+       || (bitmapLen > 0 && recv(socket_desc, &bitmap[0], bitmap.size(), MSG_WAITALL) != bitmapLen)){
+        cerr << "Receiving chunk bitmap FAILED" << endl;
+        return EXIT_FAILURE;
+    }
 
-        char *buffPtr = buffer;
-        while (bytes_read > 0) {
-            bytes_written = write(socket_desc, buffPtr, (size_t) bytes_read);
-            if (bytes_written <= 0) {
-                cerr << "Sending bytes FAILED" << endl;
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd == -1){
+        cerr << "Unable to open file or file does not exist" << endl;
+        return EXIT_FAILURE;
+    }
+    vector<char> chunk(CHUNK_MAX);
+    off_t offset = 0;
+    size_t sent = 0;
+    for(size_t i = 0; i < n; i++){
+        size_t len = recordLength(list.data() + i * CHUNK_RECORD);
+        if(bitmap[i / 8] & (1 << (i % 8))){
+            if(pread(fd, chunk.data(), len, offset) != (ssize_t) len){
+                cerr << "Reading from file FAILED" << endl;
+                close(fd);
                 return EXIT_FAILURE;
             }
-            bytes_read -= bytes_written;
-            buffPtr += bytes_written;
+            if(sendBytes(socket_desc, chunk.data(), len) == EXIT_FAILURE){
+                close(fd);
+                return EXIT_FAILURE;
+            }
+            sent++;
         }
+        offset += (off_t) len;
     }
+    close(fd);
+    cout << "Server already had " << n - sent << " of " << n << " chunks" << endl;
+    return EXIT_SUCCESS;
+}
 
-    close(upload_file);  //check??
+/**
+ * @description - Receive signatures of server's copy and send instructions rebuilding the file from it (rsync)
+ * @param int socket_desc - opened socket to server, server repeated Delta
+ * @param string filename - name of file to upload
+ * @param long fileSize - size of file
+ * @param const char *response - ACK with Delta:(block), Length:(bytes of signatures), Size:(size of server's copy)
+ * @return int - success = 0, failure = 1
+ */
+int sendDelta(int socket_desc, string filename, long fileSize, const char *response) {
+
+    Signatures sig;
+    sig.block = (size_t) parseAttribute(response, "Delta:");
+    sig.size = parseAttribute(response, "Size:");
+    sig.blocks = sig.size > 0 ? ((size_t) sig.size + sig.block - 1) / sig.block : 0;
+    long sigLen = parseAttribute(response, "Length:");
+    sig.records.resize(sig.blocks * DELTA_RECORD);
+    if(sig.blocks == 0 || sigLen != (long) sig.records.size()
+       || recv(socket_desc, &sig.records[0], sig.records.size(), MSG_WAITALL) != sigLen){
+        cerr << "Receiving signatures FAILED" << endl;
+        return EXIT_FAILURE;
+    }
+    sig.tags.assign(1 << 16, false);
+    for(size_t i = 0; i < sig.blocks; i++){
+        uint32_t weak;
+        memcpy(&weak, sig.records.data() + i * DELTA_RECORD, 4);
+        weak = be32toh(weak);
+        sig.weak.insert(std::make_pair(weak, (uint32_t) i));
+        sig.tags[(weak ^ (weak >> 16)) & 0xFFFF] = true;
+    }
 
-    if(receiveResponse(socket_desc, buffer) == EXIT_FAILURE){
+    int fd = open(filename.c_str(), O_RDONLY);
+    void *map = fd == -1 || fileSize == 0 ? MAP_FAILED : mmap(NULL, (size_t) fileSize, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(fd != -1){
+        close(fd);
+    }
+    if(map == MAP_FAILED && fileSize > 0){
+        cerr << "Unable to open file or file does not exist" << endl;
         return EXIT_FAILURE;
     }
-    cout << "Upload was successful" << endl;
+    if(map != MAP_FAILED){
+        madvise(map, (size_t) fileSize, MADV_SEQUENTIAL);
+    }
 
-    return EXIT_SUCCESS;
-}
\ No newline at end of file
+    //window rolls byte by byte until its block is found, literal data are what it passed over
+    const char *data = (const char *) map;
+    const unsigned char *p = (const unsigned char *) map;
+    size_t size = (size_t) fileSize;
+    size_t pos = 0, literal = 0, matched = 0;
+    uint32_t runFirst = 0, runCount = 0;
+    uint32_t sum = 0;
+    bool rolled = false;
+    string out;
+    int res = EXIT_SUCCESS;
+    while(res == EXIT_SUCCESS && pos < size){
+        size_t len = size - pos < sig.block ? size - pos : sig.block;
+        if(len < sig.block && literal < pos){
+            break;  //short tail can match just last block of server's copy, and just right after match
+        }
+        if(!rolled){
+            sum = weakSum(data + pos, len);
+            rolled = len == sig.block;
+        }
+        long found = sig.tags[(sum ^ (sum >> 16)) & 0xFFFF] ? findBlock(sig, sum, data + pos, len) : -1;
+        if(found >= 0){
+            if(literal < pos){
+                res = deltaCopy(socket_desc, out, runFirst, runCount);
+                res = res == EXIT_SUCCESS ? deltaData(socket_desc, out, data + literal, pos - literal) : res;
+                runCount = 0;
+            }
+            if(runCount > 0 && runFirst + runCount != (uint32_t) found){
+                res = res == EXIT_SUCCESS ? deltaCopy(socket_desc, out, runFirst, runCount) : res;
+                runCount = 0;
+            }
+            if(runCount == 0){
+                runFirst = (uint32_t) found;
+            }
+            runCount++;
+            pos += len;
+            literal = pos;
+            matched += len;
+            rolled = false;
+            continue;
+        }
+        if(len < sig.block){
+            break;
+        }
+        if(pos + len < size){
+            sum = rollSum(sum, len, p[pos], p[pos + len]);
+        }
+        else{
+            rolled = false;
+        }
+        pos++;
+    }
+
+    //rest of file was not found
+    res = res == EXIT_SUCCESS ? deltaCopy(socket_desc, out, runFirst, runCount) : res;
+    res = res == EXIT_SUCCESS ? deltaData(socket_desc, out, data + literal, size - literal) : res;
+    res = res == EXIT_SUCCESS ? sendBytes(socket_desc, out.data(), out.size()) : res;
+    if(map != MAP_FAILED){
+        munmap(map, size);
+    }
+    if(res == EXIT_SUCCESS){
+        cout << "Server already had " << matched << " of " << size << " bytes" << endl;
+    }
+    return res;
+}
+
+/**
+ * @description - Find block of server's copy with the same content as window
+ * @param const Signatures &sig - signatures of server's copy
+ * @param uint32_t sum - weak checksum of window
+ * @param const char *data - window
+ * @param size_t len - bytes of window, block or shorter tail of file
+ * @return long - index of block, -1 when none matches
+ */
+long findBlock(const Signatures &sig, uint32_t sum, const char *data, size_t len) {
+
+    auto range = sig.weak.equal_range(sum);
+    bool hashed = false;
+    unsigned char strong[DELTA_STRONG];
+    for(auto it = range.first; it != range.second; ++it){
+        size_t i = it->second;
+        size_t blockLen = i + 1 < sig.blocks ? sig.block : (size_t) sig.size - i * sig.block;
+        if(blockLen != len){
+            continue;
+        }
+        if(!hashed){
+            strongSum(data, len, strong);   //computed just for windows with known weak checksum
+            hashed = true;
+        }
+        if(memcmp(sig.records.data() + i * DELTA_RECORD + 4, strong, DELTA_STRONG) == 0){
+            return (long) i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @description - Add instruction copying blocks of server's copy, instructions are sent in big pieces
+ * @param int socket_desc - opened socket to server
+ * @param string &out - instructions not sent yet
+ * @param uint32_t first - first block
+ * @param uint32_t count - number of blocks, nothing is added when 0
+ * @return int - success = 0, failure = 1
+ */
+int deltaCopy(int socket_desc, string &out, uint32_t first, uint32_t count) {
+
+    if(count == 0){
+        return EXIT_SUCCESS;
+    }
+    char header[DELTA_HEADER];
+    deltaHeader(header, DELTA_COPY, first, count);
+    out.append(header, DELTA_HEADER);
+    if(out.size() >= DELTA_LITERAL){
+        int res = sendBytes(socket_desc, out.data(), out.size());
+        out.clear();
+        return res;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Add instructions carrying new data, instructions are sent in big pieces
+ * @param int socket_desc - opened socket to server
+ * @param string &out - instructions not sent yet
+ * @param const char *data - new data
+ * @param size_t len - bytes of data, split to DELTA_LITERAL pieces
+ * @return int - success = 0, failure = 1
+ */
+int deltaData(int socket_desc, string &out, const char *data, size_t len) {
+
+    char header[DELTA_HEADER];
+    while(len > 0){
+        size_t n = len < DELTA_LITERAL ? len : DELTA_LITERAL;
+        deltaHeader(header, DELTA_DATA, 0, (uint32_t) n);
+        out.append(header, DELTA_HEADER);
+        out.append(data, n);
+        if(out.size() >= DELTA_LITERAL){
+            int res = sendBytes(socket_desc, out.data(), out.size());
+            out.clear();
+            if(res == EXIT_FAILURE){
+                return EXIT_FAILURE;
+            }
+        }
+        data += n;
+        len -= n;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Send whole memory to socket
+ * @param int socket_desc - opened socket to server
+ * @param const char *data - bytes to be sent
+ * @param size_t len - number of bytes
+ * @return int - success = 0, failure = 1
+ */
+int sendBytes(int socket_desc, const char *data, size_t len) {
+
+    for(size_t sent = 0; sent < len; ){
+        ssize_t bytes = send(socket_desc, data + sent, len - sent, 0);
+        if(bytes <= 0){
+            cerr << "Sending bytes FAILED" << endl;
+            return EXIT_FAILURE;
+        }
+        sent += (size_t) bytes;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Send data of uploaded file, exactly announced length is sent
+ * @param int socket_desc - opened socket to server
+ * @param string filename - name of file to upload
+ * @param off_t offset - first byte of file to be sent
+ * @param long length - bytes to be sent
+ * @param uint32_t *crc - checksum updated by sent data, may be NULL
+ * @return int - success = 0, failure = 1
+ */
+int sendData(int socket_desc, string filename, off_t offset, long length, uint32_t *crc) {
+
+    /*if(sendfile(socket_desc, upload_file, 0, (size_t)fileSize) == -1){    //not supported on freeBSD
+        cerr << "Uploading file FAILED" << endl;
+        return EXIT_FAILURE;
+    }*/
+    int upload_file = open(filename.c_str(), O_RDONLY); //should exist, because fileSize was successful
+    if(upload_file == -1 || lseek(upload_file, offset, SEEK_SET) == -1){
+        cerr << "Unable to open file or file does not exist" << endl;
+        if(upload_file != -1){ close(upload_file); }
+        return EXIT_FAILURE;
+    }
+
+    char *buffer = threadBuffer();
+    if(buffer == NULL){
+        cerr << "Not enough memory for buffer" << endl;
+        close(upload_file);
+        return EXIT_FAILURE;
+    }
+    ssize_t bytes_read = 0;
+    ssize_t bytes_written = 0;
+    long left = length;
+
+#if URING
+    if(uringMode){
+        long bytes = uringTransfer(upload_file, false, socket_desc, true, offset, length, crc);
+        if(bytes != -1 && bytes != length){
+            cerr << "Sending bytes FAILED" << endl;
+            close(upload_file);
+            return EXIT_FAILURE;
+        }
+        if(bytes != -1){
+            left = 0;   //otherwise io_uring is not available, send by write() below
+        }
+    }
+#endif
+
+    while (left > 0) {
+
+        bytes_read = read(upload_file, buffer, left < (long) bufferSize() ? (size_t) left : bufferSize());
+        if (bytes_read == 0) { //file was truncated meanwhile
+            cerr << "Reading from file FAILED" << endl;
+            close(upload_file);
+            return EXIT_FAILURE;
+        }
+
+        if (bytes_read < 0) {
+            cerr << "Reading from file FAILED" << endl;
+            close(upload_file);
+            return EXIT_FAILURE;
+        }
+        left -= bytes_read;
+        if(crc != NULL){
+            *crc = crc32c(*crc, buffer, (size_t) bytes_read);
+        }
+
+        char *buffPtr = buffer;
+        while (bytes_read > 0) {
+            bytes_written = write(socket_desc, buffPtr, (size_t) bytes_read);
+            if (bytes_written <= 0) {
+                cerr << "Sending bytes FAILED" << endl;
+                close(upload_file);
+                return EXIT_FAILURE;
+            }
+            bytes_read -= bytes_written;
+            buffPtr += bytes_written;
+        }
+    }
+
+    close(upload_file);  //check??
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Receive encoded blocks of downloaded file and write their decoded data
+ * @param int socket_desc - opened socket to server
+ * @param string filename - name of file to download
+ * @param long fileSize - original length of file announced by server
+ * @param uint32_t *crc - checksum updated by decoded data, may be NULL
+ * @return int - success = 0, failure = 1
+ */
+int receiveBlocks(int socket_desc, string filename, long fileSize, uint32_t *crc) {
+
+    int fd = open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1){
+        cerr << "Unable to create a file" << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<char> block(ENC_MAX), data(ENC_BLOCK);
+    long bytes = 0;
+    while(bytes < fileSize){
+
+        size_t payload, original;
+        if(recv(socket_desc, block.data(), ENC_HEADER, MSG_WAITALL) != ENC_HEADER
+           || blockHeader(block.data(), &payload, &original) != 0 || (long) original > fileSize - bytes
+           || recv(socket_desc, block.data() + ENC_HEADER, payload, MSG_WAITALL) != (ssize_t) payload){
+            break;
+        }
+        const char *decoded = decodeBlock(block.data(), data.data());
+        if(decoded == NULL){
+            cerr << "Corrupted block of encoded data" << endl;
+            break;
+        }
+        if(write(fd, decoded, original) != (ssize_t) original){
+            cerr << "Writing to file FAILED" << endl;
+            break;
+        }
+        if(crc != NULL){
+            *crc = crc32c(*crc, decoded, original);
+        }
+        bytes += (long) original;
+    }
+
+    close(fd);
+    if(bytes != fileSize){
+        cerr << "Downloading FAILED, NOT entire file was downloaded" << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Receive final ACK of download and compare its checksum with checksum of received data
+ * @param int socket_desc - opened socket to server
+ * @param bool binary - ACK is binary frame
+ * @param uint32_t crc - checksum of received data
+ * @param bool *keepAlive - set to true when server keeps connection opened, may be NULL
+ * @return int - success = 0, failure = 1
+ */
+int receiveChecksum(int socket_desc, bool binary, uint32_t crc, bool *keepAlive) {
+
+    char buffer[MAX_BUFF_SIZE];
+    Frame f;
+
+    int res = binary ? receiveFrame(socket_desc, &f) : receiveResponse(socket_desc, buffer);
+    if(keepAlive != NULL){
+        *keepAlive = binary ? (f.flags & FRAME_KEEPALIVE) != 0 : strstr(buffer, "Connection:keep-alive") != NULL;
+    }
+    if(res == EXIT_FAILURE){
+        return EXIT_FAILURE;
+    }
+    return verifyChecksum(binary ? (long) f.size : parseAttribute(buffer, "Crc32c:"), crc);
+}
+
+/**
+ * @description - Compare checksum computed by server with checksum of transferred data
+ * @param long digest - checksum from final ACK, -1 when server sent none
+ * @param uint32_t crc - checksum of transferred data
+ * @return int - success = 0, failure = 1 when data were corrupted
+ */
+int verifyChecksum(long digest, uint32_t crc) {
+
+    if(digest == -1){   //server does not compute checksums
+        return EXIT_SUCCESS;
+    }
+    if(digest != (long) crc){
+        cerr << "Checksum mismatch, transferred data are corrupted" << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Send part of uploaded file as encoded blocks, incompressible data are sent raw
+ * @param int socket_desc - opened socket to server
+ * @param string filename - name of file to upload
+ * @param off_t offset - first byte of file to be sent
+ * @param long length - original bytes to be sent
+ * @param uint32_t *crc - checksum updated by original data, may be NULL
+ * @return int - success = 0, failure = 1
+ */
+int sendBlocks(int socket_desc, string filename, off_t offset, long length, uint32_t *crc) {
+
+    int fd = open(filename.c_str(), O_RDONLY);
+    if(fd == -1){
+        cerr << "Unable to open file or file does not exist" << endl;
+        return EXIT_FAILURE;
+    }
+
+    vector<char> data(ENC_BLOCK), block(ENC_MAX);
+    int rawBlocks = 0;  //blocks still sent raw after incompressible one
+    while(length > 0){
+
+        size_t len = length < ENC_BLOCK ? (size_t) length : ENC_BLOCK;
+        if(pread(fd, data.data(), len, offset) != (ssize_t) len){   //file was truncated meanwhile
+            cerr << "Reading from file FAILED" << endl;
+            close(fd);
+            return EXIT_FAILURE;
+        }
+        if(crc != NULL){
+            *crc = crc32c(*crc, data.data(), len);
+        }
+
+        size_t encoded = encodeBlock(data.data(), len, block.data(), rawBlocks > 0 ? 0 : compressLevel);
+        if(rawBlocks > 0){
+            rawBlocks--;
+        }
+        else if(encoded == ENC_HEADER + len){
+            rawBlocks = ENC_SKIP;
+        }
+
+        for(size_t sent = 0; sent < encoded; ){
+            ssize_t res = send(socket_desc, block.data() + sent, encoded - sent, 0);
+            if(res <= 0){
+                cerr << "Sending bytes FAILED" << endl;
+                close(fd);
+                return EXIT_FAILURE;
+            }
+            sent += (size_t) res;
+        }
+        offset += (off_t) len;
+        length -= (long) len;
+    }
+
+    close(fd);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Read list of files to be transferred
+ * @param string manifest - file with lines 'd <filename>' (download) or 'u <filename>' (upload), - for stdin
+ * @param vector<Op> &ops - listed files are appended
+ * @return int - success = 0, failure = 1
+ */
+int readManifest(string manifest, vector<Op> &ops) {
+
+    ifstream file;
+    istream *in = &cin;
+    if(manifest != "-"){
+        file.open(manifest);
+        if(!file){
+            cerr << "Unable to open manifest" << endl;
+            return EXIT_FAILURE;
+        }
+        in = &file;
+    }
+
+    string line;
+    int number = 0;
+    while(getline(*in, line)){
+        number++;
+        if(line.empty() || line[0] == '#'){ //comments and empty lines are skipped
+            continue;
+        }
+        if(line.length() < 3 || (line[0] != 'd' && line[0] != 'u') || line[1] != ' '){
+            cerr << "Wrong line " << number << " of manifest" << endl;
+            return EXIT_FAILURE;
+        }
+        ops.push_back(Op{line[0] == 'd' ? Down : Up, line.substr(2), 0, 0});
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Find regular files of directory and its subdirectories, symbolic links are not followed
+ * @param string dir - directory to be uploaded
+ * @param vector<Op> &ops - uploads of found files are appended
+ * @return int - success = 0, failure = 1
+ */
+int listDirectory(string dir, vector<Op> &ops) {
+
+    DIR *d = opendir(dir.c_str());
+    if(d == NULL){
+        cerr << "Unable to open directory " << dir << endl;
+        return EXIT_FAILURE;
+    }
+
+    struct dirent *entry;
+    while((entry = readdir(d)) != NULL){
+        string name = entry->d_name;
+        if(name == "." || name == ".."){
+            continue;
+        }
+
+        string path = dir + "/" + name;
+        struct stat info;
+        if(lstat(path.c_str(), &info) == -1){
+            continue;
+        }
+        if(S_ISDIR(info.st_mode) && listDirectory(path, ops) == EXIT_FAILURE){
+            closedir(d);
+            return EXIT_FAILURE;
+        }
+        if(S_ISREG(info.st_mode)){
+            ops.push_back(Op{Up, path, 0, 0});
+        }
+    }
+    closedir(d);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Transfer files by pool of persistent connections and report aggregate throughput
+ * @param string host - domain name or IP address
+ * @param unsigned short int port - number of port connect to
+ * @param vector<Op> &ops - files to be transferred
+ * @param int depth - max requests sent ahead of their responses
+ * @param int parallel - number of connections
+ * @return int - success = 0, failure = 1 when any transfer failed
+ */
+int transferBatch(string host, unsigned short int port, vector<Op> &ops, int depth, int parallel) {
+
+    size_t workers = (size_t) parallel < ops.size() ? (size_t) parallel : ops.size();
+
+    Batch b;
+    b.host = host;
+    b.port = port;
+    b.depth = depth;
+    b.done = b.failed = 0;
+    b.bytes = 0;
+
+    //every connection starts with continuous part of list, idle ones steal from the others
+    for(size_t i = 0; i < workers; i++){
+        WorkQueue *q = new WorkQueue;
+        q->ops.assign(ops.begin() + i * ops.size() / workers, ops.begin() + (i + 1) * ops.size() / workers);
+        b.queues.push_back(q);
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    vector<thread> threads;
+    for(size_t i = 0; i < workers; i++){
+        threads.push_back(thread(&batchWorker, &b, i));
+    }
+    for(size_t i = 0; i < threads.size(); i++){
+        threads[i].join();
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double mib = (double) b.bytes / (1024 * 1024);
+    cout << "Transferred " << b.done << " of " << ops.size() << " files, " << fixed << setprecision(2) << mib
+         << " MiB in " << seconds << " s (" << (seconds > 0 ? mib / seconds : 0) << " MiB/s)" << endl;
+
+    for(size_t i = 0; i < b.queues.size(); i++){
+        delete b.queues[i];
+    }
+
+    if(b.failed > 0){
+        cerr << b.failed << " of " << ops.size() << " transfers FAILED" << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Transfer files of own queue, then stolen ones, over one reused connection
+ * @param Batch *b - shared state of batch
+ * @param size_t id - index of own queue
+ * @return void
+ */
+void batchWorker(Batch *b, size_t id) {
+
+    Session s;
+    s.host = b->host;
+    s.port = b->port;
+    s.socket = -1;
+    s.keepAlive = false;
+    s.binary = false;
+    s.encoded = false;
+    s.depth = b->depth;
+    s.done = s.failed = 0;
+    s.bytes = 0;
+
+    vector<Op> work;
+    while(takeWork(b, id, work)){
+        transferFiles(&s, work);
+    }
+    if(s.socket != -1){
+        close(s.socket);
+    }
+
+    lock_guard<std::mutex> lock(b->mtx);
+    b->done += s.done;
+    b->failed += s.failed;
+    b->bytes += s.bytes;
+}
+
+/**
+ * @description - Take next files from front of own queue, steal half of other queue when own is empty
+ * @param Batch *b - shared state of batch
+ * @param size_t id - index of own queue
+ * @param vector<Op> &work - taken files
+ * @return bool - false when no files are left
+ */
+bool takeWork(Batch *b, size_t id, vector<Op> &work) {
+
+    WorkQueue *own = b->queues[id];
+    size_t n = b->queues.size();
+    work.clear();
+
+    own->mtx.lock();
+    bool empty = own->ops.empty();
+    own->mtx.unlock();
+
+    //just one queue is locked at a time, so stealing connections can't deadlock
+    for(size_t i = 1; empty && i < n; i++){
+        WorkQueue *victim = b->queues[(id + i) % n];
+        deque<Op> stolen;
+
+        victim->mtx.lock();
+        size_t half = (victim->ops.size() + 1) / 2;
+        stolen.assign(victim->ops.end() - half, victim->ops.end());
+        victim->ops.erase(victim->ops.end() - half, victim->ops.end());
+        victim->mtx.unlock();
+
+        if(!stolen.empty()){
+            own->mtx.lock();
+            own->ops.insert(own->ops.end(), stolen.begin(), stolen.end());
+            own->mtx.unlock();
+            empty = false;
+        }
+    }
+
+    //more requests than pipeline depth are taken, so pipeline does not drain too often
+    lock_guard<std::mutex> lock(own->mtx);
+    while(!own->ops.empty() && work.size() < 4 * (size_t) b->depth){
+        work.push_back(own->ops.front());
+        own->ops.pop_front();
+    }
+    return !work.empty();
+}
+
+/**
+ * @description - Transfer files over persistent connection of session, reconnect when server closes it
+ * @param Session *s - connection reused by more calls
+ * @param vector<Op> &ops - files to be transferred
+ * @return int - success = 0, failure = 1 when server is not reachable
+ */
+int transferFiles(Session *s, vector<Op> &ops) {
+
+    size_t next = 0;
+
+    while(next < ops.size()){
+
+        if(s->socket == -1){
+            int socket_desc = -1;
+            connectMtx.lock();
+            int res = createConnection(s->host, s->port, &socket_desc);
+            connectMtx.unlock();
+            if(res == EXIT_FAILURE){
+                if(socket_desc != -1){
+                    close(socket_desc);
+                }
+                s->failed += (int)(ops.size() - next);
+                return EXIT_FAILURE;
+            }
+            s->socket = socket_desc;
+            s->keepAlive = false;
+            s->binary = false;
+            s->encoded = false;
+        }
+
+        if(s->keepAlive && !dedupMode && !deltaMode){   //requests don't wait for responses of previous ones, deduplicated / delta upload waits for server's answer
+            next = pipelineOps(s, ops, next);
+        }
+        else{   //first request finds out whether server keeps connection opened and understands binary requests
+            Op &op = ops[next++];
+            ostringstream strOp;
+            strOp << op.type;
+            string request = strOp.str() + "\nFile:" + op.filename + "\nConnection:keep-alive\nBinary:1";
+
+            int res = op.type == Down ? download(s->socket, request, op, s) : upload(s->socket, request, op, s);
+            if(res == EXIT_SUCCESS){
+                s->done++;
+                s->bytes += op.size;
+            }
+            else{
+                cerr << "Transfer of " << op.filename << " FAILED" << endl;
+                s->failed++;
+            }
+        }
+
+        if(!s->keepAlive){
+            close(s->socket);
+            s->socket = -1;
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Send requests by separate thread while responses are received, so neither side waits for the other
+ * @param Session *s - session with persistent connection, keepAlive is cleared when connection is lost
+ * @param vector<Op> &ops - files to be transferred
+ * @param size_t first - index of first file to be transferred
+ * @return size_t - index of first file which was not transferred because connection was lost
+ */
+size_t pipelineOps(Session *s, vector<Op> &ops, size_t first) {
+
+    Pipeline pl;
+    pl.socket = s->socket;
+    pl.ops = &ops;
+    pl.depth = (size_t) s->depth;
+    pl.binary = s->binary;
+    pl.encoded = s->encoded;
+    pl.sent = pl.answered = first;
+    pl.failed = pl.aborted = false;
+
+    //uploads announce their length in request, unreadable files are left out at once
+    for(size_t i = first; i < ops.size(); i++){
+        if(ops[i].type == Up){
+            ops[i].size = fileSizeFunc(ops[i].filename);
+        }
+    }
+
+    std::thread sender(&sendRequests, &pl);
+
+    while(pl.answered < ops.size()){
+
+        unique_lock<std::mutex> lock(pl.mtx);
+        pl.cond.wait(lock, [&pl]{ return pl.sent > pl.answered || pl.failed; });
+        if(pl.sent == pl.answered){    //sending failed, rest is sent by new connection
+            s->keepAlive = false;
+            break;
+        }
+        lock.unlock();
+
+        int res = receiveOp(s->socket, ops[pl.answered], pl.binary);
+
+        lock.lock();
+        if(res == EXIT_SUCCESS){
+            s->done++;
+            s->bytes += ops[pl.answered].size;
+        }
+        else{
+            cerr << "Transfer of " << ops[pl.answered].filename << " FAILED" << endl;
+            s->failed++;
+        }
+        pl.answered++;
+        if(res == -1){  //connection was lost, stop sender
+            pl.aborted = true;
+            s->keepAlive = false;
+            shutdown(s->socket, SHUT_RDWR);
+        }
+        pl.cond.notify_all();
+        if(res == -1){
+            break;
+        }
+    }
+
+    {
+        lock_guard<std::mutex> lock(pl.mtx);
+        pl.aborted = true;
+        pl.cond.notify_all();
+    }
+    sender.join();
+    return pl.answered;
+}
+
+/**
+ * @description - Send requests of pipeline, data of uploads follow their requests immediately
+ * @param Pipeline *pl - shared state of pipeline
+ * @return void
+ */
+void sendRequests(Pipeline *pl) {
+
+    vector<Op> &ops = *pl->ops;
+
+    while(1){
+        unique_lock<std::mutex> lock(pl->mtx);
+        pl->cond.wait(lock, [pl]{ return pl->sent - pl->answered < pl->depth || pl->aborted; });
+        if(pl->aborted || pl->sent == ops.size()){
+            return;
+        }
+        Op &op = ops[pl->sent];
+        lock.unlock();
+
+        int res = EXIT_SUCCESS;
+        string encoding = string(pl->encoded ? "\nEncoding:deflate" : "") + (checksumMode ? "\nChecksum:crc32c" : "");
+        if(pl->binary){    //no text to format and no attributes for server to search
+            if(op.type == Down || op.size != -1){
+                res = sendFrame(pl->socket, op.type, FRAME_KEEPALIVE | (op.type == Up ? FRAME_PIPELINE : 0)
+                                | (pl->encoded ? FRAME_DEFLATE : 0) | (checksumMode ? FRAME_CHECKSUM : 0), op.filename, op.size);
+            }
+        }
+        else if(op.type == Down){
+            ostringstream strOp;
+            strOp << op.type;
+            res = sendRequest(pl->socket, strOp.str() + "\nFile:" + op.filename + "\nConnection:keep-alive" + encoding + "\n\n");
+        }
+        else if(op.size != -1){
+            ostringstream request;
+            request << op.type << "\nFile:" << op.filename << "\nConnection:keep-alive\nLength:" << op.size
+                    << "\nPipeline:1" << encoding << "\n\n";
+            res = sendRequest(pl->socket, request.str());
+        }
+        if(res == EXIT_SUCCESS && op.type == Up && op.size != -1){
+            uint32_t *crc = checksumMode ? &op.crc : NULL;  //compared by receiver with final ACK
+            res = pl->encoded ? sendBlocks(pl->socket, op.filename, 0, op.size, crc) : sendData(pl->socket, op.filename, 0, op.size, crc);
+        }
+
+        lock.lock();
+        if(res == EXIT_FAILURE){
+            pl->failed = true;
+            shutdown(pl->socket, SHUT_WR);  //server answers what it has got and closes connection
+            pl->cond.notify_all();
+            return;
+        }
+        pl->sent++;
+        pl->cond.notify_all();
+    }
+}
+
+/**
+ * @description - Receive responses and data belonging to one pipelined request
+ * @param int socket_desc - opened persistent connection
+ * @param Op &op - transferred file
+ * @param bool binary - responses are binary frames
+ * @return int - success = 0, transfer failed = 1, connection can't be used anymore = -1
+ */
+int receiveOp(int socket_desc, Op &op, bool binary) {
+
+    if(op.type == Up && op.size == -1){  //request was not sent
+        cerr << "Unable to open file or file does not exist" << endl;
+        return EXIT_FAILURE;
+    }
+
+    char buffer[MAX_BUFF_SIZE];
+    Frame f;
+
+    int res = binary ? receiveFrame(socket_desc, &f) : receiveResponse(socket_desc, buffer);
+    if(binary ? !(f.flags & FRAME_KEEPALIVE) : strstr(buffer, "Connection:keep-alive") == NULL){
+        return -1;  //server closes connection
+    }
+    if(res == EXIT_FAILURE){
+        return EXIT_FAILURE;
+    }
+
+    if(op.type == Down){
+        long fileSize = binary ? (long) f.length : parseAttribute(buffer, "Length:");
+        bool encoded = binary ? (f.flags & FRAME_DEFLATE) != 0 : strstr(buffer, "Encoding:deflate") != NULL;
+        bool checksum = binary ? (f.flags & FRAME_CHECKSUM) != 0 : strstr(buffer, "Checksum:crc32c") != NULL;
+        uint32_t crc = 0;
+        res = encoded ? receiveBlocks(socket_desc, op.filename, fileSize, checksum ? &crc : NULL)
+                      : receiveData(socket_desc, op.filename, fileSize, checksum ? &crc : NULL);
+        if(res == EXIT_FAILURE){
+            return -1;
+        }
+
+        //final ACK with checksum follows the data
+        bool keepAlive = true;
+        if(checksum && receiveChecksum(socket_desc, binary, crc, &keepAlive) == EXIT_FAILURE){
+            return keepAlive ? EXIT_FAILURE : -1;
+        }
+        if(!keepAlive){
+            return -1;
+        }
+        op.size = fileSize;
+        return EXIT_SUCCESS;
+    }
+
+    //upload has final response after data
+    res = binary ? receiveFrame(socket_desc, &f) : receiveResponse(socket_desc, buffer);
+    if(binary ? !(f.flags & FRAME_KEEPALIVE) : strstr(buffer, "Connection:keep-alive") == NULL){
+        return -1;
+    }
+    long digest = binary ? ((f.flags & FRAME_CHECKSUM) ? (long) f.size : -1) : parseAttribute(buffer, "Crc32c:");
+    if(res == EXIT_FAILURE || (checksumMode && verifyChecksum(digest, op.crc) == EXIT_FAILURE)){
+        return EXIT_FAILURE;
+    }
+    cout << "Upload was successful" << endl;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Transfer data between file and socket by io_uring, several reads/writes are in flight at once
+ * @param int in - descriptor data are read from
+ * @param bool inSocket - input is socket
+ * @param int out - descriptor data are written to
+ * @param bool outSocket - output is socket
+ * @param off_t offset - offset in file where transfer starts
+ * @param long length - bytes to be transferred
+ * @param uint32_t *crc - checksum updated by transferred data, may be NULL
+ * @return long - transferred bytes, -1 when io_uring is not available
+ */
+long uringTransfer(int in, bool inSocket, int out, bool outSocket, off_t offset, long length, uint32_t *crc) {
+#if URING
+    Uring ring;
+    if(uringInit(&ring, 4 * URING_SLOTS, URING_SLOTS, URING_BUFF_SIZE) != 0){
+        cerr << "io_uring is not available" << endl;
+        return -1;
+    }
+
+    UringTransfer t;
+    uringSetup(&t, in, inSocket, out, outSocket, offset, length, NULL);
+    t.crc = crc;
+    while(t.done < length && uringStep(&ring, &t) == 0);
+
+    uringFree(&ring);
+    return t.done;
+#else
+    (void) in; (void) inSocket; (void) out; (void) outSocket; (void) offset; (void) length; (void) crc;
+    return -1;
+#endif
+}
+
+/**
+ * @description - Get numeric attribute of response
+ * @param const char *response - received response
+ * @param string name - attribute with colon, f.e.: Length:
+ * @return long - value of attribute, -1 when missing
+ */
+long parseAttribute(const char *response, string name) {
+
+    string str(response);
+    size_t index = str.find(name);
+    if(index == string::npos){
+        return -1;
+    }
+    long value = -1;
+    istringstream (str.substr(index + name.length(), str.find("\n", index) - index - name.length())) >> value;
+    return value;
+}
+
+/**
+ * @description - Download one file by more connections, each fetches chunks of file by ranged requests
+ * @param string host - domain name or IP address
+ * @param unsigned short int port - number of port connect to
+ * @param Op &op - file to download
+ * @param int streams - number of parallel connections
+ * @return int - success = 0, failure = 1
+ */
+int rangedDownload(string host, unsigned short int port, Op &op, int streams) {
+
+    int socket_desc = 0;
+    if (createConnection(host, port, &socket_desc) == EXIT_FAILURE) {
+        return EXIT_FAILURE;
+    }
+
+    //empty range finds out size of file
+    ostringstream strOp;
+    strOp << Down;
+    if(sendRequest(socket_desc, strOp.str() + "\nFile:" + op.filename + "\nConnection:keep-alive\nOffset:0\nRange:0\n\n")
+       == EXIT_FAILURE){
+        close(socket_desc);
+        return EXIT_FAILURE;
+    }
+    char buffer[MAX_BUFF_SIZE];
+    if(receiveResponse(socket_desc, buffer) == EXIT_FAILURE){
+        close(socket_desc);
+        return EXIT_FAILURE;
+    }
+
+    long size = parseAttribute(buffer, "Size:");
+    if(size == -1){     //server does not support ranges and sends whole file
+        int res = receiveData(socket_desc, op.filename, parseAttribute(buffer, "Length:"), NULL);
+        close(socket_desc);
+        return res;
+    }
+    if(strstr(buffer, "Connection:keep-alive") == NULL){
+        close(socket_desc);
+        socket_desc = -1;
+    }
+
+    //space for whole file is allocated at once, streams write their chunks to it
+    int fd = open(op.filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1){
+        cerr << "Unable to create a file" << endl;
+        if(socket_desc != -1){ close(socket_desc); }
+        return EXIT_FAILURE;
+    }
+    if(size > 0 && fallocate(fd, 0, 0, (off_t) size) == -1 && ftruncate(fd, (off_t) size) == -1){
+        cerr << "Not enough space for downloaded file" << endl;
+        close(fd);
+        if(socket_desc != -1){ close(socket_desc); }
+        return EXIT_FAILURE;
+    }
+
+    RangedDownload rd;
+    rd.host = host;
+    rd.port = port;
+    rd.filename = op.filename;
+    rd.file = fd;
+    rd.size = size;
+    rd.chunk = size / (4 * streams) + 1;    //more chunks than streams, faster streams take more of them
+    if(rd.chunk < RANGE_CHUNK){ rd.chunk = RANGE_CHUNK; }
+    rd.next = 0;
+    rd.failed = false;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    vector<thread> threads;
+    for(int i = 0; i < streams && (long) i * rd.chunk < size; i++){
+        threads.push_back(thread(&rangeWorker, &rd, i == 0 ? socket_desc : -1));
+    }
+    if(threads.empty() && socket_desc != -1){   //empty file
+        close(socket_desc);
+    }
+    for(size_t i = 0; i < threads.size(); i++){
+        threads[i].join();
+    }
+    close(fd);
+
+    if(rd.failed){
+        cerr << "Downloading FAILED, NOT entire file was downloaded" << endl;
+        return EXIT_FAILURE;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double mib = (double) size / (1024 * 1024);
+    cout << "Downloaded " << fixed << setprecision(2) << mib << " MiB by " << threads.size() << " streams in "
+         << seconds << " s (" << (seconds > 0 ? mib / seconds : 0) << " MiB/s)" << endl;
+    op.size = size;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Fetch chunks of ranged download until none is left, connection is reused for all of them
+ * @param RangedDownload *rd - shared state of download
+ * @param int socket_desc - opened persistent connection, -1 to create new one
+ * @return void
+ */
+void rangeWorker(RangedDownload *rd, int socket_desc) {
+
+    while(1){
+        unique_lock<std::mutex> lock(rd->mtx);
+        if(rd->failed || rd->next >= rd->size){
+            break;
+        }
+        long offset = rd->next;
+        long length = rd->size - offset < rd->chunk ? rd->size - offset : rd->chunk;
+        rd->next += length;
+        lock.unlock();
+
+        if(socket_desc == -1){
+            connectMtx.lock();
+            int res = createConnection(rd->host, rd->port, &socket_desc);
+            connectMtx.unlock();
+            if(res == EXIT_FAILURE){
+                if(socket_desc != -1){ close(socket_desc); }
+                socket_desc = -1;
+                lock_guard<std::mutex> failLock(rd->mtx);
+                rd->failed = true;
+                break;
+            }
+        }
+
+        ostringstream request;
+        request << Down << "\nFile:" << rd->filename << "\nConnection:keep-alive\nOffset:" << offset
+                << "\nRange:" << length << (checksumMode ? "\nChecksum:crc32c" : "") << "\n\n";
+        char buffer[MAX_BUFF_SIZE];
+        uint32_t crc = 0;
+
+        //every chunk is verified by its own checksum
+        bool keepAlive = false;
+        if(sendRequest(socket_desc, request.str()) == EXIT_FAILURE
+           || receiveResponse(socket_desc, buffer) == EXIT_FAILURE
+           || parseAttribute(buffer, "Length:") != length
+           || receiveRange(socket_desc, rd->file, (off_t) offset, length, checksumMode ? &crc : NULL) == EXIT_FAILURE
+           || (strstr(buffer, "Checksum:crc32c") != NULL && receiveChecksum(socket_desc, false, crc, &keepAlive) == EXIT_FAILURE)){
+            lock_guard<std::mutex> failLock(rd->mtx);
+            rd->failed = true;
+            break;
+        }
+
+        if(strstr(buffer, "Checksum:crc32c") == NULL){
+            keepAlive = strstr(buffer, "Connection:keep-alive") != NULL;
+        }
+        if(!keepAlive){
+            close(socket_desc);
+            socket_desc = -1;
+        }
+    }
+
+    if(socket_desc != -1){
+        close(socket_desc);
+    }
+}
+
+/**
+ * @description - Receive part of downloaded file and write it at its offset
+ * @param int socket_desc - opened socket to server
+ * @param int fd - preallocated file
+ * @param off_t offset - offset of received part in file
+ * @param long length - bytes of received part
+ * @param uint32_t *crc - checksum updated by received data, may be NULL
+ * @return int - success = 0, failure = 1
+ */
+int receiveRange(int socket_desc, int fd, off_t offset, long length, uint32_t *crc) {
+#if URING
+    if(uringMode){
+        long received = uringTransfer(socket_desc, true, fd, false, offset, length, crc);
+        if(received != -1){
+            return received == length ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        //io_uring is not available, receive by recv() below
+    }
+#endif
+
+    char *buffer = threadBuffer();
+    if(buffer == NULL){
+        cerr << "Not enough memory for buffer" << endl;
+        return EXIT_FAILURE;
+    }
+
+    while(length > 0){
+        ssize_t received = recv(socket_desc, buffer, length < (long) bufferSize() ? (size_t) length : bufferSize(), 0);
+        if(received <= 0){
+            return EXIT_FAILURE;
+        }
+        if(crc != NULL){
+            *crc = crc32c(*crc, buffer, (size_t) received);
+        }
+        for(ssize_t written = 0; written < received; ){
+            ssize_t bytes = pwrite(fd, buffer + written, (size_t)(received - written), offset);
+            if(bytes <= 0){
+                cerr << "Writing to file FAILED" << endl;
+                return EXIT_FAILURE;
+            }
+            written += bytes;
+            offset += bytes;
+        }
+        length -= received;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Get name of temporary file holding partial download, it's hidden in the same directory
+ * @param string path - path of downloaded file
+ * @return string - path of partial file
+ */
+string partName(string path) {
+
+    size_t slash = path.find_last_of("/");
+    if(slash == string::npos){
+        return "." + path + ".part";
+    }
+    return path.substr(0, slash + 1) + "." + path.substr(slash + 1) + ".part";
+}
+
+/**
+ * @description - Download file to partial file, continue from its end when it exists, rename it when complete
+ * @param int socket_desc - opened socket to server
+ * @param Op &op - file to download
+ * @return int - success = 0, failure = 1
+ */
+int resumeDownload(int socket_desc, Op &op) {
+
+    string part = partName(op.filename);
+    long offset = fileSizeFunc(part);
+    if(offset == -1){
+        offset = 0;
+    }
+
+    string checksum = checksumMode ? "\nChecksum:crc32c" : "";
+    ostringstream request;
+    request << Down << "\nFile:" << op.filename << "\nConnection:keep-alive\nOffset:" << offset << checksum << "\n\n";
+    char buffer[MAX_BUFF_SIZE];
+    if(sendRequest(socket_desc, request.str()) == EXIT_FAILURE || receiveResponse(socket_desc, buffer) == EXIT_FAILURE){
+        return EXIT_FAILURE;
+    }
+
+    long size = parseAttribute(buffer, "Size:");
+    if(size == -1){     //server does not support offsets and sends whole file
+        offset = 0;
+    }
+    else if(offset > size){     //partial file is not part of this file, download it again
+        offset = 0;
+        ostringstream again;
+        again << Down << "\nFile:" << op.filename << checksum << "\n\n";
+        if(strstr(buffer, "Connection:keep-alive") == NULL || sendRequest(socket_desc, again.str()) == EXIT_FAILURE
+           || receiveResponse(socket_desc, buffer) == EXIT_FAILURE){
+            cerr << "Partial file " << part << " is longer than file on server" << endl;
+            return EXIT_FAILURE;
+        }
+    }
+    long length = parseAttribute(buffer, "Length:");
+
+    int fd = open(part.c_str(), O_WRONLY | O_CREAT, 0644);
+    if(fd == -1 || ftruncate(fd, (off_t) offset) == -1){
+        cerr << "Unable to create a file" << endl;
+        if(fd != -1){ close(fd); }
+        return EXIT_FAILURE;
+    }
+    if(offset > 0){
+        cout << "Download resumed at byte " << offset << endl;
+    }
+
+    uint32_t crc = 0;
+    int res = receiveRange(socket_desc, fd, (off_t) offset, length, checksumMode ? &crc : NULL);
+    close(fd);
+    if(res == EXIT_FAILURE){
+        cerr << "Downloading FAILED, run it again with -r to continue" << endl;
+        return EXIT_FAILURE;
+    }
+    if(strstr(buffer, "Checksum:crc32c") != NULL && receiveChecksum(socket_desc, false, crc, NULL) == EXIT_FAILURE){
+        if(truncate(part.c_str(), (off_t) offset) == -1){   //corrupted part is downloaded again by next run
+            unlink(part.c_str());
+        }
+        return EXIT_FAILURE;
+    }
+    if(rename(part.c_str(), op.filename.c_str()) == -1){
+        cerr << "Unable to rename downloaded file" << endl;
+        return EXIT_FAILURE;
+    }
+    op.size = offset + length;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Read names of files of archive
+ * @param string manifest - file with one name per line, - for stdin
+ * @param string &names - names separated by newlines, empty lines and lines starting with # are skipped
+ * @return int - success = 0, failure = 1
+ */
+int readNames(string manifest, string &names) {
+
+    ifstream file;
+    istream *in = &cin;
+    if(manifest != "-"){
+        file.open(manifest);
+        if(!file){
+            cerr << "Unable to open list of files" << endl;
+            return EXIT_FAILURE;
+        }
+        in = &file;
+    }
+
+    string line;
+    while(getline(*in, line)){
+        if(line.empty() || line[0] == '#'){
+            continue;
+        }
+        names.append(line + "\n");
+    }
+    if(names.empty() || names.length() > ARCHIVE_MANIFEST){
+        cerr << "List of files is empty or too long" << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Download more files by one archive stream and unpack them to current directory
+ * @param int socket_desc - opened socket to server
+ * @param string pattern - files matching pattern are sent, empty when names are listed
+ * @param const string &names - names of files separated by newlines, they follow the request
+ * @return int - success = 0, failure = 1
+ */
+int downloadArchive(int socket_desc, string pattern, const string &names) {
+
+    ostringstream request;
+    request << Archive;
+    if(pattern != ""){
+        request << "\nFile:" << pattern;
+    }
+    else{
+        request << "\nLength:" << names.length();
+    }
+    request << "\n\n";
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    if(sendRequest(socket_desc, request.str()) == EXIT_FAILURE
+       || (pattern == "" && sendBytes(socket_desc, names.data(), names.length()) == EXIT_FAILURE)){
+        return EXIT_FAILURE;
+    }
+    char buffer[MAX_BUFF_SIZE];
+    if(receiveResponse(socket_desc, buffer) == EXIT_FAILURE){
+        return EXIT_FAILURE;
+    }
+
+    long files = 0, bytes = 0;
+    if(unpackArchive(socket_desc, &files, &bytes) == EXIT_FAILURE){
+        cerr << "Downloading FAILED, archive ended after " << files << " files" << endl;
+        return EXIT_FAILURE;
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    double mib = (double) bytes / (1024 * 1024);
+    cout << "Received " << files << " files, " << fixed << setprecision(2) << mib << " MiB in " << seconds
+         << " s (" << (seconds > 0 ? mib / seconds : 0) << " MiB/s)" << endl;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Receive entries of archive and write their files, whole buffer is received at once
+ * @param int socket_desc - opened socket to server, ACK of archive was received
+ * @param long *files - number of written files
+ * @param long *bytes - bytes of written files
+ * @return int - success = 0, failure = 1
+ */
+int unpackArchive(int socket_desc, long *files, long *bytes) {
+
+    char *buffer = threadBuffer();
+    if(buffer == NULL){
+        cerr << "Not enough memory for buffer" << endl;
+        return EXIT_FAILURE;
+    }
+    size_t pos = 0, len = 0;    //unparsed bytes of buffer
+
+    while(1){
+        uint64_t size;
+        if(fillArchive(socket_desc, buffer, &pos, &len, ARCHIVE_HEADER) == EXIT_FAILURE){
+            return EXIT_FAILURE;
+        }
+        size_t nameLen = readArchive(buffer + pos, &size);
+        pos += ARCHIVE_HEADER;
+        if(nameLen == 0){   //last header, its size is number of sent files
+            return size == (uint64_t) *files ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+        if(fillArchive(socket_desc, buffer, &pos, &len, nameLen) == EXIT_FAILURE){
+            return EXIT_FAILURE;
+        }
+
+        //file is written just to current directory
+        string name(buffer + pos, nameLen);
+        pos += nameLen;
+        size_t slash = name.find_last_of("/\\");
+        if(slash != string::npos){
+            name = name.substr(slash + 1);
+        }
+        if(name == "" || name == "." || name == ".." || name.find('\0') != string::npos){
+            cerr << "Invalid file name in archive" << endl;
+            return EXIT_FAILURE;
+        }
+        int fd = open(name.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd == -1){
+            cerr << "Unable to create a file " << name << endl;
+            return EXIT_FAILURE;
+        }
+
+        //data are already in buffer or they are received to it
+        uint64_t left = size;
+        while(left > 0){
+            if(pos == len && fillArchive(socket_desc, buffer, &pos, &len, 1) == EXIT_FAILURE){
+                close(fd);
+                return EXIT_FAILURE;
+            }
+            size_t n = len - pos < left ? len - pos : (size_t) left;
+            for(size_t written = 0; written < n; ){
+                ssize_t w = write(fd, buffer + pos + written, n - written);
+                if(w <= 0){
+                    cerr << "Writing to file FAILED" << endl;
+                    close(fd);
+                    return EXIT_FAILURE;
+                }
+                written += (size_t) w;
+            }
+            pos += n;
+            left -= n;
+        }
+        if(close(fd) == -1){
+            cerr << "Writing to file FAILED" << endl;
+            return EXIT_FAILURE;
+        }
+        (*files)++;
+        *bytes += (long) size;
+    }
+}
+
+/**
+ * @description - Make buffer hold at least need unparsed bytes of archive, unparsed rest is moved to its beginning
+ * @param int socket_desc - opened socket to server
+ * @param char *buffer - buffer of bufferSize() bytes
+ * @param size_t *pos - first unparsed byte
+ * @param size_t *len - end of received bytes
+ * @param size_t need - bytes needed, at most bufferSize()
+ * @return int - success = 0, failure = 1 when stream ended
+ */
+int fillArchive(int socket_desc, char *buffer, size_t *pos, size_t *len, size_t need) {
+
+    if(*len - *pos >= need){
+        return EXIT_SUCCESS;
+    }
+    memmove(buffer, buffer + *pos, *len - *pos);
+    *len -= *pos;
+    *pos = 0;
+    while(*len < need){
+        ssize_t received = recv(socket_desc, buffer + *len, bufferSize() - *len, 0);
+        if(received <= 0){
+            return EXIT_FAILURE;
+        }
+        *len += (size_t) received;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Transfer files by pool of client library, its coroutines keep every connection busy
+ * @param string host - domain name or IP address of server
+ * @param unsigned short int port - port of server
+ * @param vector<Op> &ops - files to be transferred
+ * @param int concurrency - number of transfers running at once
+ * @return int - success = 0, failure = 1 when some transfer failed
+ */
+int asyncBatch(string host, unsigned short int port, vector<Op> &ops, int concurrency) {
+
+    poolBuffers(bufferSize());  //library has own pool of buffers
+    ClientPool *pool = poolCreate(host, port, concurrency < (int) ops.size() ? concurrency : (int) ops.size(), 0);
+    if(pool == NULL){
+        cerr << "Unable to resolve host name" << endl;
+        return EXIT_FAILURE;
+    }
+
+    std::mutex mtx;     //callbacks run on threads of pool
+    int done = 0, failed = 0;
+    long bytes = 0;
+    TransferCallback count = [&](const TransferResult &res){
+        std::lock_guard<std::mutex> lock(mtx);
+        if(res.error == NULL){
+            done++;
+            bytes += res.size;
+        }
+        else{
+            failed++;
+            cerr << "Transfer of " << res.name << " FAILED: " << res.error << endl;
+        }
+    };
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for(size_t i = 0; i < ops.size(); i++){
+        if(ops[i].type == Up){
+            poolUpload(pool, ops[i].filename, count);
+        }
+        else{
+            poolDownload(pool, ops[i].filename, count);
+        }
+    }
+    poolDestroy(pool);
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    double mib = (double) bytes / (1024 * 1024);
+    cout << "Transferred " << done << " of " << ops.size() << " files, " << fixed << setprecision(2) << mib
+         << " MiB in " << seconds << " s (" << (seconds > 0 ? mib / seconds : 0) << " MiB/s)" << endl;
+
+    if(failed > 0){
+        cerr << failed << " of " << ops.size() << " transfers FAILED" << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
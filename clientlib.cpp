@@ -0,0 +1,181 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: Client library, pooled connections transfer files and memory of callers in background
+ */
+
+#include "clientlib.h"
+#include "async.h"
+
+/*Pool of library, callers see it just by pointer, so they needn't be built as C++20*/
+struct ClientPool{
+    AsyncPool *engine;
+};
+
+/*Transfer submitted by caller, it is freed when its callback was called*/
+struct PoolOp{
+    AsyncOp op;
+    TransferCallback done;
+};
+
+/*--------Prototypes---------*/
+static void poolDone(AsyncOp *op);
+static int poolSubmit(ClientPool *pool, int type, std::string name, const char *input, size_t inputLen,
+                      std::string *output, TransferCallback done);
+
+/**
+ * @description - Set size of transfer buffers of library, must be called before first pool is created
+ * @param size_t size - requested bytes, clamped to BUFFER_MIN .. BUFFER_MAX and rounded to 4 KiB
+ * @return size_t - used size
+ */
+size_t poolBuffers(size_t size) {
+
+    return bufferInit(size);
+}
+
+/**
+ * @description - Start pool, its connections are opened by first transfers and kept alive for the next ones
+ * @param std::string host - domain name or IP address of server
+ * @param unsigned short int port - port of server
+ * @param int connections - max connections, so max transfers running at once
+ * @param int threads - number of threads of pool, 0 = one per core
+ * @return ClientPool * - pool, NULL when server address is unknown or threads can't be started
+ */
+ClientPool *poolCreate(std::string host, unsigned short int port, int connections, int threads) {
+
+    AsyncPool *engine = asyncCreate(host, port, connections, threads);
+    if(engine == NULL){
+        return NULL;
+    }
+    ClientPool *pool = new ClientPool;
+    pool->engine = engine;
+    return pool;
+}
+
+/**
+ * @description - Upload file of the same name in background
+ * @param ClientPool *pool - running pool
+ * @param std::string filename - uploaded file
+ * @param TransferCallback done - called when upload ends, may be empty
+ * @return int - success = 0, failure = 1 when pool is NULL, done is not called then
+ */
+int poolUpload(ClientPool *pool, std::string filename, TransferCallback done) {
+
+    return poolSubmit(pool, ASYNC_UP, filename, NULL, 0, NULL, done);
+}
+
+/**
+ * @description - Download file to the file of the same name in background
+ * @param ClientPool *pool - running pool
+ * @param std::string filename - downloaded file
+ * @param TransferCallback done - called when download ends, may be empty
+ * @return int - success = 0, failure = 1 when pool is NULL, done is not called then
+ */
+int poolDownload(ClientPool *pool, std::string filename, TransferCallback done) {
+
+    return poolSubmit(pool, ASYNC_DOWN, filename, NULL, 0, NULL, done);
+}
+
+/**
+ * @description - Upload memory of caller as file in background, nothing is staged in local file
+ * @param ClientPool *pool - running pool
+ * @param std::string name - file name on server
+ * @param const char *data - uploaded bytes, they must stay valid until done is called
+ * @param size_t len - number of bytes
+ * @param TransferCallback done - called when upload ends, may be empty
+ * @return int - success = 0, failure = 1 when pool or data is NULL, done is not called then
+ */
+int poolPut(ClientPool *pool, std::string name, const char *data, size_t len, TransferCallback done) {
+
+    if(data == NULL){
+        return EXIT_FAILURE;
+    }
+    return poolSubmit(pool, ASYNC_UP, name, data, len, NULL, done);
+}
+
+/**
+ * @description - Download file to memory of caller in background, nothing is staged in local file
+ * @param ClientPool *pool - running pool
+ * @param std::string name - file name on server
+ * @param std::string *data - replaced by content of file, it must stay valid until done is called
+ * @param TransferCallback done - called when download ends, may be empty
+ * @return int - success = 0, failure = 1 when pool or data is NULL, done is not called then
+ */
+int poolGet(ClientPool *pool, std::string name, std::string *data, TransferCallback done) {
+
+    if(data == NULL){
+        return EXIT_FAILURE;
+    }
+    return poolSubmit(pool, ASYNC_DOWN, name, NULL, 0, data, done);
+}
+
+/**
+ * @description - Wait until all submitted transfers ended and their callbacks returned, it must not be called by callback
+ * @param ClientPool *pool - running pool
+ * @return void
+ */
+void poolWait(ClientPool *pool) {
+
+    if(pool != NULL){
+        asyncWait(pool->engine);
+    }
+}
+
+/**
+ * @description - Finish submitted transfers, close connections and stop threads of pool
+ * @param ClientPool *pool - running pool, it is freed
+ * @return void
+ */
+void poolDestroy(ClientPool *pool) {
+
+    if(pool == NULL){
+        return;
+    }
+    asyncClose(pool->engine);
+    delete pool;
+}
+
+/**
+ * @description - Queue transfer to pool, some idle connection takes it
+ * @param ClientPool *pool - running pool
+ * @param int type - ASYNC_UP / ASYNC_DOWN
+ * @param std::string name - file name on server
+ * @param const char *input - data of upload, NULL = file is read
+ * @param size_t inputLen - bytes of input
+ * @param std::string *output - data of download, NULL = file is written
+ * @param TransferCallback done - callback of caller, may be empty
+ * @return int - success = 0, failure = 1 when pool is NULL
+ */
+static int poolSubmit(ClientPool *pool, int type, std::string name, const char *input, size_t inputLen,
+                      std::string *output, TransferCallback done) {
+
+    if(pool == NULL){
+        return EXIT_FAILURE;
+    }
+    PoolOp *p = new PoolOp;
+    p->op.type = type;
+    p->op.filename = name;
+    p->op.input = input;
+    p->op.inputLen = inputLen;
+    p->op.output = output;
+    p->op.done = &poolDone;
+    p->op.arg = p;
+    p->done = done;
+    asyncSubmit(pool->engine, &p->op);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Pass result of finished transfer to callback of caller and free the transfer
+ * @param AsyncOp *op - finished transfer, engine does not touch it anymore
+ * @return void
+ */
+static void poolDone(AsyncOp *op) {
+
+    PoolOp *p = (PoolOp *) op->arg;
+    TransferResult result{op->filename, op->size, op->status, op->error};
+    TransferCallback done = p->done;
+    delete p;
+    if(done){
+        done(result);
+    }
+}
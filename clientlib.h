@@ -0,0 +1,37 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: Client library, pooled connections transfer files and memory of callers in background
+ */
+
+#ifndef CLIENTLIB_H
+#define CLIENTLIB_H
+
+#include <stddef.h>
+#include <string>
+#include <functional>
+
+/*Result of one transfer passed to its callback*/
+struct TransferResult{
+    std::string name;       //file name on server
+    long size;              //transferred bytes
+    int status;             //ReqAns code of server's answer, -1 when there was none
+    const char *error;      //why transfer failed, NULL on success
+};
+
+/*Called by thread of pool when transfer ends, it may submit more transfers but must not wait for the pool*/
+typedef std::function<void(const TransferResult &result)> TransferCallback;
+
+/*Connections and threads of library, opaque for callers, all calls are thread safe*/
+struct ClientPool;
+
+/*--------Prototypes---------*/
+size_t poolBuffers(size_t size);
+ClientPool *poolCreate(std::string host, unsigned short int port, int connections, int threads);
+int poolUpload(ClientPool *pool, std::string filename, TransferCallback done);
+int poolDownload(ClientPool *pool, std::string filename, TransferCallback done);
+int poolPut(ClientPool *pool, std::string name, const char *data, size_t len, TransferCallback done);
+int poolGet(ClientPool *pool, std::string name, std::string *data, TransferCallback done);
+void poolWait(ClientPool *pool);
+void poolDestroy(ClientPool *pool);
+
+#endif //CLIENTLIB_H
@@ -0,0 +1,94 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: Content defined chunking of deduplicated uploads shared by client and server
+ */
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <openssl/sha.h>
+
+#define CHUNK_MIN (16 * 1024)       //no boundary is searched before
+#define CHUNK_AVG (64 * 1024)       //boundaries are harder to find before, easier after
+#define CHUNK_MAX (256 * 1024)      //chunk is cut here at latest
+#define CHUNK_HASH SHA256_DIGEST_LENGTH     //chunk is identified by SHA-256 of its content
+#define CHUNK_RECORD (CHUNK_HASH + 4)       //hash(32) length(4), big endian, one per chunk in list
+#define CHUNK_MASK_S 0xFFFFC00000000000ULL  //18 bits, used before CHUNK_AVG
+#define CHUNK_MASK_L 0xFFFC000000000000ULL  //14 bits, used after CHUNK_AVG
+
+/*Random value of every byte, rolling hash adds them shifted by position*/
+struct GearTable{
+    uint64_t entry[256];
+    GearTable() {
+        uint64_t x = 0x9E3779B97F4A7C15ULL;    //splitmix64, every build gets the same table
+        for(int i = 0; i < 256; i++){
+            uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            entry[i] = z ^ (z >> 31);
+        }
+    }
+};
+
+/**
+ * @description - Find end of next chunk by gear rolling hash (FastCDC), same content gives same boundaries
+ * @param const char *data - data starting with the chunk
+ * @param size_t len - bytes of data to the end of file
+ * @return size_t - length of chunk, 1 .. CHUNK_MAX
+ */
+static inline size_t chunkLength(const char *data, size_t len) {
+
+    static const GearTable gear;    //built once, thread safe
+    if(len <= CHUNK_MIN){
+        return len;
+    }
+    const unsigned char *p = (const unsigned char *) data;
+    size_t end = len < CHUNK_MAX ? len : CHUNK_MAX;
+    size_t normal = len < CHUNK_AVG ? len : CHUNK_AVG;
+    uint64_t hash = 0;
+    size_t i = CHUNK_MIN;
+    for(; i < normal; i++){
+        hash = (hash << 1) + gear.entry[p[i]];
+        if((hash & CHUNK_MASK_S) == 0){
+            return i + 1;
+        }
+    }
+    for(; i < end; i++){
+        hash = (hash << 1) + gear.entry[p[i]];
+        if((hash & CHUNK_MASK_L) == 0){
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+/**
+ * @description - Write record of chunk list
+ * @param char *out - memory of CHUNK_RECORD bytes
+ * @param const unsigned char *hash - SHA-256 of chunk
+ * @param size_t len - length of chunk
+ * @return void
+ */
+static inline void chunkRecord(char *out, const unsigned char *hash, size_t len) {
+
+    uint32_t length = htobe32((uint32_t) len);
+    memcpy(out, hash, CHUNK_HASH);
+    memcpy(out + CHUNK_HASH, &length, 4);
+}
+
+/**
+ * @description - Get length of chunk from its record
+ * @param const char *record - CHUNK_RECORD bytes, hash is at the beginning
+ * @return size_t - length of chunk
+ */
+static inline size_t recordLength(const char *record) {
+
+    uint32_t length;
+    memcpy(&length, record + CHUNK_HASH, 4);
+    return be32toh(length);
+}
+
+#endif //DEDUP_H
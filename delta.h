@@ -0,0 +1,114 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: Block signatures and instructions of delta uploads shared by client and server
+ */
+
+#ifndef DELTA_H
+#define DELTA_H
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <math.h>
+#include <openssl/sha.h>
+
+#define DELTA_MIN 2048              //smallest block of signatures
+#define DELTA_MAX (128 * 1024)      //biggest block of signatures
+#define DELTA_STRONG 16             //first bytes of SHA-256 of block
+#define DELTA_RECORD (4 + DELTA_STRONG)     //weak(4) strong(16), big endian, one per block of server's file
+#define DELTA_HEADER 9              //type(1) first(4) count(4), big endian
+#define DELTA_LITERAL (256 * 1024)  //max bytes of one DELTA_DATA instruction
+
+/*Instructions of delta stream, file is rebuilt in their order*/
+#define DELTA_COPY 1    //copy count blocks of server's file starting by block first
+#define DELTA_DATA 2    //count bytes of new data follow the header, first is 0
+
+/**
+ * @description - Choose block of signatures, about square root of file size, so their number grows slowly
+ * @param long size - size of server's file
+ * @return size_t - block size, multiple of 1 KiB
+ */
+static inline size_t deltaBlock(long size) {
+
+    size_t block = ((size_t) sqrt((double) size) + 1023) & ~(size_t) 1023;
+    return block < DELTA_MIN ? DELTA_MIN : block > DELTA_MAX ? DELTA_MAX : block;
+}
+
+/**
+ * @description - Compute weak checksum of block (rsync), it can be rolled by one byte
+ * @param const char *data - block
+ * @param size_t len - bytes of block
+ * @return uint32_t - sum of bytes in low half, sum of sums in high half
+ */
+static inline uint32_t weakSum(const char *data, size_t len) {
+
+    const unsigned char *p = (const unsigned char *) data;
+    uint32_t a = 0, b = 0;
+    for(size_t i = 0; i < len; i++){
+        a += p[i];
+        b += (uint32_t)(len - i) * p[i];
+    }
+    return (a & 0xFFFF) | (b << 16);
+}
+
+/**
+ * @description - Move weak checksum of window by one byte
+ * @param uint32_t sum - checksum of window
+ * @param size_t len - bytes of window
+ * @param unsigned char out - first byte of window, leaves it
+ * @param unsigned char in - byte following window, enters it
+ * @return uint32_t - checksum of window starting one byte later
+ */
+static inline uint32_t rollSum(uint32_t sum, size_t len, unsigned char out, unsigned char in) {
+
+    uint32_t a = ((sum & 0xFFFF) - out + in) & 0xFFFF;
+    uint32_t b = ((sum >> 16) - (uint32_t) len * out + a) & 0xFFFF;
+    return a | (b << 16);
+}
+
+/**
+ * @description - Compute strong checksum of block, it confirms match of weak one
+ * @param const char *data - block
+ * @param size_t len - bytes of block
+ * @param unsigned char *out - memory of DELTA_STRONG bytes
+ * @return void
+ */
+static inline void strongSum(const char *data, size_t len, unsigned char *out) {
+
+    unsigned char hash[SHA256_DIGEST_LENGTH];
+    SHA256((const unsigned char *) data, len, hash);
+    memcpy(out, hash, DELTA_STRONG);
+}
+
+/**
+ * @description - Write header of instruction of delta stream
+ * @param char *out - memory of DELTA_HEADER bytes
+ * @param int type - DELTA_COPY / DELTA_DATA
+ * @param uint32_t first - first copied block
+ * @param uint32_t count - copied blocks / bytes of data
+ * @return void
+ */
+static inline void deltaHeader(char *out, int type, uint32_t first, uint32_t count) {
+
+    uint32_t values[2] = {htobe32(first), htobe32(count)};
+    out[0] = (char) type;
+    memcpy(out + 1, values, 8);
+}
+
+/**
+ * @description - Read header of instruction of delta stream
+ * @param const char *in - DELTA_HEADER bytes
+ * @param uint32_t *first - first copied block
+ * @param uint32_t *count - copied blocks / bytes of data
+ * @return int - type of instruction
+ */
+static inline int readDelta(const char *in, uint32_t *first, uint32_t *count) {
+
+    uint32_t values[2];
+    memcpy(values, in + 1, 8);
+    *first = be32toh(values[0]);
+    *count = be32toh(values[1]);
+    return (unsigned char) in[0];
+}
+
+#endif //DELTA_H
@@ -0,0 +1,79 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: Encoding:deflate of transferred data shared by client and server
+ */
+
+#ifndef ENCODING_H
+#define ENCODING_H
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+#include <zlib.h>
+
+#define ENC_HEADER 8            //payload length(4) original length(4), big endian
+#define ENC_BLOCK (256 * 1024)  //max original bytes of one block
+#define ENC_MAX (ENC_HEADER + ENC_BLOCK + ENC_BLOCK / 100 + 64)  //encoded block with header, >= compressBound
+#define ENC_SKIP 8              //blocks sent raw without trying after incompressible one
+
+/**
+ * @description - Encode one block, compressed payload is used just when it saves at least tenth of data
+ * @param const char *data - original data
+ * @param size_t len - bytes of data, 1 .. ENC_BLOCK
+ * @param char *out - memory of ENC_MAX bytes for header and payload
+ * @param int level - zlib compression level, 0 = payload is always raw
+ * @return size_t - bytes of encoded block, payload is raw when it equals ENC_HEADER + len
+ */
+static inline size_t encodeBlock(const char *data, size_t len, char *out, int level) {
+
+    uLongf payload = ENC_MAX - ENC_HEADER;
+    if(level <= 0 || compress2((Bytef *)(out + ENC_HEADER), &payload, (const Bytef *) data, (uLong) len, level) != Z_OK
+       || payload >= len - len / 10){
+        memcpy(out + ENC_HEADER, data, len);
+        payload = len;
+    }
+
+    uint32_t lengths[2] = {htobe32((uint32_t) payload), htobe32((uint32_t) len)};
+    memcpy(out, lengths, ENC_HEADER);
+    return ENC_HEADER + (size_t) payload;
+}
+
+/**
+ * @description - Read header of encoded block
+ * @param const char *block - at least ENC_HEADER bytes
+ * @param size_t *payload - bytes of payload following header
+ * @param size_t *original - bytes of original data
+ * @return int - success = 0, failure = 1 when lengths are not valid
+ */
+static inline int blockHeader(const char *block, size_t *payload, size_t *original) {
+
+    uint32_t lengths[2];
+    memcpy(lengths, block, ENC_HEADER);
+    *payload = be32toh(lengths[0]);
+    *original = be32toh(lengths[1]);
+    return *payload == 0 || *payload > *original || *original > ENC_BLOCK;
+}
+
+/**
+ * @description - Decode payload of block
+ * @param const char *block - whole block with header
+ * @param char *out - memory of ENC_BLOCK bytes for original data, raw payload is not copied
+ * @return const char * - original data, NULL when payload is corrupted
+ */
+static inline const char *decodeBlock(const char *block, char *out) {
+
+    size_t payload, original;
+    if(blockHeader(block, &payload, &original) != 0){
+        return NULL;
+    }
+    if(payload == original){
+        return block + ENC_HEADER;
+    }
+    uLongf len = ENC_BLOCK;
+    if(uncompress((Bytef *) out, &len, (const Bytef *)(block + ENC_HEADER), (uLong) payload) != Z_OK || len != original){
+        return NULL;
+    }
+    return out;
+}
+
+#endif //ENCODING_H
@@ -0,0 +1,87 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: Binary framing of requests and responses shared by client and server
+ */
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+#include <string.h>
+#include <endian.h>
+
+#define FRAME_MAGIC 0xF7        //first byte of binary message, text message starts with digit
+#define FRAME_VERSION 1
+#define FRAME_HEADER_SIZE 32    //fixed header, file name of request follows it
+
+/*Flags of binary message*/
+#define FRAME_KEEPALIVE 0x01    //Connection:keep-alive
+#define FRAME_PIPELINE 0x02     //Pipeline:1, data of upload follow the request
+#define FRAME_RESUME 0x04       //Resume:1
+#define FRAME_OFFSET 0x08       //offset is valid (Offset of download / resumed upload)
+#define FRAME_RANGE 0x10        //length of download request is Range
+#define FRAME_SIZE 0x20         //size of whole file is valid (response to ranged download)
+#define FRAME_DEFLATE 0x40      //Encoding:deflate, data are encoded blocks
+#define FRAME_CHECKSUM 0x80     //Checksum:crc32c, final ACK has CRC32C of data in size
+
+/*Header of binary message, on the wire numbers are big endian:
+  magic(1) version(1) opcode(1) flags(1) nameLen(2) reserved(2) length(8) offset(8) size(8)*/
+struct Frame{
+    uint8_t version;
+    uint8_t opcode;     //ReqAns, operation of request / result in response
+    uint8_t flags;      //FRAME_* flags
+    uint16_t nameLen;   //bytes of file name following header, 0 in response
+    uint64_t length;    //Length of upload, Range of download / Length of sent data
+    uint64_t offset;
+    uint64_t size;      //Size of whole file / CRC32C of data in final ACK
+};
+
+/**
+ * @description - Write header of binary message
+ * @param char *buf - memory of FRAME_HEADER_SIZE bytes
+ * @param const Frame *f - header to be written
+ * @return void
+ */
+static inline void frameEncode(char *buf, const Frame *f) {
+
+    uint16_t nameLen = htobe16(f->nameLen);
+    uint64_t length = htobe64(f->length);
+    uint64_t offset = htobe64(f->offset);
+    uint64_t size = htobe64(f->size);
+
+    buf[0] = (char) FRAME_MAGIC;
+    buf[1] = (char) f->version;
+    buf[2] = (char) f->opcode;
+    buf[3] = (char) f->flags;
+    memcpy(buf + 4, &nameLen, 2);
+    memset(buf + 6, 0, 2);
+    memcpy(buf + 8, &length, 8);
+    memcpy(buf + 16, &offset, 8);
+    memcpy(buf + 24, &size, 8);
+}
+
+/**
+ * @description - Read header of binary message in place, buffer needn't be aligned
+ * @param const char *buf - FRAME_HEADER_SIZE bytes starting with FRAME_MAGIC
+ * @param Frame *f - read header
+ * @return void
+ */
+static inline void frameDecode(const char *buf, Frame *f) {
+
+    uint16_t nameLen;
+    uint64_t length, offset, size;
+    memcpy(&nameLen, buf + 4, 2);
+    memcpy(&length, buf + 8, 8);
+    memcpy(&offset, buf + 16, 8);
+    memcpy(&size, buf + 24, 8);
+
+    f->version = (uint8_t) buf[1];
+    f->opcode = (uint8_t) buf[2];
+    f->flags = (uint8_t) buf[3];
+    f->nameLen = be16toh(nameLen);
+    f->length = be64toh(length);
+    f->offset = be64toh(offset);
+    f->size = be64toh(size);
+}
+
+#endif //FRAME_H
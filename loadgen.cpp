@@ -0,0 +1,703 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: Load generator, starts server and measures throughput and latency of transfers
+ */
+
+#include <iostream>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>  //inet_addr
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sstream>
+#include <fstream>
+#include <getopt.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <chrono>
+#include <iomanip>
+#include "frame.h"
+
+#define EXIT_SUCCESS 0
+#define EXIT_FAILURE 1
+#define MAX_BUFF_SIZE 4096
+#define DATA_BUFF_SIZE (1024 * 1024)    //data of uploads, received data of downloads are thrown away
+#define IO_TIMEOUT 30                   //seconds without progress, then operation fails
+#define START_TIMEOUT 5000              //milliseconds to wait for server to listen
+
+using namespace std;
+
+/*Enum for identifying and result of transfer operation*/
+enum ReqAns{
+    Up,         //upload operation
+    Down,       //download operation
+    ACK,        //operation completed successfully
+    NACK,       //operation failed
+    NotFound,   //if requested file wasn't found
+    Unknown,    //if server received unrecognized request
+    TooLong,    //request was too long
+    Incomplete, //request was incomplete
+    Overloaded  //server is overloaded
+};
+
+/*One measured operation*/
+struct BenchOp{
+    ReqAns type;        //Up or Down
+    size_t size;        //index of file size
+};
+
+/*Results of operations with one file size*/
+struct SizeStats{
+    string label;               //size as given by user, f.e.: 64K
+    long size;
+    vector<double> latencies;   //microseconds of successful operations
+    long bytes;
+    int failed;
+};
+
+/*State shared by all connections of benchmark*/
+struct Bench{
+    unsigned short int port;
+    bool keepAlive;             //operations of one connection reuse it
+    bool binary;                //requests are binary frames
+    vector<BenchOp> ops;        //all operations in order of start
+    std::atomic<size_t> next;   //index of next operation to be started
+    vector<SizeStats> stats;
+    std::mutex mtx;             //guards stats
+};
+
+/*Resources used by process*/
+struct Usage{
+    long syscalls;      //read and write syscalls (syscr + syscw of /proc/<pid>/io)
+    double cpu;         //user + system time in seconds
+};
+
+/*--------Prototypes---------*/
+long parseSize(string size);
+int createDataset(string dir, vector<SizeStats> &stats);
+pid_t startServer(string server, string options, unsigned short int port, string dir);
+int connectServer(unsigned short int port);
+int sendAll(int socket, const char *data, size_t length);
+int receiveResponse(int socket, bool binary, char *buffer, Frame *f);
+long runOp(Bench *b, int *socket, BenchOp &op, int worker);
+void benchWorker(Bench *b, int worker);
+int readUsage(pid_t pid, Usage *u);
+double percentile(vector<double> &sorted, double q);
+
+/*Data of uploads, filled once by pseudo-random bytes*/
+static char uploadData[DATA_BUFF_SIZE];
+
+int main(int argc, char *argv[]) {
+    unsigned short int port = 12250;
+    string server = "./server";
+    string serverOpts = "-e";
+    int concurrency = 4;
+    int count = 100;
+    string sizes = "1K,64K,1M,16M";
+    int uploads = 50;
+    bool keepAlive = false;
+    bool binary = false;
+    string dir = "benchData";
+
+    int option;
+    opterr = 0; // getopt will not print it's error messages
+    while ((option = getopt(argc, argv, "p:s:o:c:n:z:u:kbd:h")) != -1) {
+        switch (option) {
+            case 'p':
+                istringstream (optarg) >> port;
+                break;
+            case 's':
+                server = optarg;
+                break;
+            case 'o':
+                serverOpts = optarg;
+                break;
+            case 'c':
+                istringstream (optarg) >> concurrency;
+                break;
+            case 'n':
+                istringstream (optarg) >> count;
+                break;
+            case 'z':
+                sizes = optarg;
+                break;
+            case 'u':
+                istringstream (optarg) >> uploads;
+                break;
+            case 'k':
+                keepAlive = true;
+                break;
+            case 'b':
+                binary = true;
+                break;
+            case 'd':
+                dir = optarg;
+                break;
+            default:
+                cerr << "HELP:" << endl;
+                cerr << "./loadgen [-p <port>] [-s <server binary>] [-o <server options>] [-c <connections>]"
+                     << " [-n <operations per size>] [-z <sizes>] [-u <percent of uploads>] [-k] [-b] [-d <directory>]" << endl;
+                cerr << " -o -> options of started server (default: -e)\n";
+                cerr << " -c -> number of parallel connections (default: 4)\n";
+                cerr << " -n -> number of operations with every file size (default: 100)\n";
+                cerr << " -z -> comma separated file sizes, suffixes K, M, G (default: 1K,64K,1M,16M)\n";
+                cerr << " -u -> percent of operations which are uploads (default: 50)\n";
+                cerr << " -k -> connection is kept alive for following operations\n";
+                cerr << " -b -> requests are sent in binary frames\n";
+                cerr << " -d -> directory of server and its files (default: benchData)\n\n";
+                return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if(concurrency < 1 || count < 1 || uploads < 0 || uploads > 100 || optind != argc){
+        cerr << "Wrong arguments" << endl;
+        return EXIT_FAILURE;
+    }
+
+    Bench b;
+    b.port = port;
+    b.keepAlive = keepAlive;
+    b.binary = binary;
+    b.next = 0;
+
+    //parse sizes
+    istringstream list(sizes);
+    string item;
+    while(getline(list, item, ',')){
+        SizeStats st;
+        st.label = item;
+        st.size = parseSize(item);
+        st.bytes = 0;
+        st.failed = 0;
+        if(st.size < 0){
+            cerr << "Wrong size " << item << endl;
+            return EXIT_FAILURE;
+        }
+        b.stats.push_back(st);
+    }
+
+    //same mix of operations in every run
+    mt19937 gen(42);
+    for(size_t i = 0; i < b.stats.size(); i++){
+        for(int j = 0; j < count; j++){
+            b.ops.push_back(BenchOp{(int)(gen() % 100) < uploads ? Up : Down, i});
+        }
+    }
+    shuffle(b.ops.begin(), b.ops.end(), gen);
+    for(size_t i = 0; i < sizeof(uploadData); i++){
+        uploadData[i] = (char) gen();
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+
+    if(createDataset(dir, b.stats) == EXIT_FAILURE){
+        return EXIT_FAILURE;
+    }
+    pid_t pid = startServer(server, serverOpts, port, dir);
+    if(pid == -1){
+        return EXIT_FAILURE;
+    }
+
+    Usage serverBefore, serverAfter;
+    struct rusage selfBefore, selfAfter;
+    readUsage(pid, &serverBefore);
+    getrusage(RUSAGE_SELF, &selfBefore);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    vector<thread> workers;
+    for(int i = 0; i < concurrency; i++){
+        workers.push_back(thread(&benchWorker, &b, i));
+    }
+    for(size_t i = 0; i < workers.size(); i++){
+        workers[i].join();
+    }
+
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+    getrusage(RUSAGE_SELF, &selfAfter);
+    bool usage = readUsage(pid, &serverAfter) == EXIT_SUCCESS;
+
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+
+    //uploaded files would only fill the disk, downloaded ones are kept for next run
+    for(int i = 0; i < concurrency; i++){
+        for(size_t j = 0; j < b.stats.size(); j++){
+            ostringstream name;
+            name << dir << "/up_" << i << "_" << b.stats[j].label;
+            unlink(name.str().c_str());
+        }
+    }
+
+    //report
+    cout << "Benchmark: server '" << serverOpts << "', " << concurrency << " connections" << (keepAlive ? " kept alive" : "")
+         << (binary ? ", binary requests" : "")
+         << ", " << count << " operations per size, " << uploads << " % uploads\n\n";
+    cout << setw(8) << "size" << setw(8) << "ops" << setw(8) << "failed" << setw(12) << "MiB/s/conn"
+         << setw(10) << "p50 ms" << setw(10) << "p99 ms" << setw(10) << "p999 ms" << "\n";
+
+    long bytes = 0;
+    int done = 0;
+    int failed = 0;
+    cout << fixed;
+    for(size_t i = 0; i < b.stats.size(); i++){
+        SizeStats &st = b.stats[i];
+        sort(st.latencies.begin(), st.latencies.end());
+        double busy = 0;
+        for(size_t j = 0; j < st.latencies.size(); j++){
+            busy += st.latencies[j];
+        }
+        cout << setw(8) << st.label << setw(8) << st.latencies.size() << setw(8) << st.failed << setprecision(1)
+             << setw(12) << (busy > 0 ? (double) st.bytes / (1024 * 1024) / (busy / 1e6) : 0) << setprecision(3)
+             << setw(10) << percentile(st.latencies, 0.5) / 1000 << setw(10) << percentile(st.latencies, 0.99) / 1000
+             << setw(10) << percentile(st.latencies, 0.999) / 1000 << "\n";
+        bytes += st.bytes;
+        done += (int) st.latencies.size();
+        failed += st.failed;
+    }
+
+    double mib = (double) bytes / (1024 * 1024);
+    double gib = mib / 1024;
+    double selfCpu = (double)(selfAfter.ru_utime.tv_sec - selfBefore.ru_utime.tv_sec + selfAfter.ru_stime.tv_sec
+                              - selfBefore.ru_stime.tv_sec)
+                     + (double)(selfAfter.ru_utime.tv_usec - selfBefore.ru_utime.tv_usec + selfAfter.ru_stime.tv_usec
+                                - selfBefore.ru_stime.tv_usec) / 1e6;
+
+    cout << "\ntotal: " << done << " operations, " << failed << " failed, " << setprecision(1) << mib << " MiB in "
+         << setprecision(2) << seconds << " s (" << setprecision(1) << (seconds > 0 ? mib / seconds : 0) << " MiB/s)\n";
+    if(usage){
+        long syscalls = serverAfter.syscalls - serverBefore.syscalls;
+        cout << "server: " << syscalls << " read/write syscalls, " << scientific << setprecision(3)
+             << (bytes > 0 ? (double) syscalls / (double) bytes : 0) << " per byte, " << fixed << setprecision(3)
+             << (gib > 0 ? (serverAfter.cpu - serverBefore.cpu) / gib : 0) << " s CPU per GiB\n";
+    }
+    cout << "loadgen: " << setprecision(3) << (gib > 0 ? selfCpu / gib : 0) << " s CPU per GiB" << endl;
+
+    return failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
+
+/**
+ * @description - Convert size with optional suffix to bytes
+ * @param string size - f.e.: 512, 64K, 16M, 2G
+ * @return long - bytes, -1 when size is wrong
+ */
+long parseSize(string size) {
+
+    long value = -1;
+    char suffix = '\0';
+    istringstream ss(size);
+    ss >> value;
+    if(ss.fail() || value < 0){
+        return -1;
+    }
+    ss >> suffix;
+    switch (suffix){
+        case '\0':
+            return value;
+        case 'K': case 'k':
+            return value << 10;
+        case 'M': case 'm':
+            return value << 20;
+        case 'G': case 'g':
+            return value << 30;
+        default:
+            return -1;
+    }
+}
+
+/**
+ * @description - Create directory of server with downloaded files, files of right size are kept from previous run
+ * @param string dir - directory of server
+ * @param vector<SizeStats> &stats - file sizes
+ * @return int - success = 0, failure = 1
+ */
+int createDataset(string dir, vector<SizeStats> &stats) {
+
+    if(mkdir(dir.c_str(), 0755) == -1 && errno != EEXIST){
+        cerr << "Unable to create directory " << dir << endl;
+        return EXIT_FAILURE;
+    }
+
+    for(size_t i = 0; i < stats.size(); i++){
+        string path = dir + "/bench_" + stats[i].label;
+        struct stat info;
+        if(stat(path.c_str(), &info) == 0 && info.st_size == (off_t) stats[i].size){
+            continue;
+        }
+
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if(fd == -1){
+            cerr << "Unable to create a file " << path << endl;
+            return EXIT_FAILURE;
+        }
+        for(long left = stats[i].size; left > 0; ){
+            ssize_t bytes = write(fd, uploadData, left < DATA_BUFF_SIZE ? (size_t) left : DATA_BUFF_SIZE);
+            if(bytes <= 0){
+                cerr << "Writing to file FAILED" << endl;
+                close(fd);
+                return EXIT_FAILURE;
+            }
+            left -= bytes;
+        }
+        close(fd);
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Run server in its directory and wait until it accepts connections
+ * @param string server - path of server binary
+ * @param string options - options of server separated by spaces
+ * @param unsigned short int port - port of server
+ * @param string dir - working directory of server
+ * @return pid_t - process of server, -1 on failure
+ */
+pid_t startServer(string server, string options, unsigned short int port, string dir) {
+
+    char path[PATH_MAX];
+    if(realpath(server.c_str(), path) == NULL){
+        cerr << "Server binary " << server << " not found" << endl;
+        return -1;
+    }
+
+    ostringstream strPort;
+    strPort << port;
+    vector<string> args;
+    args.push_back(path);
+    args.push_back("-p");
+    args.push_back(strPort.str());
+    istringstream ss(options);
+    string arg;
+    while(ss >> arg){
+        args.push_back(arg);
+    }
+
+    pid_t pid = fork();
+    if(pid == -1){
+        cerr << "Starting server FAILED" << endl;
+        return -1;
+    }
+    if(pid == 0){
+        vector<char *> argv;
+        for(size_t i = 0; i < args.size(); i++){
+            argv.push_back((char *) args[i].c_str());
+        }
+        argv.push_back(NULL);
+        if(chdir(dir.c_str()) == 0){
+            execv(argv[0], argv.data());
+        }
+        _exit(127);
+    }
+
+    //server is ready when it accepts connection
+    for(int waited = 0; waited < START_TIMEOUT; waited += 20){
+        int socket = connectServer(port);
+        if(socket != -1){
+            close(socket);
+            return pid;
+        }
+        if(waitpid(pid, NULL, WNOHANG) == pid){
+            cerr << "Server ended" << endl;
+            return -1;
+        }
+        usleep(20 * 1000);
+    }
+    cerr << "Server does not accept connections" << endl;
+    kill(pid, SIGTERM);
+    waitpid(pid, NULL, 0);
+    return -1;
+}
+
+/**
+ * @description - Connect to local server, blocked operations fail after IO_TIMEOUT
+ * @param unsigned short int port - port of server
+ * @return int - opened socket, -1 on failure
+ */
+int connectServer(unsigned short int port) {
+
+    int socket_desc = socket(AF_INET, SOCK_STREAM, 0);
+    if(socket_desc == -1){
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = inet_addr("127.0.0.1");
+
+    if(connect(socket_desc, (struct sockaddr *) &addr, sizeof(addr)) < 0){
+        close(socket_desc);
+        return -1;
+    }
+
+    int yes = 1;
+    struct timeval timeout;
+    timeout.tv_sec = IO_TIMEOUT;
+    timeout.tv_usec = 0;
+    setsockopt(socket_desc, IPPROTO_TCP, TCP_NODELAY, (void *)&yes, sizeof(yes));
+    setsockopt(socket_desc, SOL_SOCKET, SO_RCVTIMEO, (void *)&timeout, sizeof(timeout));
+    setsockopt(socket_desc, SOL_SOCKET, SO_SNDTIMEO, (void *)&timeout, sizeof(timeout));
+    return socket_desc;
+}
+
+/**
+ * @description - Send whole buffer
+ * @param int socket - opened socket to the server
+ * @param const char *data - data to be sent
+ * @param size_t length - bytes to be sent
+ * @return int - success = 0, failure = 1
+ */
+int sendAll(int socket, const char *data, size_t length) {
+
+    while(length > 0){
+        ssize_t bytes = send(socket, data, length, 0);
+        if(bytes < 0 && errno == EINTR){
+            continue;
+        }
+        if(bytes <= 0){
+            return EXIT_FAILURE;
+        }
+        data += bytes;
+        length -= (size_t) bytes;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Receive one response, data following it stay in socket
+ * @param int socket - opened socket to the server
+ * @param bool binary - response is binary frame, otherwise text with terminating zero
+ * @param char *buffer - memory of MAX_BUFF_SIZE bytes for response
+ * @param Frame *f - length and keep-alive flag of response, text response is translated to it
+ * @return int - success = 0 when response is ACK, failure = 1
+ */
+int receiveResponse(int socket, bool binary, char *buffer, Frame *f) {
+
+    memset(f, 0, sizeof(*f));
+    if(binary){
+        if(recv(socket, buffer, FRAME_HEADER_SIZE, MSG_WAITALL) != FRAME_HEADER_SIZE
+           || (unsigned char) buffer[0] != FRAME_MAGIC){
+            return EXIT_FAILURE;
+        }
+        frameDecode(buffer, f);
+        return f->opcode == ACK ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    int total = 0;
+    memset(buffer, 0, MAX_BUFF_SIZE);
+
+    while(total < MAX_BUFF_SIZE - 1){
+
+        ssize_t received = recv(socket, buffer + total, (size_t)(MAX_BUFF_SIZE - 1 - total), MSG_PEEK);
+        if(received <= 0){
+            return EXIT_FAILURE;
+        }
+
+        char *end = strstr(buffer + (total > 0 ? total - 1 : 0), "\n\n");
+        if(end == NULL){    //consume peeked part and wait for the rest
+            total += (int) recv(socket, buffer + total, (size_t) received, 0);
+            continue;
+        }
+
+        int msgLen = (int)(end - buffer) + 3;
+        if(recv(socket, buffer + total, (size_t)(msgLen - total), MSG_WAITALL) != msgLen - total){
+            return EXIT_FAILURE;
+        }
+        buffer[msgLen - 1] = '\0';
+        char *attr = strstr(buffer, "Length:");
+        f->length = attr != NULL ? strtoull(attr + 7, NULL, 10) : 0;
+        f->flags = strstr(buffer, "Connection:keep-alive") != NULL ? FRAME_KEEPALIVE : 0;
+        return buffer[0] - '0' == ACK ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    return EXIT_FAILURE;
+}
+
+/**
+ * @description - Run one upload or download, connection is opened when needed
+ * @param Bench *b - shared state of benchmark
+ * @param int *socket - connection kept from previous operation, -1 if none
+ * @param BenchOp &op - operation to be run
+ * @param int worker - index of connection, uploads of connections go to different files
+ * @return long - transferred bytes, -1 on failure
+ */
+long runOp(Bench *b, int *socket, BenchOp &op, int worker) {
+
+    static thread_local char data[DATA_BUFF_SIZE];
+    SizeStats &st = b->stats[op.size];
+
+    if(*socket == -1 && (*socket = connectServer(b->port)) == -1){
+        return -1;
+    }
+
+    ostringstream name;
+    if(op.type == Down){
+        name << "bench_" << st.label;
+    }
+    else{
+        name << "up_" << worker << "_" << st.label;
+    }
+
+    string str;
+    char buffer[MAX_BUFF_SIZE];
+    Frame f;
+    if(b->binary){
+        f.version = FRAME_VERSION;
+        f.opcode = (uint8_t) op.type;
+        f.flags = b->keepAlive ? FRAME_KEEPALIVE : 0;
+        f.nameLen = (uint16_t) name.str().length();
+        f.length = op.type == Up ? (uint64_t) st.size : 0;
+        f.offset = f.size = 0;
+        frameEncode(buffer, &f);
+        str.assign(buffer, FRAME_HEADER_SIZE);
+        str.append(name.str());
+    }
+    else{
+        ostringstream request;
+        request << op.type << "\nFile:" << name.str();
+        if(op.type == Up){
+            request << "\nLength:" << st.size;
+        }
+        if(b->keepAlive){
+            request << "\nConnection:keep-alive";
+        }
+        request << "\n\n";
+        str = request.str();
+        str.push_back('\0');
+    }
+
+    long length = st.size;
+    bool ok = sendAll(*socket, str.data(), str.length()) == EXIT_SUCCESS
+              && receiveResponse(*socket, b->binary, buffer, &f) == EXIT_SUCCESS;
+
+    if(ok && op.type == Down){
+        length = (long) f.length;
+        ok = length == st.size;
+        for(long left = length; ok && left > 0; ){
+            ssize_t bytes = recv(*socket, data, left < DATA_BUFF_SIZE ? (size_t) left : DATA_BUFF_SIZE, 0);
+            ok = bytes > 0;
+            left -= bytes;
+        }
+    }
+    else if(ok){
+        for(long left = length; ok && left > 0; left -= DATA_BUFF_SIZE){
+            ok = sendAll(*socket, uploadData, left < DATA_BUFF_SIZE ? (size_t) left : DATA_BUFF_SIZE) == EXIT_SUCCESS;
+        }
+        ok = ok && receiveResponse(*socket, b->binary, buffer, &f) == EXIT_SUCCESS;
+    }
+
+    //connection is reused only when server keeps it
+    if(!ok || !b->keepAlive || !(f.flags & FRAME_KEEPALIVE)){
+        close(*socket);
+        *socket = -1;
+    }
+    return ok ? length : -1;
+}
+
+/**
+ * @description - Run operations of benchmark by one connection until none is left
+ * @param Bench *b - shared state of benchmark
+ * @param int worker - index of connection
+ * @return void
+ */
+void benchWorker(Bench *b, int worker) {
+
+    int socket = -1;
+
+    while(1){
+        size_t i = b->next++;
+        if(i >= b->ops.size()){
+            break;
+        }
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+        long bytes = runOp(b, &socket, b->ops[i], worker);
+        double us = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+
+        lock_guard<std::mutex> lock(b->mtx);
+        SizeStats &st = b->stats[b->ops[i].size];
+        if(bytes < 0){
+            st.failed++;
+        }
+        else{
+            st.latencies.push_back(us);
+            st.bytes += bytes;
+        }
+    }
+
+    if(socket != -1){
+        close(socket);
+    }
+}
+
+/**
+ * @description - Read syscall counters and CPU time of process from /proc
+ * @param pid_t pid - process
+ * @param Usage *u - read values
+ * @return int - success = 0, failure = 1
+ */
+int readUsage(pid_t pid, Usage *u) {
+
+    ostringstream base;
+    base << "/proc/" << pid << "/";
+    u->syscalls = 0;
+    u->cpu = 0;
+
+    ifstream io((base.str() + "io").c_str());
+    string name;
+    long value;
+    bool found = false;
+    while(io >> name >> value){
+        if(name == "syscr:" || name == "syscw:"){
+            u->syscalls += value;
+            found = true;
+        }
+    }
+
+    //utime and stime are 14th and 15th field, name of process in parentheses may contain spaces
+    ifstream statFile((base.str() + "stat").c_str());
+    string stat;
+    getline(statFile, stat);
+    size_t end = stat.rfind(')');
+    if(!found || end == string::npos){
+        return EXIT_FAILURE;
+    }
+    istringstream fields(stat.substr(end + 2));
+    string field;
+    long ticks = 0;
+    for(int i = 3; i <= 15 && fields >> field; i++){
+        if(i >= 14){
+            ticks += atol(field.c_str());
+        }
+    }
+    u->cpu = (double) ticks / (double) sysconf(_SC_CLK_TCK);
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Get percentile of sorted values
+ * @param vector<double> &sorted - sorted values
+ * @param double q - quantile, f.e.: 0.99
+ * @return double - value at quantile, 0 when there are no values
+ */
+double percentile(vector<double> &sorted, double q) {
+
+    if(sorted.empty()){
+        return 0;
+    }
+    size_t index = (size_t)(q * (double) sorted.size());
+    if(index >= sorted.size()){
+        index = sorted.size() - 1;
+    }
+    return sorted[index];
+}
@@ -9,25 +9,92 @@
 #include <iostream>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <string.h>
-#include <fstream>
 #include <unistd.h>
 #include <fcntl.h>
 #include <arpa/inet.h>  //inet_addr
 #include <thread>       //-std=c++0x -pthread
 #include <mutex>
-#include <stack>
+#include <atomic>
+#include <condition_variable>
+#include <semaphore.h>
 #include <sstream>
-//#include <sys/sendfile.h>     //freeBSD does not support
+#include <errno.h>
+#include <signal.h>
+#include <getopt.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/eventfd.h>
+#include <sched.h>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <memory>
+#include <unordered_map>
+#include <map>
+#include <deque>
+#include <glob.h>
+#include <sys/file.h>   //flock
+
+#ifndef ZEROCOPY
+#define ZEROCOPY 1      //build with -DZEROCOPY=0 to transfer data just by read/write copying
+#endif
+
+#if ZEROCOPY
+#include <sys/sendfile.h>   //Linux only, freeBSD has different sendfile
+#endif
+
+#ifndef URING
+#define URING 1         //build with -DURING=0 when kernel headers have no io_uring
+#endif
+
+#if URING
+#include "uring.h"
+#endif
+
+#include "frame.h"
+#include "encoding.h"
+#include "checksum.h"
+#include "dedup.h"
+#include "delta.h"
+#include "buffers.h"
+#include "archive.h"
 
 #define EXIT_SUCCESS 0
 #define EXIT_FAILURE 1
 #define MAX_BUFF_SIZE 4096
-#define MAX_CLIENTS 5
+#define MAX_CLIENTS 5         //default number of worker threads
+#define QUEUE_DEPTH 64          //default number of accepted connections waiting for a worker
+#define MAX_EVENTS 256
+#define PIPE_SIZE (1 << 20)     //capacity of pipe used by splice
+#define URING_ENTRIES 1024      //submission queue of event loop's ring
+#define URING_LOOP_BUFFERS 64   //registered buffers shared by transfers of one event loop
+#define CACHE_BUDGET 64         //default MiB of file cache
+#define CACHE_SHARDS 16         //parts of file cache with own lock
+#define CACHE_MAX_FILE (256 * 1024)     //bigger files are sent by zero-copy engines
+#define CHUNK_INDEX_MAX (1 << 20)       //max chunks remembered for deduplicated uploads
+#define CHUNK_LIST_FIRST (64 * 1024)    //first block of chunk list, it doubles as records arrive
+#define DELTA_BLOCKS_MAX (1 << 20)      //bigger files are not offered for delta uploads
+#define ARCHIVE_IOV 1024        //max parts of one writev of archive (IOV_MAX)
+#define SCHED_QUANTUM (1024 * 1024)     //bytes of download sent in one turn of event loop, smaller rests are never delayed
+#define SCHED_BURST 100000000ULL        //nanoseconds of rate collected by idle token bucket
+#define HIST_SUB 8              //buckets per power of two of latency histogram, values are within 12.5 %
+#define HIST_BUCKETS (62 * HIST_SUB)    //nanoseconds up to 2^64
 
 /*Globals declarations*/
-std::mutex threadMtx;   //mutex for push/pop operation
-std::stack<int> numberOfThreads;
+bool uringMode = false; //transfer data by io_uring
+struct FileCache *fileCache = NULL;    //NULL when files are not cached
+bool mmapMode = false;  //downloads are sent from shared mappings of files
+int compressLevel = 1;  //zlib level of downloads with Encoding:deflate
+std::mutex mappingMtx;  //guards mappings
+std::map<std::pair<dev_t, ino_t>, std::weak_ptr<struct Mapping> > mappings;    //files mapped at the moment
+struct ChunkIndex *chunkIndex = NULL;  //chunks of files stored by deduplicated uploads
+bool metricsOn = false;     //counters and histograms are collected for metrics endpoint
+std::mutex metricsMtx;      //guards allMetrics
+std::vector<struct Metrics *> allMetrics;  //metrics of every thread which served something
+std::atomic<long> activeConnections(0);
 
 using namespace std;
 
@@ -41,54 +108,589 @@ enum ReqAns{
     Unknown,    //unrecognized request
     TooLong,    //too long request, longer than MAX_BUFF_SIZE
     Incomplete, //in case required attribute missing (Length: / File:)
-    Overloaded  //MAX_CLIENTS clients are connected
+    Overloaded, //all workers are busy and admission queue is full
+    Archive,    //archive operation, more files are sent in one stream, from client side
+    REQANS      //number of codes, new ones are added above
+};
+
+/*Phases of connection's state machine*/
+enum Phase{
+    ReadReq,    //receiving client's request
+    SendResp,   //sending response to the client
+    Upload,     //receiving data of uploaded file
+    Index,      //receiving chunk list of deduplicated upload
+    Manifest,   //receiving list of files of archive
+    Pack,       //sending headers and small files of archive, big files are sent in Download phase
+    Download,   //sending data of downloaded file
+    Discard,    //receiving data of rejected pipelined upload, they are thrown away
+    Syncing,    //complete upload waits for background flusher, final ACK follows
+    Finished,   //request is served, persistent connection reads next one, other is closed
+    Closing     //nothing else to do, connection will be closed
+};
+
+/*Result of one step of connection's state machine*/
+enum StepRes{
+    Progress,   //some work was done, step can be called again
+    Blocked,    //socket would block, wait for next event
+    Done        //connection is finished and should be closed
+};
+
+/*How data of file are moved between file and socket*/
+enum Engine{
+    SendFile,   //sendfile(), zero-copy download of regular files
+    Splice,     //splice() through a pipe, zero-copy for other files and uploads
+    Copy,       //read()/recv() to buffer and send()/pwrite() it
+    IoUring,    //batches of linked read -> write pairs in io_uring
+    Cached,     //content of file is in cache, it's sent together with response by writev
+    Mapped,     //file is mapped to memory shared by its downloads, sent like cached one
+    Deflate,    //data are sent / received as blocks of Encoding:deflate
+    Chunks,     //missing chunks of deduplicated upload are received whole and checked by hash
+    Delta       //file is rebuilt from server's old copy by received instructions
+};
+
+/*How uploaded files are made durable before final ACK*/
+enum Durability{
+    NoSync,     //file is renamed and ACKed at once, kernel writes it back later
+    FileSync,   //every upload flushes its file and directory before ACK
+    GroupSync   //background flusher makes uploads finished meanwhile durable together
+};
+
+/*Chunk of deduplicated upload announced by client*/
+struct Chunk{
+    string hash;        //SHA-256 of content
+    off_t offset;       //offset in uploaded file
+    size_t length;
+};
+
+/*State of one client's connection*/
+struct Connection{
+    int socket;                     //opened socket to the client
+    Phase phase;                    //current phase
+    Phase next;                     //phase entered when response is sent
+    char request[MAX_BUFF_SIZE];    //received request, may be followed by data or next requests
+    size_t reqLen;                  //bytes of request buffer received so far
+    size_t scanned;                 //bytes of request buffer already searched for end of request
+    bool keepAlive;                 //connection serves next request when this one is done
+    int op;                         //ReqAns operation of current request
+    uint64_t reqStart;              //time when current request was complete, 0 when metrics are off
+    bool firstByte;                 //first byte of response to current request was not sent yet
+    long counted;                   //transferred bytes already added to metrics
+    bool pipelined;                 //data of upload follow the request without waiting for ACK
+    bool binary;                    //request came in binary frame, response is sent the same way
+    bool upgrade;                   //text request asked for binary framing, response confirms it
+    bool encoded;                   //data of transfer are blocks of Encoding:deflate
+    vector<char> block;             //encoded block being sent / received
+    size_t blockLen;                //bytes of block to be sent / received so far
+    size_t blockOff;                //bytes of block already sent
+    size_t blockOrig;               //original bytes of block being sent
+    int rawBlocks;                  //blocks sent without trying compression
+    bool checksum;                  //CRC32C of transferred data is sent in final ACK
+    uint32_t crc;                   //CRC32C of data transferred so far
+    bool dedup;                     //upload sends chunk list first, then just chunks server does not have
+    vector<Chunk> chunks;           //chunks of deduplicated upload
+    size_t listLen;                 //bytes of chunk list announced by client, block grows to it as list arrives
+    vector<size_t> missing;         //chunks which are received from client
+    size_t chunkNext;               //index to missing of chunk being received
+    int basis;                      //old copy of file rebuilt by delta upload, -1 if none
+    size_t basisBlock;              //block of its signatures
+    off_t basisSize;
+    vector<string> names;           //files of archive in order of sending
+    size_t nameNext;                //index to names of next file packed to archive
+    long files;                     //files packed to archive so far
+    bool ended;                     //last header of archive is packed
+    vector<struct iovec> iov;       //batch of archive: headers and read files in buffer, cached files
+    size_t iovNext;                 //first part of batch not sent whole
+    vector<std::shared_ptr<const string> > pinned;     //cached files referenced by batch
+    string response;                //response being sent
+    size_t respSent;                //bytes of response already sent
+    int file;                       //file being transferred, -1 if none
+    std::shared_ptr<const string> cached;   //content of downloaded file from cache, NULL if none
+    std::shared_ptr<struct Mapping> mapping;    //mapping of downloaded file, NULL if none
+    const char *memory;             //content of file sent by Cached or Mapped engine
+    string path;                    //name of requested file
+    string partPath;                //temporary file of upload, renamed to path when complete
+    bool resumable;                 //partPath is .name.part locked by this upload, it is kept when upload fails
+    long dataLength;                //bytes to be transferred
+    long transferred;               //bytes already transferred
+    Engine engine;                  //how data are transferred
+    off_t fileOff;                  //offset of next read from / write to file
+    int pipe[2];                    //pipe for splice, -1 if not opened
+    size_t pipeSize;                //capacity of pipe
+    size_t pipeLen;                 //bytes waiting in pipe
+#if URING
+    UringTransfer ring;             //transfer by io_uring
+    bool ringWaiting;               //waits for free buffers of event loop's ring
+#endif
+    char *buffer;                   //pooled buffer of data staged for sending, NULL until needed
+    size_t buffLen;                 //bytes staged in buffer
+    size_t buffOff;                 //bytes of buffer already sent
+    struct SyncLoop *loop;          //event loop waiting for flushed upload, NULL in worker thread
+    bool synced;                    //flusher is done with upload, guarded by syncQueue in worker thread
+    bool syncFailed;                //upload could not be flushed or renamed
+    uint64_t syncStart;             //time when upload was complete, 0 when metrics are off
+    bool queued;                    //waits in run queue of event loop, its events are ignored until its turn
+    long deficit;                   //bytes of download connection may send in this turn
+    long shaped;                    //transferred bytes already charged to rate limits
+    std::shared_ptr<struct Bucket> client;  //rate limit of client's address, NULL when not limited
+};
+
+/*Cached content of one file with attributes of its version*/
+struct CacheEntry{
+    string name;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    std::shared_ptr<const string> data;     //connections sending it keep it alive after eviction
+    bool referenced;                        //hit since the clock hand passed, gets second chance
+};
+
+/*Part of file cache, entries form a ring swept by clock hand*/
+struct CacheShard{
+    std::mutex mtx;
+    std::unordered_map<string, size_t> index;  //name -> position in ring
+    vector<CacheEntry> ring;
+    size_t hand;                                //next entry considered for eviction
+    size_t bytes;                               //size of cached data
+};
+
+/*In-memory cache of small hot files, shards are chosen by hash of name*/
+struct FileCache{
+    CacheShard shards[CACHE_SHARDS];
+    size_t shardBudget;                         //max bytes of one shard
+};
+
+/*Where content of chunk is stored, file is checked by its version before chunk is copied*/
+struct ChunkPlace{
+    string path;
+    off_t offset;
+    size_t length;
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+};
+
+/*Chunks of uploaded files found by hash of their content*/
+struct ChunkIndex{
+    std::mutex mtx;
+    std::unordered_map<string, ChunkPlace> places;     //hash -> last file stored with the chunk
+};
+
+/*File mapped once and shared by all its concurrent downloads, unmapped with last of them*/
+struct Mapping{
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    char *addr;
+};
+
+/*Request parsed in place, name points to request buffer of connection*/
+struct Request{
+    int type;           //ReqAns operation
+    const char *name;   //file name, NULL when missing
+    size_t nameLen;     //bytes of file name
+    long length;        //Length of upload, -1 when missing
+    long offset;        //Offset of download, valid with FRAME_OFFSET
+    long range;         //Range of download, valid with FRAME_RANGE
+    unsigned flags;     //FRAME_* flags, attributes of text request are translated to them
+    bool upgrade;       //text request has Binary:1
+    long chunks;        //number of chunks of deduplicated upload, -1 when missing
+    bool delta;         //text request has Delta:1
+};
+
+/*Counters of metrics endpoint*/
+enum Counter{
+    Accepted,       //connections accepted
+    Rejected,       //connections rejected as Overloaded
+    Uploads,        //upload requests
+    Downloads,      //download requests
+    BytesIn,        //bytes of uploaded files
+    BytesOut,       //bytes of downloaded files
+    SyncBatches,    //flushes of uploaded files, group commit flushes more uploads at once
+    COUNTERS
+};
+
+/*Latency histograms of metrics endpoint*/
+enum Latency{
+    AdmissionWait,  //accepted socket waits for worker
+    Handling,       //request is parsed and response prepared (open, stat, cache)
+    FirstByte,      //complete request -> first byte of response sent
+    UploadTime,     //complete request -> upload finished
+    DownloadTime,   //complete request -> download finished
+    SyncTime,       //complete upload -> upload durable
+    LATENCIES
+};
+
+/*Log-linear histogram of nanoseconds (HDR-like), bucket is found by leading bit and 3 bits after it*/
+struct Histogram{
+    std::atomic<uint64_t> buckets[HIST_BUCKETS];
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum;      //nanoseconds
+};
+
+/*Metrics of one thread, written just by it without locked instructions, summed when scraped*/
+struct Metrics{
+    std::atomic<uint64_t> counters[COUNTERS];
+    std::atomic<uint64_t> responses[REQANS];   //responses by ReqAns code
+    Histogram latencies[LATENCIES];
+};
+
+/*Slot of admission queue, seq tells whether it is free for given push or filled for given pop*/
+struct QueueSlot{
+    std::atomic<size_t> seq;
+    int socket;
+    uint64_t accepted;      //time of accept for metrics, 0 when they are off
+};
+
+/*Bounded lock-free queue of accepted sockets waiting for worker threads*/
+struct AdmissionQueue{
+    QueueSlot *slots;
+    size_t capacity;
+    std::atomic<size_t> head;       //position of next push
+    std::atomic<size_t> tail;       //position of next pop
+    sem_t items;                    //number of queued sockets, idle workers sleep on it
+};
+
+/*Connections of event loop whose uploads were flushed, they are handed back through eventfd*/
+struct SyncLoop{
+    int eventFd;
+    std::mutex mtx;
+    vector<Connection *> done;
+};
+
+/*Uploads waiting for background flusher*/
+struct SyncQueue{
+    std::mutex mtx;
+    std::condition_variable wake;       //flusher waits for uploads
+    std::condition_variable synced;     //worker threads wait for their uploads
+    vector<Connection *> pending;
+};
+
+/*Token bucket of rate limit, tokens are bytes, data sent by one step may put it in debt*/
+struct Bucket{
+    std::mutex mtx;
+    double rate;        //bytes per nanosecond
+    double burst;       //max tokens collected while idle
+    double tokens;
+    uint64_t last;      //time of last refill
+};
+
+/*Connections of event loop waiting for their turn, each turn sends one quantum of download*/
+struct RunQueue{
+    std::deque<Connection *> ready;                 //used their quantum, run in next round
+    std::multimap<uint64_t, Connection *> sleeping; //over rate limit, by time they may continue
+};
+
+Bucket *totalBucket = NULL;     //rate limit of all downloads, NULL when not limited
+long clientRate = 0;            //KiB/s of downloads of one client address, 0 = not limited
+std::mutex clientsMtx;          //guards clientBuckets
+std::map<string, std::weak_ptr<Bucket> > clientBuckets;    //rate limits of addresses with running downloads
+thread_local RunQueue *runQueue = NULL;     //set in threads running event loop
+
+Durability durability = NoSync;
+int dirFd = -1;             //directory of uploaded files, flushed after renames
+SyncQueue syncQueue;
+thread_local SyncLoop *syncLoop = NULL;    //set in threads running event loop in GroupSync mode
+
+#if URING
+/*Ring of event loop, its completions are signalled to epoll by eventfd*/
+struct LoopRing{
+    Uring ring;
+    int eventFd;
+    std::deque<Connection *> waiting;   //connections waiting for free buffers
+};
+
+/*Ring of blocking thread, freed when thread ends*/
+struct ThreadRing{
+    Uring ring;
+    int state;      //0 = not created yet, 1 = ready, -1 = io_uring unavailable
+    ~ThreadRing(){ if(state == 1){ uringFree(&ring); } }
 };
 
+thread_local LoopRing *loopRing = NULL;    //set in threads running event loop
+thread_local bool ringUsable = true;        //false when this thread failed to create its ring
+#endif
+
 /*--------Prototypes---------*/
 int bindOp(unsigned short int port, int socket_desc);
+int createListener(unsigned short int port, int backlog, bool reusePort);
+void reactorThread(int welcoming_socket, int cpu);
 int sendResponse(int socket, ReqAns type, string customMsg);
-void handleClient(int *comm);
-int receiveReq(int socket, char *buffer);
-long fileSizeFunc(string filename);
-string parseRequest(int comm_socket, string toFind, string request);
-string parseFilename(string path);
-void upload(int comm_socket, string request);
-void download(int comm_socket, string request);
+void handleClient(int comm);
+int queueInit(AdmissionQueue *q, size_t capacity);
+bool queuePush(AdmissionQueue *q, int socket, uint64_t accepted);
+int queuePop(AdmissionQueue *q, uint64_t *accepted);
+void workerThread(AdmissionQueue *q);
+int eventLoop(int welcoming_socket);
+Connection *newConnection(int socket);
+void closeConnection(Connection *c);
+void queueResponse(Connection *c, ReqAns type, Phase next, long length = -1, long offset = -1, long size = -1);
+StepRes stepConnection(Connection *c);
+StepRes stepPhase(Connection *c);
+StepRes receiveReq(Connection *c);
+StepRes sendRespStep(Connection *c);
+StepRes uploadStep(Connection *c);
+StepRes spliceRecvStep(Connection *c);
+StepRes recvStep(Connection *c);
+void finishUpload(Connection *c);
+void commitUpload(Connection *c, bool failed);
+StepRes syncStep(Connection *c);
+void flusherThread();
+SyncLoop *createSyncLoop(int epoll_fd);
+void syncCompleted(SyncLoop *sl);
+int openPipe(Connection *c);
+StepRes downloadStep(Connection *c);
+StepRes shapeStep(Connection *c);
+StepRes throttle(Connection *c, uint64_t wait);
+void bucketInit(Bucket *b, long kib);
+uint64_t bucketCharge(Bucket *b, long bytes);
+std::shared_ptr<Bucket> clientBucket(int socket);
+void runQueued(RunQueue *q);
+int runTimeout(RunQueue *q);
+StepRes sendfileStep(Connection *c);
+StepRes spliceStep(Connection *c);
+StepRes copyStep(Connection *c);
+int checksumFile(Connection *c, off_t offset, size_t len);
+StepRes ringStep(Connection *c);
+StepRes ringFailed(Connection *c);
+StepRes memoryStep(Connection *c);
+StepRes deflateStep(Connection *c);
+StepRes inflateStep(Connection *c);
+StepRes receiveBlock(Connection *c, bool *complete);
+StepRes receiveBytes(Connection *c, size_t need, bool *complete);
+StepRes indexStep(Connection *c);
+void findChunks(Connection *c);
+int copyChunk(int src, off_t from, int dst, off_t to, size_t len);
+StepRes chunkStep(Connection *c);
+int signFile(Connection *c, string &signatures);
+StepRes deltaStep(Connection *c);
+void archive(Connection *c, Request *r);
+StepRes manifestStep(Connection *c);
+void startArchive(Connection *c);
+StepRes packStep(Connection *c);
+int packFiles(Connection *c);
+void packPart(Connection *c, const char *data, size_t len);
+void indexChunks(Connection *c, const struct stat &info);
+bool samePlace(const ChunkPlace &p, const struct stat &info);
+std::shared_ptr<Mapping> mapFile(int fd, const struct stat &info);
+void unmapFile(Mapping *m);
+FileCache *createCache(size_t budget);
+std::shared_ptr<const string> cacheGet(const string &name, const struct stat &info);
+void cacheInsert(CacheShard *sh, CacheEntry &entry, size_t budget);
+void cacheRemove(CacheShard *sh, size_t pos);
+bool sameVersion(const CacheEntry &e, const struct stat &info);
+Engine defaultEngine(bool regular);
+StepRes discardStep(Connection *c);
+StepRes nextRequest(Connection *c);
+void consumeRequest(Connection *c, size_t len);
+void handleRequest(Connection *c, Request *r, size_t len);
+size_t textLength(Connection *c);
+size_t frameLength(Connection *c);
+void parseText(const char *req, size_t len, Request *r);
+int parseFrame(const char *req, Request *r);
+bool isAttribute(const char *attr, size_t len, const char *name);
+void driveConnection(Connection *c);
+#if URING
+Uring *threadRing();
+LoopRing *createLoopRing(int epoll_fd);
+void ringCompleted(LoopRing *lr);
+#endif
+void upload(Connection *c, Request *r);
+int openPart(string path);
+int openTemp(Connection *c);
+void dropUpload(Connection *c);
+void download(Connection *c, Request *r);
+uint64_t nowNs();
+Metrics *threadMetrics();
+void countMetric(Counter which, uint64_t n);
+void recordLatency(Latency which, uint64_t start);
+string metricsText();
+int createMetricsListener(unsigned short int port);
+void metricsThread(int listener);
 
 int main(int argc, char *argv[]) {
     int welcoming_socket;
-    unsigned short int port;
+    unsigned short int port = 0;
+    bool p = false;
+    bool events = false;
+    int loops = 0;              //0 = one event loop per core
+    int backlog = SOMAXCONN;
+    int workers = MAX_CLIENTS;
+    int depth = QUEUE_DEPTH;
+    long cacheBudget = CACHE_BUDGET;
+    unsigned short int metricsPort = 0;     //0 = no metrics endpoint
+    long bufferKiB = BUFFER_DEFAULT / 1024;
+    string syncMode = "none";
+    long totalRate = 0;         //0 = downloads are not limited
 
     //check arguments
-    if(strcmp(argv[1],"-h") == 0 || strcmp(argv[1], "--help") == 0){
-        cout << "\nHELP:\n    ./server -p <port_number>\n\n";
+    if(argc > 1 && (strcmp(argv[1],"-h") == 0 || strcmp(argv[1], "--help") == 0)){
+        cout << "\nHELP:\n    ./server -p <port_number> [-e [-w <loops>] | -t <threads> [-q <depth>]] [-b <backlog>] [-c <MiB>] [-m] [-z <level>] [-i] [-M <port>] [-B <KiB>] [-f none|file|group] [-R <KiB/s>] [-r <KiB/s>]\n\n";
+        cout << " -e -> event driven mode, clients are served by epoll loops\n";
+        cout << " -w -> number of event loops, each on its own core (default: number of cores)\n";
+        cout << " -t -> number of worker threads serving clients (default: " << MAX_CLIENTS << ")\n";
+        cout << " -q -> accepted clients waiting for a worker, others are rejected (default: " << QUEUE_DEPTH << ")\n";
+        cout << " -b -> length of queue of pending connections (default: " << SOMAXCONN << ")\n";
+        cout << " -c -> memory for cache of small files, 0 = no cache (default: " << CACHE_BUDGET << ")\n";
+        cout << " -m -> send downloaded files from memory mappings shared by concurrent downloads\n";
+        cout << " -z -> compression level of downloads asking for Encoding:deflate, 1-9 (default: 1)\n";
+        cout << " -i -> transfer data by io_uring\n";
+        cout << " -M -> serve metrics in Prometheus text format on 127.0.0.1:<port>\n";
+        cout << " -B -> size of transfer buffers, " << BUFFER_MIN / 1024 << "-" << BUFFER_MAX / 1024 << " (default: " << BUFFER_DEFAULT / 1024 << ")\n";
+        cout << " -f -> uploads are ACKed when durable: file = each flushed alone, group = flushed together by background thread (default: none)\n";
+        cout << " -R -> limit of all downloads together (default: unlimited)\n";
+        cout << " -r -> limit of downloads of one client address (default: unlimited)\n\n";
         return EXIT_SUCCESS;
     }
 
-    if(argc < 3 || argc > 3 || strcmp(argv[1], "-p")){
+    int option;
+    opterr = 0; // getopt will not print it's error messages
+    while ((option = getopt(argc, argv, "p:ew:t:q:b:c:mz:iM:B:f:R:r:")) != -1) {
+        switch (option) {
+            case 'p':
+                istringstream (optarg) >> port; // check if range?
+                p = true;
+                break;
+            case 'e':
+                events = true;
+                break;
+            case 'w':
+                istringstream (optarg) >> loops;
+                break;
+            case 't':
+                istringstream (optarg) >> workers;
+                break;
+            case 'q':
+                istringstream (optarg) >> depth;
+                break;
+            case 'b':
+                istringstream (optarg) >> backlog;
+                break;
+            case 'c':
+                istringstream (optarg) >> cacheBudget;
+                break;
+            case 'm':
+                mmapMode = true;
+                break;
+            case 'z':
+                istringstream (optarg) >> compressLevel;
+                break;
+            case 'i':
+#if URING
+                uringMode = true;
+#else
+                cerr << "Server was built without io_uring" << endl;
+#endif
+                break;
+            case 'M':
+                istringstream (optarg) >> metricsPort;
+                break;
+            case 'B':
+                istringstream (optarg) >> bufferKiB;
+                break;
+            case 'f':
+                syncMode = optarg;
+                break;
+            case 'R':
+                istringstream (optarg) >> totalRate;
+                break;
+            case 'r':
+                istringstream (optarg) >> clientRate;
+                break;
+            default:
+                cerr << "Wrong arguments" << endl;
+                return EXIT_FAILURE;
+        }
+    }
+    if(!p || optind != argc || loops < 0 || backlog < 1 || workers < 1 || depth < 1 || cacheBudget < 0 || compressLevel < 1 || compressLevel > 9
+       || bufferKiB < BUFFER_MIN / 1024 || bufferKiB > BUFFER_MAX / 1024
+       || (syncMode != "none" && syncMode != "file" && syncMode != "group") || totalRate < 0 || clientRate < 0){
         cerr << "Wrong arguments" << endl;
         return EXIT_FAILURE;
     }
-    istringstream (argv[2]) >> port; // check if range?
 
-    //create socket
-    if((welcoming_socket = socket(PF_INET6, SOCK_STREAM, 0)) == -1){
-        cerr << "Opening socket FAILED" << endl;
+    //client closing connection during transfer must not kill the server
+    signal(SIGPIPE, SIG_IGN);
+
+    bufferInit((size_t) bufferKiB * 1024);
+
+    if(cacheBudget > 0){
+        fileCache = createCache((size_t) cacheBudget << 20);
+    }
+    chunkIndex = new ChunkIndex;
+
+    //renames of uploaded files are made durable by flushing the directory they are stored in
+    durability = syncMode == "file" ? FileSync : syncMode == "group" ? GroupSync : NoSync;
+    if(durability != NoSync && (dirFd = open(".", O_RDONLY | O_DIRECTORY)) == -1){
+        cerr << "Unable to open directory of uploaded files" << endl;
         return EXIT_FAILURE;
     }
-    int no = 0;
-    setsockopt(welcoming_socket, IPPROTO_IPV6, IPV6_V6ONLY, (void *)&no, sizeof(no));
+    if(durability == GroupSync){
+        std::thread(&flusherThread).detach();
+    }
 
-    //bind port, socket
-    if(bindOp(port, welcoming_socket) == EXIT_FAILURE){
+    if(totalRate > 0){
+        totalBucket = new Bucket;
+        bucketInit(totalBucket, totalRate);
+    }
+
+    //metrics are served by own thread, transfers just update counters of their threads
+    if(metricsPort != 0){
+        int listener = createMetricsListener(metricsPort);
+        if(listener == -1){
+            return EXIT_FAILURE;
+        }
+        metricsOn = true;
+        std::thread(&metricsThread, listener).detach();
+    }
+
+    if(events){
+        //number of connections is limited only by number of descriptors
+        struct rlimit limit;
+        if(getrlimit(RLIMIT_NOFILE, &limit) == 0){
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+
+        if(loops == 0){
+            loops = (int) thread::hardware_concurrency();
+            if(loops == 0){ loops = 1; }
+        }
+
+        //every loop has its own listening socket, kernel spreads connections among them
+        vector<int> listeners;
+        for(int i = 0; i < loops; i++){
+            int listener = createListener(port, backlog, true);
+            if(listener == -1){
+                return EXIT_FAILURE;
+            }
+            listeners.push_back(listener);
+        }
+
+        vector<thread> reactors;
+        for(int i = 0; i < loops; i++){
+            reactors.push_back(thread(&reactorThread, listeners[i], i));
+        }
+        for(size_t i = 0; i < reactors.size(); i++){
+            reactors[i].join();
+        }
+        return EXIT_FAILURE;    //loops end only on failure
+    }
+
+    if((welcoming_socket = createListener(port, backlog, false)) == -1){
         return EXIT_FAILURE;
     }
 
-    //listen - makes passive socket
-    if(listen(welcoming_socket, 1) == -1){
-        cerr << "Listen operation FAILED" << endl;
+    //workers are started once, accepting just hands sockets over to them
+    AdmissionQueue queue;
+    if(queueInit(&queue, (size_t) depth) == EXIT_FAILURE){
         return EXIT_FAILURE;
     }
+    for(int i = 0; i < workers; i++){
+        std::thread(&workerThread, &queue).detach();
+    }
 
     //declarations for accept function
     struct sockaddr_in6 client_addr;
@@ -101,17 +703,11 @@ int main(int argc, char *argv[]) {
         if(comm_socket < 0){
             cerr << "ERROR: Bad socket of new connection" << endl;
         }
-        else{   //new thread here
-
-            threadMtx.lock();
-            if (numberOfThreads.size() == MAX_CLIENTS){
-                cerr << "Maximum connections reached" << endl;
-                sendResponse(comm_socket, Overloaded, "");  //inform client about situation
-            }
-            std::thread t1(&handleClient, &comm_socket);
-            numberOfThreads.push(1); // push something, no matter what, important is just the number of items
-            t1.detach();        //makes thread independent, when ends, his memory is freed automatically
-            threadMtx.unlock();
+        else if(!queuePush(&queue, comm_socket, metricsOn ? nowNs() : 0)){
+            cerr << "Maximum connections reached" << endl;
+            countMetric(Rejected, 1);
+            sendResponse(comm_socket, Overloaded, "");  //inform client about situation
+            close(comm_socket);
         }
     }
 
@@ -139,6 +735,47 @@ int bindOp(unsigned short int port, int socket_desc) {
     return EXIT_SUCCESS;
 }
 
+/**
+ * @description - Create listening socket accepting both ipv4 and ipv6 connections
+ * @param unsigned short int port - port on which server will listen
+ * @param int backlog - length of queue of pending connections
+ * @param bool reusePort - allow more sockets to listen on the same port (SO_REUSEPORT)
+ * @return int - listening socket, -1 on failure
+ */
+int createListener(unsigned short int port, int backlog, bool reusePort) {
+    int welcoming_socket;
+
+    //create socket
+    if((welcoming_socket = socket(PF_INET6, SOCK_STREAM, 0)) == -1){
+        cerr << "Opening socket FAILED" << endl;
+        return -1;
+    }
+    int no = 0;
+    int yes = 1;
+    setsockopt(welcoming_socket, IPPROTO_IPV6, IPV6_V6ONLY, (void *)&no, sizeof(no));
+    setsockopt(welcoming_socket, SOL_SOCKET, SO_REUSEADDR, (void *)&yes, sizeof(yes));
+    tuneSocket(welcoming_socket);   //accepted sockets inherit buffer sizes
+    if(reusePort && setsockopt(welcoming_socket, SOL_SOCKET, SO_REUSEPORT, (void *)&yes, sizeof(yes)) == -1){
+        cerr << "Setting SO_REUSEPORT FAILED" << endl;
+        close(welcoming_socket);
+        return -1;
+    }
+
+    //bind port, socket
+    if(bindOp(port, welcoming_socket) == EXIT_FAILURE){
+        close(welcoming_socket);
+        return -1;
+    }
+
+    //listen - makes passive socket
+    if(listen(welcoming_socket, backlog) == -1){
+        cerr << "Listen operation FAILED" << endl;
+        close(welcoming_socket);
+        return -1;
+    }
+    return welcoming_socket;
+}
+
 /**
  * @description - Send response to the client, f.e.: information about success of operation
  * @param int socket - opened socket for communication with specific client
@@ -179,255 +816,3390 @@ int sendResponse(int socket, ReqAns type, string customMsg) {
 }
 
 /**
- * @description - According to client's request decide which operation to handle
- * @param int * comm - pointer to opened socket to client
+ * @description - Serve one client by worker thread, socket is blocking so every step makes progress
+ * @param int comm - opened socket to client
  * @return void
  */
-void handleClient(int *comm) {
+void handleClient(int comm) {
 
-    int comm_socket = *comm;
-    char buffer[MAX_BUFF_SIZE]; //load request here
+    Connection *c = newConnection(comm);
 
-    int ReqType = 0;
-    if((ReqType = receiveReq(comm_socket, buffer)) == -1){
-        return;
-    }
+    while(stepConnection(c) != Done);
 
-    string str(buffer);
+    closeConnection(c);
+}
 
-    switch (ReqType){
-        case Up:
-            upload(comm_socket, str);
-            break;
-        case Down:
-            download(comm_socket, str);
-            break;
-        default:
-            cerr << "UNKNOWN request received" << endl;
-            sendResponse(comm_socket, Unknown, "");  //inform client that unrecognized request was received
+/**
+ * @description - Allocate admission queue, slot i is free for push at position i
+ * @param AdmissionQueue *q - queue to be initialized
+ * @param size_t capacity - maximum number of queued sockets
+ * @return int - success = 0, failure = 1
+ */
+int queueInit(AdmissionQueue *q, size_t capacity) {
+
+    q->slots = new QueueSlot[capacity];
+    q->capacity = capacity;
+    for(size_t i = 0; i < capacity; i++){
+        q->slots[i].seq.store(i, std::memory_order_relaxed);
     }
+    q->head.store(0, std::memory_order_relaxed);
+    q->tail.store(0, std::memory_order_relaxed);
 
-    threadMtx.lock();
-    numberOfThreads.pop();  //pop one item
-    threadMtx.unlock();
-    close(comm_socket);
+    if(sem_init(&q->items, 0, 0) == -1){
+        cerr << "ERROR: Unable to create admission queue" << endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
 
 /**
- * @description - Receive and parse request, send response back if wrong request received
- * @param int socket - opened socket to the client
- * @param char *buffer - pointer to buffer where client's request is stored
- * @return int - ReqAns number when success otherwise -1
+ * @description - Queue socket for workers without locking
+ * @param AdmissionQueue *q - admission queue
+ * @param int socket - accepted socket
+ * @param uint64_t accepted - time of accept, 0 when metrics are off
+ * @return bool - false when queue is full
  */
-int receiveReq(int socket, char *buffer) {
-    memset(buffer, 0, MAX_BUFF_SIZE);
-    bool entireMsg = false;
-    int received = 0;
-    int total = 0;
-
-    while(true){
-
-        received =(int) recv(socket, buffer + total, (size_t)(MAX_BUFF_SIZE - total), 0);
+bool queuePush(AdmissionQueue *q, int socket, uint64_t accepted) {
 
-        string str(buffer);
-        if(str.find("\n\n") != string::npos){
-            entireMsg = true;
-            break;
+    size_t pos = q->head.load(std::memory_order_relaxed);
+    while(1){
+        QueueSlot *slot = &q->slots[pos % q->capacity];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        if(seq == pos){     //slot is free, claim it
+            if(q->head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                slot->socket = socket;
+                slot->accepted = accepted;
+                slot->seq.store(pos + 1, std::memory_order_release);
+                sem_post(&q->items);
+                return true;
+            }
         }
-        if (received <= 0){
-            break;
+        else if(seq < pos){ //slot still holds socket from previous round
+            return false;
         }
-        total += received;
-
-        if(total >= MAX_BUFF_SIZE){ // too long request
-            sendResponse(socket, TooLong, "");
-            return -1;
+        else{               //other producer was faster
+            pos = q->head.load(std::memory_order_relaxed);
         }
     }
-    if(!entireMsg){
-        sendResponse(socket, NACK, "");
-        return -1;
-    }
-
-    return buffer[0] - '0';       //return reqAns type
 }
 
 /**
- * @description - Find out size of file
- * @param string filename - name of file
- * @return long - size of file in bytes
+ * @description - Take socket from queue, wait while it is empty
+ * @param AdmissionQueue *q - admission queue
+ * @param uint64_t *accepted - time of accept, 0 when metrics are off
+ * @return int - accepted socket
  */
-long fileSizeFunc(string filename) {
+int queuePop(AdmissionQueue *q, uint64_t *accepted) {
 
-    ifstream file;
-    file.open(filename, ios::binary);
-    if(!file){
-        return -1;      //but file should exists, it's checked in other context
+    while(sem_wait(&q->items) == -1);   //interrupted by signal
+
+    //semaphore guarantees a filled slot, only its position is contended
+    size_t pos = q->tail.load(std::memory_order_relaxed);
+    while(1){
+        QueueSlot *slot = &q->slots[pos % q->capacity];
+        size_t seq = slot->seq.load(std::memory_order_acquire);
+        if(seq == pos + 1){
+            if(q->tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                int socket = slot->socket;
+                *accepted = slot->accepted;
+                slot->seq.store(pos + q->capacity, std::memory_order_release);
+                return socket;
+            }
+        }
+        else{   //other consumer took it or producer has not published it yet
+            pos = q->tail.load(std::memory_order_relaxed);
+        }
     }
-    file.seekg(0, ios::end);
-    streamoff fileSize = file.tellg();
-    file.close();
-    return fileSize;
 }
 
 /**
- * @description - Get filename or length of file from request
- * @param int comm_socket - opened socket to the client
- * @param string toFind - the attribute to find for in request and obtain his value
- * @param string request - request to be searched for attribute
- * @return string - the value of attribute f.e.: filename, length of file
+ * @description - Serve queued clients one after another
+ * @param AdmissionQueue *q - admission queue
+ * @return void
  */
-string parseRequest(int comm_socket, string toFind, string request) {
+void workerThread(AdmissionQueue *q) {
 
-    size_t index = request.find(toFind);
-    if(index == string::npos){
-        sendResponse(comm_socket, Incomplete, "");
-        return "";
+    while(1){
+        uint64_t accepted;
+        int socket = queuePop(q, &accepted);
+        recordLatency(AdmissionWait, accepted);
+        handleClient(socket);
     }
-    size_t end = (request.substr(index)).find("\n");
-    return request.substr(index + toFind.length(), end - toFind.length());
 }
+
 /**
- * @description - Get filename if path was given
- * @param string path - file path
- * @return string - return just name of file
+ * @description - Pin thread to one of allowed cpus and run event loop on its listening socket
+ * @param int welcoming_socket - listening socket of this loop
+ * @param int cpu - index of loop, loops are spread over allowed cpus
+ * @return void
  */
-string parseFilename(string path){
+void reactorThread(int welcoming_socket, int cpu) {
 
-    if(path.find_last_of("\\/") != string::npos){
-        path = path.substr(path.substr(0, path.find_last_of("\\/")).length()+1);
+    cpu_set_t allowed;
+    if(sched_getaffinity(0, sizeof(allowed), &allowed) == 0 && CPU_COUNT(&allowed) > 0){
+        cpu %= CPU_COUNT(&allowed);
+        for(int i = 0; i < CPU_SETSIZE; i++){
+            if(CPU_ISSET(i, &allowed) && cpu-- == 0){
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(i, &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                break;
+            }
+        }
     }
 
-    return path;
+    eventLoop(welcoming_socket);
+    cerr << "Event loop FAILED" << endl;
 }
 
 /**
- * @description - Handle upload (from client's side) operation
- * @param int comm_socket - opened socket to the client
- * @param string request - client's request
- * @return void
+ * @description - Serve all clients from one thread, edge triggered epoll over non-blocking sockets
+ * @param int welcoming_socket - listening socket
+ * @return int - failure = 1, on success never returns
  */
-void upload(int comm_socket, string request) {
+int eventLoop(int welcoming_socket) {
 
-    int bytes = 0;
-    int received = 0;
-    char buffer[MAX_BUFF_SIZE];
-    long dataLength;
-    string filename;
-    ofstream file; //has automatically ios::out flag
-
-    //get filename
-    if((filename = parseRequest(comm_socket, "File:", request)) == ""){
-        return;
+    int epoll_fd = epoll_create1(0);
+    if(epoll_fd == -1){
+        cerr << "Creating epoll FAILED" << endl;
+        return EXIT_FAILURE;
     }
-    filename = parseFilename(filename);
 
-    //get length of data
-    string temp;
-    if((temp = parseRequest(comm_socket, "Length:", request)) == ""){
-        return;
+    fcntl(welcoming_socket, F_SETFL, fcntl(welcoming_socket, F_GETFL) | O_NONBLOCK);
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = NULL;     //NULL stands for the welcoming socket
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, welcoming_socket, &ev) == -1){
+        cerr << "Adding socket to epoll FAILED" << endl;
+        return EXIT_FAILURE;
     }
-    istringstream ss(temp);
-    ss >> dataLength;
 
-    //open file
-    file.open(filename, ios::binary);
-    if( !file.is_open() ){
-        cerr << "Unable to create a file" << endl;
-        sendResponse(comm_socket, NACK, "");
-        return;
+    struct epoll_event events[MAX_EVENTS];
+
+#if URING
+    //completions of transfers are watched together with sockets
+    if(uringMode && (loopRing = createLoopRing(epoll_fd)) == NULL){
+        cerr << "io_uring is not available, using other transfer engines" << endl;
+        ringUsable = false;
+    }
+#endif
+
+    //uploads made durable by flusher are handed back like completions of ring
+    if(durability == GroupSync && (syncLoop = createSyncLoop(epoll_fd)) == NULL){
+        cerr << "Unable to watch flushed uploads, event loop will wait for them" << endl;
     }
 
-    //inform client,that upload request received and handled successfully
-    sendResponse(comm_socket, ACK, "");
+    //big downloads take turns, waiting for events does not block queued ones
+    RunQueue queue;
+    runQueue = &queue;
 
-    //receive and write data out
-    while(bytes != dataLength) {
+    while(1) {
 
-        memset(buffer, 0, sizeof(buffer));
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, runTimeout(&queue));
+        bool syncReady = false;
+#if URING
+        bool ringReady = false;
+#endif
+        if(ready == -1){
+            if(errno == EINTR){ continue; }
+            cerr << "Waiting for events FAILED" << endl;
+            return EXIT_FAILURE;
+        }
 
-        received = (int) recv(comm_socket, buffer, MAX_BUFF_SIZE, 0);
+        for(int i = 0; i < ready; i++){
 
-        if (received <= 0) {
-            break;
+            if(events[i].data.ptr == NULL){ //accept all pending connections
+                while(1){
+                    int comm_socket = accept4(welcoming_socket, NULL, NULL, SOCK_NONBLOCK);
+                    if(comm_socket < 0){
+                        if(errno != EAGAIN && errno != EWOULDBLOCK){
+                            cerr << "ERROR: Bad socket of new connection" << endl;
+                        }
+                        break;
+                    }
+                    ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                    ev.data.ptr = newConnection(comm_socket);
+                    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, comm_socket, &ev) == -1){
+                        cerr << "Adding socket to epoll FAILED" << endl;
+                        closeConnection((Connection *) ev.data.ptr);
+                    }
+                }
+                continue;
+            }
+
+#if URING
+            if(loopRing != NULL && events[i].data.ptr == loopRing){
+                ringReady = true;   //handled after sockets, it may close connections with pending events
+                continue;
+            }
+#endif
+
+            if(syncLoop != NULL && events[i].data.ptr == syncLoop){
+                syncReady = true;   //handled after sockets like ring
+                continue;
+            }
+
+            driveConnection((Connection *) events[i].data.ptr);
         }
-        file.write(buffer, received);
-        bytes += received;
-    }
 
-    file.close(); //check if successful?
-    if(bytes == dataLength){ sendResponse(comm_socket, ACK, ""); }
-    else{ sendResponse(comm_socket, NACK, ""); } //delete created file??
+        if(syncReady){
+            syncCompleted(syncLoop);
+        }
+
+#if URING
+        if(ringReady){
+            ringCompleted(loopRing);
+        }
+#endif
+
+        runQueued(&queue);
+
+#if URING
+        //batches started during this iteration are submitted by one syscall
+        if(loopRing != NULL && loopRing->ring.toSubmit > 0 && uringSubmit(&loopRing->ring, 0) != 0){
+            cerr << "Submitting to io_uring FAILED" << endl;
+        }
+#endif
+    }
 }
 
 /**
- * @description - Handle download (from client's side) operation
- * @param int comm_socket - opened socket to the client
- * @param string request - client's request
+ * @description - Run state machine of non-blocking connection until it would block, close it when done
+ * @param Connection *c - connection to the client
  * @return void
  */
-void download(int comm_socket, string request) {
+void driveConnection(Connection *c) {
 
-    string filename;
-    int upload_file;
-    long dataLength;
-
-    //get filename
-    if((filename = parseRequest(comm_socket, "File:", request)) == ""){
+    //queued connection tries its socket in its turn, so ignored event is not lost
+    if(c->queued){
         return;
     }
-    filename = parseFilename(filename);
+    c->deficit = (c->deficit < 0 ? c->deficit : 0) + SCHED_QUANTUM;  //debt of previous turn is paid first
 
-    //check if exists
-    upload_file = open(filename.c_str(), O_RDONLY); //flock ???
-    if(upload_file == -1){
-        sendResponse(comm_socket, NotFound, "");    //inform client
-        return;
+    //edge triggered - run state machine until socket would block or quantum is used
+    StepRes res;
+    while((res = stepConnection(c)) == Progress);
+
+    if(res == Done){
+        closeConnection(c);     //closing descriptor removes it from epoll
+    }
+}
+
+#if URING
+/**
+ * @description - Create ring of event loop and watch its completions by epoll
+ * @param int epoll_fd - epoll of event loop
+ * @return LoopRing * - ring, NULL when io_uring is not available
+ */
+LoopRing *createLoopRing(int epoll_fd) {
+
+    LoopRing *lr = new LoopRing;
+    if(uringInit(&lr->ring, URING_ENTRIES, URING_LOOP_BUFFERS, URING_BUFF_SIZE) != 0){
+        delete lr;
+        return NULL;
+    }
+    if((lr->eventFd = uringEventFd(&lr->ring)) == -1){
+        uringFree(&lr->ring);
+        delete lr;
+        return NULL;
     }
-    //Send ACK and length of file
-    dataLength = fileSizeFunc(filename);
-    ostringstream strData;  //because of freeBsd otherwise to_string(dataLength) would be enough
-    strData << dataLength;
-    sendResponse(comm_socket, ACK, "\nLength:"+strData.str());
 
-    /* if(sendfile(comm_socket, upload_file, 0, (size_t)dataLength) == -1){      //on FreeBSD can't be used
-         cerr << "Sendfile function FAILED" << endl;
-         return;
-     }*/
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = lr;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, lr->eventFd, &ev) == -1){
+        close(lr->eventFd);
+        uringFree(&lr->ring);
+        delete lr;
+        return NULL;
+    }
+    return lr;
+}
 
-    char buffer[MAX_BUFF_SIZE];
-    ssize_t bytes_read = 0;
-    ssize_t bytes_written = 0;
-    ssize_t total = 0;
+/**
+ * @description - Process completed batches and continue their connections, then the ones waiting for buffers
+ * @param LoopRing *lr - ring of event loop
+ * @return void
+ */
+void ringCompleted(LoopRing *lr) {
 
-    while (1) {
+    uint64_t count;
+    while(read(lr->eventFd, &count, sizeof(count)) > 0);    //reset eventfd
 
-        memset(buffer, 0, sizeof(buffer));
+    vector<UringTransfer *> finished;
+    uringReap(&lr->ring, &finished);
 
-        bytes_read = read(upload_file, buffer, sizeof(buffer));
+    for(size_t i = 0; i < finished.size(); i++){
+        Connection *c = (Connection *) finished[i]->user;
+        uringCollect(&lr->ring, finished[i]);
+        c->transferred = c->dataLength - finished[i]->length + finished[i]->done;
+        driveConnection(c);
+    }
 
-        if (bytes_read == 0) { break; } //whole file is read
+    //buffers were returned, give them to waiting connections
+    size_t waiting = lr->waiting.size();
+    while(waiting-- > 0 && !lr->waiting.empty() && !lr->ring.freeBufs.empty()){
+        Connection *c = lr->waiting.front();
+        lr->waiting.pop_front();
+        c->ringWaiting = false;
+        driveConnection(c);
+    }
+}
 
-        if (bytes_read < 0) {
-            cerr << "Reading from file FAILED" << endl;
-            return;
-        }
+/**
+ * @description - Get ring of current blocking thread, create it at first use
+ * @return Uring * - ring, NULL when io_uring is not available
+ */
+Uring *threadRing() {
 
-        char *buffPtr = buffer;
-        while (bytes_read > 0) {
-            bytes_written = write(comm_socket, buffPtr, (size_t) bytes_read);
-            if (bytes_written <= 0) {
-                cerr << "Sending bytes FAILED" << endl;
-                return;
-            }
-            bytes_read -= bytes_written;
-            buffPtr += bytes_written;
-            total += bytes_written;
+    static thread_local ThreadRing tr = ThreadRing();
+
+    if(tr.state == 0){
+        tr.state = uringInit(&tr.ring, 4 * URING_SLOTS, URING_SLOTS, URING_BUFF_SIZE) == 0 ? 1 : -1;
+        if(tr.state == -1){
+            cerr << "io_uring is not available, using other transfer engines" << endl;
+            ringUsable = false;
         }
+    }
+    return tr.state == 1 ? &tr.ring : NULL;
+}
+#endif
+
+/**
+ * @description - Allocate state for newly accepted connection
+ * @param int socket - opened socket to the client
+ * @return Connection * - state of connection waiting for request
+ */
+Connection *newConnection(int socket) {
+
+    //response and data are corked by MSG_MORE, Nagle would just delay end of each exchange
+    int yes = 1;
+    setsockopt(socket, IPPROTO_TCP, TCP_NODELAY, (void *)&yes, sizeof(yes));
+
+    Connection *c = new Connection;
+    c->socket = socket;
+    c->phase = ReadReq;
+    c->next = Finished;
+    c->reqLen = 0;
+    c->scanned = 0;
+    c->keepAlive = false;
+    c->op = Unknown;
+    c->reqStart = 0;
+    c->firstByte = false;
+    c->counted = 0;
+    c->pipelined = false;
+    c->binary = false;
+    c->upgrade = false;
+    c->encoded = false;
+    c->blockLen = c->blockOff = c->blockOrig = 0;
+    c->rawBlocks = 0;
+    c->checksum = false;
+    c->crc = 0;
+    c->dedup = false;
+    c->listLen = 0;
+    c->chunkNext = 0;
+    c->basis = -1;
+    c->basisBlock = 0;
+    c->basisSize = 0;
+    c->nameNext = 0;
+    c->files = 0;
+    c->ended = false;
+    c->iovNext = 0;
+    c->respSent = 0;
+    c->file = -1;
+    c->resumable = false;
+    c->cached.reset();
+    c->mapping.reset();
+    c->memory = NULL;
+    c->dataLength = 0;
+    c->transferred = 0;
+    c->engine = Copy;
+    c->fileOff = 0;
+    c->pipe[0] = c->pipe[1] = -1;
+    c->pipeSize = 0;
+    c->pipeLen = 0;
+#if URING
+    c->ring.pending = 0;
+    c->ringWaiting = false;
+#endif
+    c->buffer = NULL;
+    c->buffLen = 0;
+    c->buffOff = 0;
+    c->loop = NULL;
+    c->synced = false;
+    c->syncFailed = false;
+    c->syncStart = 0;
+    c->queued = false;
+    c->deficit = SCHED_QUANTUM;
+    c->shaped = 0;
+    if(metricsOn){
+        countMetric(Accepted, 1);
+        activeConnections.fetch_add(1, std::memory_order_relaxed);
+    }
+    return c;
+}
+
+/**
+ * @description - Close socket and file of connection and free its state
+ * @param Connection *c - connection to be closed
+ * @return void
+ */
+void closeConnection(Connection *c) {
+
+    if(c->file != -1){
+        close(c->file);
+    }
+    if(c->basis != -1){
+        close(c->basis);
+    }
+    if(c->pipe[0] != -1){
+        close(c->pipe[0]);
+        close(c->pipe[1]);
+    }
+    bufferRelease(c->buffer);
+    close(c->socket);
+    delete c;
+    if(metricsOn){
+        activeConnections.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * @description - Open pipe used by splice and make it as big as possible
+ * @param Connection *c - connection to the client
+ * @return int - success = 0, failure = 1
+ */
+int openPipe(Connection *c) {
 
+    if(c->pipe[0] != -1){
+        return EXIT_SUCCESS;
+    }
+    if(pipe2(c->pipe, O_NONBLOCK) == -1){
+        c->pipe[0] = c->pipe[1] = -1;
+        return EXIT_FAILURE;
     }
-    if(total != dataLength){ cerr << "Not entire data sent: " << total << " - " << dataLength << endl; }
+    fcntl(c->pipe[1], F_SETPIPE_SZ, PIPE_SIZE);    //bigger pipe = less syscalls, ignore failure
+    int size = fcntl(c->pipe[1], F_GETPIPE_SZ);
+    c->pipeSize = size > 0 ? (size_t) size : 4096;
+    c->pipeLen = 0;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Prepare response for sending in format of request, it's sent by state machine in SendResp phase
+ * @param Connection *c - connection to the client
+ * @param ReqAns type - enum, type/result of operation
+ * @param Phase next - phase entered after whole response is sent
+ * @param long length - Length of sent data, -1 when not sent
+ * @param long offset - Offset of resumed upload, -1 when not sent
+ * @param long size - Size of whole file, -1 when not sent
+ * @return void
+ */
+void queueResponse(Connection *c, ReqAns type, Phase next, long length, long offset, long size) {
 
-    close(upload_file);
+    if(next == Closing){
+        c->keepAlive = false;   //framing of the stream is lost, connection can't continue
+    }
+    bool digest = c->checksum && type == ACK && next == Finished;  //final ACK of transfer carries checksum
+    if(metricsOn){
+        Metrics *m = threadMetrics();
+        m->responses[type].store(m->responses[type].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
 
-}
\ No newline at end of file
+    if(c->binary){  //fixed header, nothing to format
+        Frame f;
+        f.version = FRAME_VERSION;
+        f.opcode = (uint8_t) type;
+        f.flags = (uint8_t)((c->keepAlive ? FRAME_KEEPALIVE : 0) | (offset >= 0 ? FRAME_OFFSET : 0)
+                            | (size >= 0 ? FRAME_SIZE : 0) | (c->encoded ? FRAME_DEFLATE : 0)
+                            | (c->checksum ? FRAME_CHECKSUM : 0));
+        f.nameLen = 0;
+        f.length = length >= 0 ? (uint64_t) length : 0;
+        f.offset = offset >= 0 ? (uint64_t) offset : 0;
+        f.size = digest ? c->crc : size >= 0 ? (uint64_t) size : 0;
+        c->response.resize(FRAME_HEADER_SIZE);
+        frameEncode(&c->response[0], &f);
+    }
+    else{
+        ostringstream msg;
+        msg << type;
+        if(length >= 0){
+            msg << "\nLength:" << length;
+        }
+        if(offset >= 0){
+            msg << "\nOffset:" << offset;
+        }
+        if(size >= 0){
+            msg << "\nSize:" << size;
+        }
+        if(c->keepAlive){
+            msg << "\nConnection:keep-alive";  //client knows connection stays opened
+        }
+        if(c->upgrade){
+            msg << "\nBinary:1";   //client may send next requests in binary frames
+        }
+        if(c->encoded){
+            msg << "\nEncoding:deflate";   //data are sent / expected as encoded blocks
+        }
+        if(c->checksum){
+            msg << "\nChecksum:crc32c";
+        }
+        if(digest){
+            msg << "\nCrc32c:" << c->crc;
+        }
+        if(c->dedup && next == Index){
+            msg << "\nChunks:" << c->listLen / CHUNK_RECORD;  //client sends chunk list instead of data
+        }
+        if(c->basis != -1 && next == Upload){
+            msg << "\nDelta:" << c->basisBlock;      //signatures follow, client sends instructions instead of data
+        }
+        msg << "\n\n";
+        c->response = msg.str();
+        c->response.push_back('\0');   //terminating zero is part of the message
+    }
+    c->respSent = 0;
+    c->phase = SendResp;
+    c->next = next;
+}
+
+/**
+ * @description - Do one step of connection's work according to its phase
+ * @param Connection *c - connection to the client
+ * @return StepRes - Progress if step can be repeated, Blocked if socket would block, Done at the end
+ */
+StepRes stepConnection(Connection *c) {
+
+    if(!metricsOn){
+        return stepPhase(c);
+    }
+    bool responding = c->phase == SendResp;
+    StepRes res = stepPhase(c);
+
+    //bytes are counted while transfer goes, not just at its end
+    if(c->transferred > c->counted){
+        countMetric(c->op == Up ? BytesIn : BytesOut, (uint64_t)(c->transferred - c->counted));
+        c->counted = c->transferred;
+    }
+    if(responding && c->firstByte && (c->respSent > 0 || c->phase != SendResp)){
+        recordLatency(FirstByte, c->reqStart);
+        c->firstByte = false;
+    }
+    return res;
+}
+
+/**
+ * @description - Do one step of connection's work according to its phase
+ * @param Connection *c - connection to the client
+ * @return StepRes - Progress if step can be repeated, Blocked if socket would block, Done at the end
+ */
+StepRes stepPhase(Connection *c) {
+
+    switch (c->phase){
+        case ReadReq:
+            return receiveReq(c);
+        case SendResp:
+            return sendRespStep(c);
+        case Upload:
+            return uploadStep(c);
+        case Index:
+            return indexStep(c);
+        case Manifest:
+            return manifestStep(c);
+        case Pack:
+            return packStep(c);
+        case Download:
+            return shapeStep(c);
+        case Discard:
+            return discardStep(c);
+        case Syncing:
+            return syncStep(c);
+        case Finished:
+            return nextRequest(c);
+        default:
+            return Done;
+    }
+}
+
+/**
+ * @description - Receive part of request, handle it when whole request is received
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes receiveReq(Connection *c) {
+
+    //terminating zero of previous request may come separately
+    size_t zeros = 0;
+    while(zeros < c->reqLen && c->request[zeros] == '\0'){ zeros++; }
+    consumeRequest(c, zeros);
+
+    //buffer may already hold next pipelined request, binary one starts with magic byte
+    bool binary = c->reqLen > 0 && (unsigned char) c->request[0] == FRAME_MAGIC;
+    if(c->reqLen > 0){
+        c->binary = binary;     //response of failed request is sent in format of request
+    }
+    size_t len = binary ? frameLength(c) : textLength(c);
+
+    if(len > MAX_BUFF_SIZE - 1 || (len == 0 && c->reqLen >= MAX_BUFF_SIZE - 1)){ // too long request
+        queueResponse(c, TooLong, Closing);
+        return Progress;
+    }
+
+    if(len == 0 || len > c->reqLen){
+
+        ssize_t received = recv(c->socket, c->request + c->reqLen, MAX_BUFF_SIZE - 1 - c->reqLen, 0);
+
+        if(received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return Blocked;
+        }
+        if(received < 0 && errno == EINTR){
+            return Progress;
+        }
+        if(received <= 0){
+            if(c->keepAlive && c->reqLen == 0){ //client closed persistent connection between requests
+                return Done;
+            }
+            queueResponse(c, NACK, Closing);    //request was not finished
+            return Progress;
+        }
+        c->reqLen += received;
+        return Progress;
+    }
+
+    Request r;
+    if(binary && parseFrame(c->request, &r) == EXIT_FAILURE){
+        queueResponse(c, Unknown, Closing);     //layout of unknown version may differ
+        return Progress;
+    }
+    c->reqStart = metricsOn ? nowNs() : 0;
+    c->firstByte = metricsOn;
+    if(!binary){
+        parseText(c->request, len, &r);
+    }
+    handleRequest(c, &r, len);
+    recordLatency(Handling, c->reqStart);
+    return Progress;
+}
+
+/**
+ * @description - Find end of text request, just newly received part of buffer is searched
+ * @param Connection *c - connection to the client
+ * @return size_t - length of request including two newlines, 0 when it is not complete
+ */
+size_t textLength(Connection *c) {
+
+    char *end = (char *) memmem(c->request + c->scanned, c->reqLen - c->scanned, "\n\n", 2);
+    if(end == NULL){
+        //search just in newly received data, one '\n' may be from previous part
+        c->scanned = c->reqLen > 0 ? c->reqLen - 1 : 0;
+        return 0;
+    }
+    return (size_t)(end - c->request) + 2;
+}
+
+/**
+ * @description - Get length of binary request from its header
+ * @param Connection *c - connection to the client
+ * @return size_t - length of header and file name, 0 when header is not complete
+ */
+size_t frameLength(Connection *c) {
+
+    if(c->reqLen < FRAME_HEADER_SIZE){
+        return 0;
+    }
+    Frame f;
+    frameDecode(c->request, &f);
+    return FRAME_HEADER_SIZE + f.nameLen;
+}
+
+/**
+ * @description - Remove handled bytes from the beginning of request buffer
+ * @param Connection *c - connection to the client
+ * @param size_t len - bytes to be removed
+ * @return void
+ */
+void consumeRequest(Connection *c, size_t len) {
+
+    if(len == 0){
+        return;
+    }
+    memmove(c->request, c->request + len, c->reqLen - len);
+    c->reqLen -= len;
+    c->scanned = 0;
+}
+
+/**
+ * @description - Start serving next request of persistent connection, other connections are finished
+ * @param Connection *c - connection with served request
+ * @return StepRes - result of step
+ */
+StepRes nextRequest(Connection *c) {
+
+    if(c->reqStart != 0 && (c->op == Up || c->op == Down || c->op == Archive)){
+        recordLatency(c->op == Up ? UploadTime : DownloadTime, c->reqStart);
+        c->reqStart = 0;
+    }
+    if(!c->keepAlive){
+        return Done;
+    }
+    if(c->file != -1){
+        close(c->file);
+        c->file = -1;
+    }
+    if(c->basis != -1){
+        close(c->basis);
+        c->basis = -1;
+    }
+    bufferRelease(c->buffer);     //idle connection keeps no buffer
+    c->buffer = NULL;
+    c->cached.reset();
+    c->mapping.reset();
+    c->memory = NULL;
+    c->blockLen = c->blockOff = c->blockOrig = 0;
+    c->rawBlocks = 0;
+    c->dedup = false;
+    c->listLen = 0;
+    c->chunks.clear();
+    c->missing.clear();
+    vector<string>().swap(c->names);    //list of big archive is not kept
+    c->iov.clear();
+    c->pinned.clear();
+    c->dataLength = 0;
+    c->transferred = 0;
+    c->phase = ReadReq;
+    return Progress;
+}
+
+/**
+ * @description - Send part of queued response
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes sendRespStep(Connection *c) {
+
+    if(c->next == Download && (c->engine == Cached || c->engine == Mapped)){
+        return memoryStep(c);   //response and data go by one writev
+    }
+
+    //response is sent in one segment with the beginning of downloaded data
+    int flags = c->next == Download && c->dataLength > 0 ? MSG_MORE : 0;
+    ssize_t bytes = send(c->socket, c->response.data() + c->respSent, c->response.length() - c->respSent, flags);
+
+    if(bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return Blocked;
+    }
+    if(bytes < 0 && errno == EINTR){
+        return Progress;
+    }
+    if(bytes <= 0){
+        cerr << "ERROR: Sending response FAILED" << endl;
+        return Done;
+    }
+    c->respSent += bytes;
+
+    if(c->respSent == c->response.length()){
+        c->phase = c->next;
+    }
+    return Progress;
+}
+
+/**
+ * @description - According to client's request decide which operation to handle
+ * @param Connection *c - connection with whole request received
+ * @param Request *r - parsed request, it's removed from buffer here
+ * @param size_t len - length of request in buffer
+ * @return void
+ */
+void handleRequest(Connection *c, Request *r, size_t len) {
+
+    //every request decides whether connection stays opened after it
+    c->keepAlive = (r->flags & FRAME_KEEPALIVE) != 0;
+    c->pipelined = c->keepAlive && (r->flags & FRAME_PIPELINE) != 0;
+    c->upgrade = r->upgrade;
+    c->encoded = (r->flags & FRAME_DEFLATE) != 0;
+    c->checksum = (r->flags & FRAME_CHECKSUM) != 0;
+    c->crc = 0;
+
+    //file name without path is copied out before request is removed from buffer
+    if(r->name != NULL && (r->nameLen == 0 || memchr(r->name, '\0', r->nameLen) != NULL)){
+        r->name = NULL;
+    }
+    if(r->name != NULL){
+        const char *base = r->name + r->nameLen;
+        while(base > r->name && base[-1] != '/' && base[-1] != '\\'){
+            base--;
+        }
+        c->path.assign(base, (size_t)(r->name + r->nameLen - base));
+    }
+
+    //bytes behind the request are data of upload or next requests
+    if(!c->binary && len < c->reqLen && c->request[len] == '\0'){ len++; }
+    consumeRequest(c, len);
+
+    c->op = r->type;
+    c->counted = 0;
+    c->shaped = 0;
+    switch (r->type){
+        case Up:
+            countMetric(Uploads, 1);
+            upload(c, r);
+            break;
+        case Down:
+            countMetric(Downloads, 1);
+            download(c, r);
+            break;
+        case Archive:
+            countMetric(Downloads, 1);
+            archive(c, r);
+            break;
+        default:
+            cerr << "UNKNOWN request received" << endl;
+            queueResponse(c, Unknown, Finished);  //inform client that unrecognized request was received
+    }
+}
+
+/**
+ * @description - Parse text request in place, its attributes are lines Name:value
+ * @param const char *req - request ending by two newlines
+ * @param size_t len - length of request
+ * @param Request *r - parsed request, attributes with empty value are missing
+ * @return void
+ */
+void parseText(const char *req, size_t len, Request *r) {
+
+    r->type = req[0] >= '0' && req[0] <= '9' ? req[0] - '0' : Unknown;
+    r->name = NULL;
+    r->nameLen = 0;
+    r->length = -1;
+    r->offset = 0;
+    r->range = 0;
+    r->flags = 0;
+    r->upgrade = false;
+    r->chunks = -1;
+    r->delta = false;
+
+    //every line ends by newline, so numbers can be parsed directly in buffer
+    const char *end = req + len;
+    const char *line = (const char *) memchr(req, '\n', len) + 1;
+    while(line < end){
+        const char *eol = (const char *) memchr(line, '\n', (size_t)(end - line));
+        const char *colon = (const char *) memchr(line, ':', (size_t)(eol - line));
+        if(colon != NULL && colon + 1 < eol){
+            const char *value = colon + 1;
+            size_t attrLen = (size_t)(colon - line);
+            size_t valueLen = (size_t)(eol - value);
+
+            if(isAttribute(line, attrLen, "File")){
+                r->name = value;
+                r->nameLen = valueLen;
+            }
+            else if(isAttribute(line, attrLen, "Length")){
+                r->length = strtol(value, NULL, 10);
+            }
+            else if(isAttribute(line, attrLen, "Offset")){
+                r->offset = strtol(value, NULL, 10);
+                r->flags |= FRAME_OFFSET;
+            }
+            else if(isAttribute(line, attrLen, "Range")){
+                r->range = strtol(value, NULL, 10);
+                r->flags |= FRAME_RANGE;
+            }
+            else if(isAttribute(line, attrLen, "Connection") && isAttribute(value, valueLen, "keep-alive")){
+                r->flags |= FRAME_KEEPALIVE;
+            }
+            else if(isAttribute(line, attrLen, "Pipeline") && *value == '1'){
+                r->flags |= FRAME_PIPELINE;
+            }
+            else if(isAttribute(line, attrLen, "Resume") && *value == '1'){
+                r->flags |= FRAME_RESUME;
+            }
+            else if(isAttribute(line, attrLen, "Binary") && *value == '1'){
+                r->upgrade = true;
+            }
+            else if(isAttribute(line, attrLen, "Encoding") && isAttribute(value, valueLen, "deflate")){
+                r->flags |= FRAME_DEFLATE;
+            }
+            else if(isAttribute(line, attrLen, "Checksum") && isAttribute(value, valueLen, "crc32c")){
+                r->flags |= FRAME_CHECKSUM;
+            }
+            else if(isAttribute(line, attrLen, "Chunks")){
+                r->chunks = strtol(value, NULL, 10);
+            }
+            else if(isAttribute(line, attrLen, "Delta") && isAttribute(value, valueLen, "1")){
+                r->delta = true;
+            }
+        }
+        line = eol + 1;
+    }
+}
+
+/**
+ * @description - Parse binary request in place, file name follows fixed header
+ * @param const char *req - whole request starting by header
+ * @param Request *r - parsed request
+ * @return int - success = 0, failure = 1 when version is not supported
+ */
+int parseFrame(const char *req, Request *r) {
+
+    Frame f;
+    frameDecode(req, &f);
+
+    r->type = f.opcode;
+    r->name = req + FRAME_HEADER_SIZE;
+    r->nameLen = f.nameLen;
+    r->length = (long) f.length;
+    r->offset = (long) f.offset;
+    r->range = (long) f.length;
+    r->flags = f.flags;
+    r->upgrade = false;
+    r->chunks = -1;
+    r->delta = false;
+    return f.version == FRAME_VERSION ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/**
+ * @description - Compare name of attribute which is not terminated by zero
+ * @param const char *attr - name of attribute in request
+ * @param size_t len - length of name
+ * @param const char *name - expected name
+ * @return bool - names are equal
+ */
+bool isAttribute(const char *attr, size_t len, const char *name) {
+
+    return strlen(name) == len && memcmp(attr, name, len) == 0;
+}
+
+/**
+ * @description - Handle upload (from client's side) operation, prepare file for received data
+ * @param Connection *c - connection to the client
+ * @param Request *r - parsed request, its name is already copied to path of connection
+ * @return void
+ */
+void upload(Connection *c, Request *r) {
+
+    //data may follow, their length is unknown
+    if(r->name == NULL || r->length < 0){
+        queueResponse(c, Incomplete, Closing);
+        return;
+    }
+    c->dataLength = r->length;
+    c->transferred = 0;
+    c->fileOff = 0;
+
+    //client which does not wait for ACK sends data even if upload is rejected
+    Phase rejected = c->pipelined ? Discard : Finished;
+
+    //client which waits for ACK can send chunk list instead of data, list can't be longer than chunks of minimal length
+    if(r->chunks > CHUNK_INDEX_MAX){
+        queueResponse(c, NACK, rejected);   //declared length must not size memory of server
+        return;
+    }
+    c->dedup = !c->pipelined && r->chunks >= 0 && r->chunks <= c->dataLength / CHUNK_MIN + 1;
+
+    //data are written to temporary file, complete file replaces the old one at once
+    bool plain = !c->pipelined && !c->dedup && !r->delta;
+    bool resume = plain && (r->flags & FRAME_RESUME) != 0;
+
+    //plain upload writes .name.part kept for resuming, concurrent upload of the name gets its own file
+    c->file = -1;
+    c->resumable = false;
+    if(plain){
+        c->partPath = "." + c->path + ".part";
+        c->file = openPart(c->partPath);
+        c->resumable = c->file != -1;
+    }
+    if(c->file == -1 && resume){
+        cerr << "Partial file is being uploaded by other connection" << endl;
+        queueResponse(c, NACK, rejected);
+        return;
+    }
+    if(c->file == -1){
+        c->partPath.clear();    //.name.part of other upload is never removed
+        c->file = openTemp(c);
+    }
+
+    //resumed upload continues at the end of partial file
+    struct stat info;
+    if(c->file == -1 || fstat(c->file, &info) == -1){
+        cerr << "Unable to create a file" << endl;
+        dropUpload(c);
+        queueResponse(c, NACK, rejected);
+        return;
+    }
+    if(resume && info.st_size <= (off_t) c->dataLength){
+        c->transferred = (long) info.st_size;
+        c->fileOff = info.st_size;
+        c->counted = c->transferred;    //bytes of previous upload
+    }
+    else if(c->resumable && ftruncate(c->file, 0) == -1){   //partial file does not belong to this upload
+        cerr << "Unable to create a file" << endl;
+        dropUpload(c);
+        queueResponse(c, NACK, rejected);
+        return;
+    }
+
+    //reserve space for whole file at once, size of file stays as written
+    if(c->dataLength > 0 && fallocate(c->file, FALLOC_FL_KEEP_SIZE, 0, (off_t) c->dataLength) == -1 && errno == ENOSPC){
+        cerr << "Not enough space for uploaded file" << endl;
+        dropUpload(c);
+        queueResponse(c, NACK, rejected);
+        return;
+    }
+
+    //chunks are verified by their hashes, they are never encoded
+    if(c->dedup){
+        c->encoded = false;
+        c->checksum = false;
+        c->listLen = (size_t) r->chunks * CHUNK_RECORD;
+        c->block.clear();
+        c->blockLen = 0;
+        queueResponse(c, ACK, Index);
+        return;
+    }
+
+    //old copy of file is described by block signatures, client sends instructions how to rebuild it
+    string signatures;
+    if(r->delta && !c->pipelined && !c->dedup && signFile(c, signatures) == EXIT_SUCCESS){
+        c->encoded = false;
+        c->checksum = false;
+        c->engine = Delta;
+        c->block.resize(DELTA_HEADER + DELTA_LITERAL);
+        c->blockLen = 0;
+        queueResponse(c, ACK, Upload, (long) signatures.size(), -1, (long) c->basisSize);
+        c->response.append(signatures);
+        return;
+    }
+
+    //encoded data are decoded block by block, also those received together with request
+    if(c->encoded){
+        c->block.resize(ENC_MAX);
+        c->blockLen = 0;
+        c->engine = Deflate;
+        queueResponse(c, ACK, Upload, -1, resume ? c->transferred : -1);
+        return;
+    }
+
+    //beginning of pipelined data could be received together with request
+    long left = c->dataLength - c->transferred;
+    size_t buffered = c->reqLen < (size_t) left ? c->reqLen : (size_t) left;
+    if(buffered > 0 && pwrite(c->file, c->request, buffered, c->fileOff) != (ssize_t) buffered){
+        cerr << "Writing to file FAILED" << endl;
+        queueResponse(c, NACK, rejected);
+        return;
+    }
+    if(c->checksum){
+        c->crc = crc32c(c->crc, c->request, buffered);
+    }
+    consumeRequest(c, buffered);
+    c->transferred += (long) buffered;
+    c->fileOff += (off_t) buffered;
+
+    //data are moved by splice from socket to file, fallback is recv and pwrite
+    c->engine = defaultEngine(false);
+#if URING
+    if(c->engine == IoUring){
+        uringSetup(&c->ring, c->socket, true, c->file, false, c->fileOff, c->dataLength - c->transferred, c);
+        c->ring.crc = c->checksum ? &c->crc : NULL;
+    }
+#endif
+
+    //inform client,that upload request received and handled successfully, resumed one gets offset of missing data
+    queueResponse(c, ACK, Upload, -1, resume ? c->transferred : -1);
+}
+
+/**
+ * @description - Open partial file of plain upload, it is locked while one upload writes it
+ *                Partial file sharing its inode with other file by hard link is replaced by own file
+ * @param string path - .name.part
+ * @return int - locked file, -1 when other upload holds it or it can't be opened
+ */
+int openPart(string path) {
+
+    for(int attempt = 0; attempt < 2; attempt++){
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if(fd == -1){
+            return -1;
+        }
+        struct stat info, named;
+        if(flock(fd, LOCK_EX | LOCK_NB) == -1 || fstat(fd, &info) == -1){
+            close(fd);
+            return -1;
+        }
+
+        //finished upload may have renamed the file meanwhile, name leads to other file then
+        if(stat(path.c_str(), &named) == -1 || named.st_dev != info.st_dev || named.st_ino != info.st_ino){
+            close(fd);
+            return -1;
+        }
+        if(info.st_nlink == 1){
+            return fd;
+        }
+        unlink(path.c_str());   //shared inode must not be written through
+        close(fd);
+    }
+    return -1;
+}
+
+/**
+ * @description - Create temporary file of upload which is not resumable, its name is unique to the connection
+ * @param Connection *c - connection to the client, partPath is set
+ * @return int - opened file, -1 on failure
+ */
+int openTemp(Connection *c) {
+
+    string name = "." + c->path + ".XXXXXX";
+    int fd = mkostemp(&name[0], O_CLOEXEC);
+    if(fd == -1){
+        return -1;
+    }
+    fchmod(fd, 0644);   //mkostemp creates it just for owner
+    c->partPath = name;
+    return fd;
+}
+
+/**
+ * @description - Close file of failed upload and remove it, partial file of plain upload is kept for resuming
+ * @param Connection *c - connection to the client
+ * @return void
+ */
+void dropUpload(Connection *c) {
+
+    if(c->file != -1){
+        close(c->file);     //lock of partial file is released with it
+        c->file = -1;
+    }
+    if(!c->resumable && !c->partPath.empty()){
+        unlink(c->partPath.c_str());
+    }
+}
+
+/**
+ * @description - Receive part of uploaded data by engine chosen for the upload
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes uploadStep(Connection *c) {
+
+    if(c->transferred == c->dataLength){
+        finishUpload(c);
+        return Progress;
+    }
+
+    switch (c->engine){
+        case Splice:
+            return spliceRecvStep(c);
+        case IoUring:
+            return ringStep(c);
+        case Deflate:
+            return inflateStep(c);
+        case Chunks:
+            return chunkStep(c);
+        case Delta:
+            return deltaStep(c);
+        default:
+            return recvStep(c);
+    }
+}
+
+/**
+ * @description - Close uploaded file and queue final response according to received bytes
+ *                Complete file is made durable first as chosen by durability mode
+ * @param Connection *c - connection to the client
+ * @return void
+ */
+void finishUpload(Connection *c) {
+
+    if(c->basis != -1){
+        close(c->basis);
+        c->basis = -1;
+    }
+    if(c->transferred != c->dataLength){
+        close(c->file); //check if successful?
+        c->file = -1;
+        dropUpload(c);
+        queueResponse(c, NACK, Closing);    //partial file of plain upload is kept, upload can be resumed
+        return;
+    }
+    c->syncStart = metricsOn ? nowNs() : 0;
+
+    //flusher renames file when it is durable, connection waits for it
+    if(durability == GroupSync){
+        c->loop = syncLoop;
+        c->synced = false;
+        {
+            std::lock_guard<std::mutex> lock(syncQueue.mtx);
+            syncQueue.pending.push_back(c);
+        }
+        syncQueue.wake.notify_one();
+        c->phase = Syncing;
+        return;
+    }
+
+    //data are flushed before file replaces the old one, its new name after that
+    if(durability == FileSync && fdatasync(c->file) == -1){
+        cerr << "Unable to flush uploaded file" << endl;
+        commitUpload(c, true);
+    }
+    else if(rename(c->partPath.c_str(), c->path.c_str()) == -1){
+        cerr << "Unable to rename uploaded file" << endl;
+        commitUpload(c, true);
+    }
+    else if(durability == FileSync && fsync(dirFd) == -1){
+        cerr << "Unable to flush directory of uploaded file" << endl;
+        commitUpload(c, true);
+    }
+    else{
+        if(durability == FileSync){
+            countMetric(SyncBatches, 1);
+            recordLatency(SyncTime, c->syncStart);
+        }
+        commitUpload(c, false);
+    }
+}
+
+/**
+ * @description - Close complete uploaded file, index its chunks and queue final response
+ * @param Connection *c - connection to the client
+ * @param bool failed - file was not made durable or renamed
+ * @return void
+ */
+void commitUpload(Connection *c, bool failed) {
+
+    struct stat info;
+    bool indexed = !failed && c->dedup && fstat(c->file, &info) == 0;
+    close(c->file); //check if successful?
+    c->file = -1;
+    if(failed){
+        dropUpload(c);
+        queueResponse(c, NACK, Finished);
+        return;
+    }
+    if(indexed){
+        struct stat part;
+        if(stat(c->partPath.c_str(), &part) == 0 && part.st_dev == info.st_dev && part.st_ino == info.st_ino){
+            unlink(c->partPath.c_str());    //link to file which already had this name is not renamed
+        }
+        indexChunks(c, info);
+    }
+    queueResponse(c, ACK, Finished);
+}
+
+/**
+ * @description - Wait until flusher makes upload durable, then send final response
+ * @param Connection *c - connection to the client
+ * @return StepRes - Blocked while event loop waits for flusher, Progress when response is queued
+ */
+StepRes syncStep(Connection *c) {
+
+    if(c->loop == NULL){    //worker thread has nothing else to do meanwhile
+        std::unique_lock<std::mutex> lock(syncQueue.mtx);
+        while(!c->synced){
+            syncQueue.synced.wait(lock);
+        }
+    }
+    else if(!c->synced){
+        return Blocked;     //event loop resumes connection when flusher hands it back
+    }
+    commitUpload(c, c->syncFailed);
+    return Progress;
+}
+
+/**
+ * @description - Make uploads durable in batches, all uploads finished during one flush form the next batch
+ *                Writeback of whole batch is started at once, so waiting for each file overlaps the others
+ *                and renames of batch are made durable by one flush of directory
+ * @return void
+ */
+void flusherThread() {
+
+    while(1){
+        vector<Connection *> batch;
+        {
+            std::unique_lock<std::mutex> lock(syncQueue.mtx);
+            while(syncQueue.pending.empty()){
+                syncQueue.wake.wait(lock);
+            }
+            batch.swap(syncQueue.pending);
+        }
+
+        for(size_t i = 0; i < batch.size(); i++){
+            sync_file_range(batch[i]->file, 0, 0, SYNC_FILE_RANGE_WRITE);  //just a hint, fdatasync reports errors
+        }
+        bool renamed = false;
+        for(size_t i = 0; i < batch.size(); i++){
+            Connection *c = batch[i];
+            c->syncFailed = true;
+            if(fdatasync(c->file) == -1){
+                cerr << "Unable to flush uploaded file" << endl;
+            }
+            else if(rename(c->partPath.c_str(), c->path.c_str()) == -1){
+                cerr << "Unable to rename uploaded file" << endl;
+            }
+            else{
+                c->syncFailed = false;
+                renamed = true;
+            }
+        }
+        if(renamed && fsync(dirFd) == -1){
+            cerr << "Unable to flush directory of uploaded files" << endl;
+            for(size_t i = 0; i < batch.size(); i++){
+                batch[i]->syncFailed = true;
+            }
+        }
+        countMetric(SyncBatches, 1);
+
+        //connection may be closed as soon as it is handed back
+        std::lock_guard<std::mutex> lock(syncQueue.mtx);
+        for(size_t i = 0; i < batch.size(); i++){
+            Connection *c = batch[i];
+            recordLatency(SyncTime, c->syncStart);
+            if(c->loop == NULL){
+                c->synced = true;
+                continue;
+            }
+            SyncLoop *sl = c->loop;
+            {
+                std::lock_guard<std::mutex> done(sl->mtx);
+                sl->done.push_back(c);
+            }
+            uint64_t one = 1;
+            if(write(sl->eventFd, &one, sizeof(one)) == -1){
+                cerr << "Waking event loop FAILED" << endl;
+            }
+        }
+        syncQueue.synced.notify_all();
+    }
+}
+
+/**
+ * @description - Create eventfd of event loop signalling flushed uploads and watch it by epoll
+ * @param int epoll_fd - epoll of event loop
+ * @return SyncLoop * - handed back connections of loop, NULL on failure
+ */
+SyncLoop *createSyncLoop(int epoll_fd) {
+
+    SyncLoop *sl = new SyncLoop;
+    if((sl->eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1){
+        delete sl;
+        return NULL;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = sl;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, sl->eventFd, &ev) == -1){
+        close(sl->eventFd);
+        delete sl;
+        return NULL;
+    }
+    return sl;
+}
+
+/**
+ * @description - Resume connections of event loop whose uploads were flushed
+ * @param SyncLoop *sl - handed back connections of loop
+ * @return void
+ */
+void syncCompleted(SyncLoop *sl) {
+
+    uint64_t count;
+    while(read(sl->eventFd, &count, sizeof(count)) > 0);    //reset eventfd
+
+    vector<Connection *> done;
+    {
+        std::lock_guard<std::mutex> lock(sl->mtx);
+        done.swap(sl->done);
+    }
+    for(size_t i = 0; i < done.size(); i++){
+        done[i]->synced = true;
+        driveConnection(done[i]);
+    }
+}
+
+/**
+ * @description - Receive and throw away data of rejected pipelined upload, so next request can be read
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes discardStep(Connection *c) {
+
+    //encoded data end after blocks with Length original bytes
+    while(c->encoded && c->transferred < c->dataLength){
+        bool complete;
+        StepRes res = receiveBlock(c, &complete);
+        if(!complete){
+            return res;
+        }
+        size_t payload, original;
+        blockHeader(c->block.data(), &payload, &original);
+        c->transferred += (long) original;
+        c->blockLen = 0;
+    }
+
+    //part of data may be already in request buffer
+    long left = c->dataLength - c->transferred;
+    size_t buffered = c->reqLen < (size_t) left ? c->reqLen : (size_t) left;
+    consumeRequest(c, buffered);
+    c->transferred += (long) buffered;
+
+    left = c->dataLength - c->transferred;
+    if(left == 0){
+        c->phase = Finished;
+        return Progress;
+    }
+
+    char *buffer = threadBuffer();  //discarded data are not kept
+    if(buffer == NULL){
+        cerr << "Not enough memory for buffer" << endl;
+        return Done;
+    }
+    ssize_t received = recv(c->socket, buffer, left < (long) bufferSize() ? (size_t) left : bufferSize(), 0);
+
+    if(received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return Blocked;
+    }
+    if(received < 0 && errno == EINTR){
+        return Progress;
+    }
+    if(received <= 0){
+        return Done;
+    }
+    c->transferred += received;
+    return Progress;
+}
+
+/**
+ * @description - Move received data to the pipe and from the pipe to the file by splice
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes spliceRecvStep(Connection *c) {
+#if ZEROCOPY
+    if(c->checksum || openPipe(c) == EXIT_FAILURE){    //checksum is computed from received buffer
+        c->engine = Copy;
+        return Progress;
+    }
+
+    //fill pipe from socket, but never take more than announced length
+    long left = c->dataLength - c->transferred - (long) c->pipeLen;
+    if(left > 0 && c->pipeLen < c->pipeSize){
+        size_t space = c->pipeSize - c->pipeLen;
+        ssize_t moved = splice(c->socket, NULL, c->pipe[1], NULL,
+                               left < (long) space ? (size_t) left : space, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+        if(moved < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            if(c->pipeLen == 0){
+                return Blocked;
+            }
+        }
+        else if(moved < 0 && errno == EINTR){
+            return Progress;
+        }
+        else if(moved < 0 && errno == EINVAL && c->transferred == 0 && c->pipeLen == 0){
+            c->engine = Copy;   //socket can't be spliced
+            return Progress;
+        }
+        else if(moved <= 0){
+            finishUpload(c);    //client stopped sending
+            return Progress;
+        }
+        else{
+            c->pipeLen += moved;
+        }
+    }
+
+    //drain pipe to file
+    ssize_t written = splice(c->pipe[0], NULL, c->file, &c->fileOff, c->pipeLen, SPLICE_F_MOVE);
+    if(written < 0 && errno == EINTR){
+        return Progress;
+    }
+    if(written <= 0){
+        cerr << "Writing to file FAILED" << endl;
+        finishUpload(c);
+        return Progress;
+    }
+    c->pipeLen -= written;
+    c->transferred += written;
+    return Progress;
+#else
+    c->engine = Copy;
+    return Progress;
+#endif
+}
+
+/**
+ * @description - Receive part of uploaded data to big buffer and write it out
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes recvStep(Connection *c) {
+
+    char *buffer = threadBuffer();  //data are written out in the same step, so buffer can be shared
+    if(buffer == NULL){
+        cerr << "Not enough memory for buffer" << endl;
+        finishUpload(c);
+        return Progress;
+    }
+
+    long left = c->dataLength - c->transferred;
+    ssize_t received = recv(c->socket, buffer, left < (long) bufferSize() ? (size_t) left : bufferSize(), 0);
+
+    if(received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return Blocked;
+    }
+    if(received < 0 && errno == EINTR){
+        return Progress;
+    }
+    if(received <= 0){
+        finishUpload(c);
+        return Progress;
+    }
+    if(c->checksum){
+        c->crc = crc32c(c->crc, buffer, (size_t) received);
+    }
+
+    for(ssize_t written = 0; written < received; ){
+        ssize_t bytes = pwrite(c->file, buffer + written, (size_t)(received - written), c->fileOff);
+        if(bytes <= 0){
+            cerr << "Writing to file FAILED" << endl;
+            finishUpload(c);
+            return Progress;
+        }
+        written += bytes;
+        c->fileOff += bytes;
+        c->transferred += bytes;
+    }
+    return Progress;
+}
+
+/**
+ * @description - Handle download (from client's side) operation, open file and send its length
+ * @param Connection *c - connection to the client
+ * @param Request *r - parsed request, its name is already copied to path of connection
+ * @return void
+ */
+void download(Connection *c, Request *r) {
+
+    if(r->name == NULL){
+        queueResponse(c, Incomplete, Finished);
+        return;
+    }
+
+    //small hot files are served from memory without opening them
+    struct stat info;
+    if(fileCache != NULL && !c->encoded && stat(c->path.c_str(), &info) == 0 && S_ISREG(info.st_mode) && info.st_size <= CACHE_MAX_FILE){
+        c->cached = cacheGet(c->path, info);
+    }
+
+    //check if exists
+    if(!c->cached){
+        c->file = open(c->path.c_str(), O_RDONLY); //flock ???
+        if(c->file == -1 || fstat(c->file, &info) == -1){
+            queueResponse(c, NotFound, Finished);    //inform client
+            return;
+        }
+    }
+
+    //concurrent downloads of the same file share one mapping
+    if(mmapMode && !c->cached && !c->encoded && S_ISREG(info.st_mode) && info.st_size > 0){
+        c->mapping = mapFile(c->file, info);
+    }
+
+    //just part of file is sent when client asks for range, f.e.: one stream of parallel download
+    long size = c->cached ? (long) c->cached->size() : (long) info.st_size;
+    long offset = (r->flags & FRAME_OFFSET) ? r->offset : 0;
+    long length = (r->flags & FRAME_RANGE) ? r->range : size;
+    bool ranged = (r->flags & (FRAME_OFFSET | FRAME_RANGE)) != 0;
+    if(offset < 0 || length < 0){
+        queueResponse(c, NACK, Finished);
+        return;
+    }
+    if(offset > size){ offset = size; }
+    if(length > size - offset){ length = size - offset; }
+
+    //regular files are sent by sendfile, others by splice, fallback is copying
+    if(c->cached){
+        c->engine = Cached;
+        c->memory = c->cached->data();
+    }
+    else if(c->mapping){
+        c->engine = Mapped;
+        c->memory = c->mapping->addr;
+    }
+    else if(c->encoded){
+        c->engine = Deflate;
+        c->block.resize(ENC_MAX);
+    }
+    else{
+        c->engine = defaultEngine(S_ISREG(info.st_mode));
+    }
+#if URING
+    if(c->engine == IoUring){
+        uringSetup(&c->ring, c->file, false, c->socket, true, (off_t) offset, length, c);
+        c->ring.crc = c->checksum ? &c->crc : NULL;
+    }
+#endif
+
+    //Send ACK and length of sent data, size of whole file when range was asked
+    c->dataLength = length;
+    c->transferred = 0;
+    c->fileOff = (off_t) offset;
+    c->buffLen = c->buffOff = 0;
+    queueResponse(c, ACK, Download, c->dataLength, -1, ranged ? size : -1);
+}
+
+/**
+ * @description - Handle archive (from client's side) operation, files are matched by pattern or listed after request
+ * @param Connection *c - connection to the client
+ * @param Request *r - parsed request, its name is already copied to path of connection
+ * @return void
+ */
+void archive(Connection *c, Request *r) {
+
+    c->encoded = false;     //archive is sent raw, files are checked by their sizes
+    c->checksum = false;
+    c->names.clear();
+    c->nameNext = 0;
+    c->files = 0;
+    c->ended = false;
+    c->dataLength = 0;
+    c->transferred = 0;
+
+    //pattern matches files of server's directory like names of other requests
+    if(r->name != NULL){
+        glob_t g;
+        if(glob(c->path.c_str(), 0, NULL, &g) == 0){
+            c->names.assign(g.gl_pathv, g.gl_pathv + g.gl_pathc);
+        }
+        globfree(&g);
+        startArchive(c);
+    }
+    else if(r->length > ARCHIVE_MANIFEST){
+        queueResponse(c, TooLong, Closing);     //list follows, it can't be skipped
+    }
+    else if(r->length > 0){
+        c->block.resize((size_t) r->length);
+        c->blockLen = 0;
+        c->phase = Manifest;
+    }
+    else{
+        queueResponse(c, Incomplete, Finished);
+    }
+}
+
+/**
+ * @description - Receive list of files of archive, names are separated by newlines
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes manifestStep(Connection *c) {
+
+    bool complete;
+    StepRes res = receiveBytes(c, c->block.size(), &complete);
+    if(res == Done || !complete){
+        return res;
+    }
+
+    //path is stripped like in other requests
+    const char *line = c->block.data();
+    const char *end = line + c->block.size();
+    while(line < end){
+        const char *eol = (const char *) memchr(line, '\n', (size_t)(end - line));
+        if(eol == NULL){
+            eol = end;
+        }
+        const char *base = eol;
+        while(base > line && base[-1] != '/' && base[-1] != '\\'){
+            base--;
+        }
+        if(base < eol && memchr(base, '\0', (size_t)(eol - base)) == NULL){
+            c->names.push_back(string(base, (size_t)(eol - base)));
+        }
+        line = eol + 1;
+    }
+    c->blockLen = 0;
+    startArchive(c);
+    return Progress;
+}
+
+/**
+ * @description - Send ACK of archive, files are packed when it's sent
+ * @param Connection *c - connection to the client, names are filled
+ * @return void
+ */
+void startArchive(Connection *c) {
+
+    if(c->names.empty()){
+        queueResponse(c, NotFound, Finished);
+        return;
+    }
+    if(c->buffer == NULL && (c->buffer = bufferAcquire()) == NULL){
+        cerr << "Not enough memory for buffer" << endl;
+        queueResponse(c, NACK, Finished);
+        return;
+    }
+    c->iov.clear();
+    c->iovNext = 0;
+    queueResponse(c, ACK, Pack);
+}
+
+/**
+ * @description - Send part of batch of archive by writev, next batch is packed when it's sent
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes packStep(Connection *c) {
+
+    if(c->iovNext == c->iov.size()){
+        c->pinned.clear();
+
+        //big file follows its header, it's sent like download
+        if(c->file != -1){
+            c->engine = defaultEngine(true);
+#if URING
+            if(c->engine == IoUring){
+                uringSetup(&c->ring, c->file, false, c->socket, true, 0, c->dataLength - c->transferred, c);
+                c->ring.crc = NULL;
+            }
+#endif
+            c->buffLen = c->buffOff = 0;
+            c->phase = Download;
+            return Progress;
+        }
+        if(c->ended){
+            c->phase = Finished;
+            return Progress;
+        }
+        if(packFiles(c) == EXIT_FAILURE){
+            cerr << "Reading from file FAILED" << endl;
+            return Done;    //header with size of file was already packed
+        }
+        return Progress;
+    }
+
+    size_t count = c->iov.size() - c->iovNext;
+    ssize_t bytes = writev(c->socket, &c->iov[c->iovNext], (int)(count < ARCHIVE_IOV ? count : ARCHIVE_IOV));
+
+    if(bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return Blocked;
+    }
+    if(bytes < 0 && errno == EINTR){
+        return Progress;
+    }
+    if(bytes <= 0){
+        cerr << "Sending archive FAILED" << endl;
+        return Done;
+    }
+    c->transferred += bytes;
+
+    //partly sent part continues by its rest
+    while(bytes > 0){
+        struct iovec &part = c->iov[c->iovNext];
+        if((size_t) bytes < part.iov_len){
+            part.iov_base = (char *) part.iov_base + bytes;
+            part.iov_len -= (size_t) bytes;
+            break;
+        }
+        bytes -= (ssize_t) part.iov_len;
+        c->iovNext++;
+    }
+    return Progress;
+}
+
+/**
+ * @description - Pack headers and data of next files to batch sent by writev, small files go back-to-back
+ *                Headers and read files are copied to buffer, cached files are sent from cache, big file ends batch
+ * @param Connection *c - connection to the client
+ * @return int - success = 0, failure = 1 when file was shorter than its header says
+ */
+int packFiles(Connection *c) {
+
+    size_t size = bufferSize();
+    size_t used = 0;
+    c->iov.clear();
+    c->iovNext = 0;
+    c->dataLength = c->transferred;
+    while(c->nameNext < c->names.size() && c->iov.size() < ARCHIVE_IOV - 2){
+
+        const string &name = c->names[c->nameNext];
+        size_t header = ARCHIVE_HEADER + name.length();
+        if(used + header > size){
+            break;
+        }
+
+        //small hot files are served from memory without opening them, missing and other than regular files are skipped
+        struct stat info;
+        std::shared_ptr<const string> cached;
+        int fd = -1;
+        if(stat(name.c_str(), &info) == 0 && S_ISREG(info.st_mode) && fileCache != NULL && info.st_size <= CACHE_MAX_FILE){
+            cached = cacheGet(name, info);
+        }
+        if(!cached && ((fd = open(name.c_str(), O_RDONLY)) == -1 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode))){
+            if(fd != -1){
+                close(fd);
+            }
+            c->nameNext++;
+            continue;
+        }
+        size_t bytes = cached ? cached->size() : (size_t) info.st_size;
+        bool fits = cached || used + header + bytes <= size;
+        if(!fits && used > 0 && header + bytes <= size){
+            close(fd);      //file goes whole to next batch
+            break;
+        }
+
+        archiveHeader(c->buffer + used, name.length(), (uint64_t) bytes);
+        memcpy(c->buffer + used + ARCHIVE_HEADER, name.data(), name.length());
+        packPart(c, c->buffer + used, header);
+        used += header;
+        c->nameNext++;
+        c->files++;
+
+        if(cached){
+            packPart(c, cached->data(), bytes);
+            c->pinned.push_back(cached);
+        }
+        else if(fits){
+            for(size_t got = 0; got < bytes; ){
+                ssize_t r = pread(fd, c->buffer + used + got, bytes - got, (off_t) got);
+                if(r <= 0){
+                    close(fd);
+                    return EXIT_FAILURE;
+                }
+                got += (size_t) r;
+            }
+            packPart(c, c->buffer + used, bytes);
+            used += bytes;
+            close(fd);
+        }
+        else{
+            c->file = fd;   //sent after batch
+            c->fileOff = 0;
+            c->dataLength += (long) bytes;
+            return EXIT_SUCCESS;
+        }
+    }
+
+    //last header tells number of files, so client knows nothing is missing
+    if(c->nameNext == c->names.size() && used + ARCHIVE_HEADER <= size && c->iov.size() < ARCHIVE_IOV){
+        archiveHeader(c->buffer + used, 0, (uint64_t) c->files);
+        packPart(c, c->buffer + used, ARCHIVE_HEADER);
+        c->ended = true;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Append part to batch of archive, part following the previous one in memory extends it
+ * @param Connection *c - connection to the client
+ * @param const char *data - part of archive
+ * @param size_t len - bytes of part
+ * @return void
+ */
+void packPart(Connection *c, const char *data, size_t len) {
+
+    if(len == 0){
+        return;
+    }
+    c->dataLength += (long) len;
+    if(!c->iov.empty() && (const char *) c->iov.back().iov_base + c->iov.back().iov_len == data){
+        c->iov.back().iov_len += len;
+        return;
+    }
+    struct iovec part;
+    part.iov_base = (void *) data;
+    part.iov_len = len;
+    c->iov.push_back(part);
+}
+
+/**
+ * @description - Send part of downloaded file by engine chosen for the file
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes downloadStep(Connection *c) {
+
+    if(c->transferred == c->dataLength){ //whole file is sent
+        if(c->op == Archive){
+            close(c->file);     //next files of archive follow
+            c->file = -1;
+            c->phase = Pack;
+        }
+        else if(c->checksum){
+            queueResponse(c, ACK, Finished);    //checksum follows the data
+        }
+        else{
+            c->phase = Finished;
+        }
+        return Progress;
+    }
+
+    switch (c->engine){
+        case SendFile:
+            return sendfileStep(c);
+        case Splice:
+            return spliceStep(c);
+        case IoUring:
+            return ringStep(c);
+        case Cached:
+        case Mapped:
+            return memoryStep(c);
+        case Deflate:
+            return deflateStep(c);
+        default:
+            return copyStep(c);
+    }
+}
+
+/**
+ * @description - Send next part of download when connection has quantum of its turn and rate limits allow it
+ *                Downloads with less than a quantum left are never delayed, so small files pass big ones
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of download step, Blocked when connection waits for its next turn
+ */
+StepRes shapeStep(Connection *c) {
+
+    //bytes are charged after they are sent, io_uring batches complete outside of steps
+    long sent = c->transferred - c->shaped;
+    c->shaped = c->transferred;
+    c->deficit -= sent;
+    uint64_t wait = 0;
+    if(totalBucket != NULL){
+        wait = bucketCharge(totalBucket, sent);
+    }
+    if(clientRate > 0){
+        if(c->client == NULL){
+            c->client = clientBucket(c->socket);
+        }
+        if(c->client != NULL){
+            uint64_t own = bucketCharge(c->client.get(), sent);
+            wait = own > wait ? own : wait;
+        }
+    }
+
+    if(c->dataLength - c->transferred > SCHED_QUANTUM){
+        if(wait > 0){
+            return throttle(c, wait);
+        }
+        if(runQueue != NULL && c->deficit <= 0){    //other connections of loop go first
+            c->queued = true;
+            runQueue->ready.push_back(c);
+            return Blocked;
+        }
+    }
+    return downloadStep(c);
+}
+
+/**
+ * @description - Wait until download is within rate limits again
+ * @param Connection *c - connection to the client
+ * @param uint64_t wait - nanoseconds to wait
+ * @return StepRes - Progress after worker thread slept, Blocked when event loop wakes connection later
+ */
+StepRes throttle(Connection *c, uint64_t wait) {
+
+    if(runQueue == NULL){   //worker thread has nothing else to do meanwhile
+        std::this_thread::sleep_for(std::chrono::nanoseconds(wait));
+        return Progress;
+    }
+    c->queued = true;
+    runQueue->sleeping.insert(std::make_pair(nowNs() + wait, c));
+    return Blocked;
+}
+
+/**
+ * @description - Set rate of token bucket and fill it
+ * @param Bucket *b - bucket to be initialized
+ * @param long kib - KiB per second
+ * @return void
+ */
+void bucketInit(Bucket *b, long kib) {
+
+    b->rate = (double) kib * 1024 / 1e9;
+    b->burst = b->rate * SCHED_BURST;
+    if(b->burst < SCHED_QUANTUM){
+        b->burst = SCHED_QUANTUM;   //one turn never waits for bucket
+    }
+    b->tokens = b->burst;
+    b->last = nowNs();
+}
+
+/**
+ * @description - Refill bucket by elapsed time and charge sent bytes to it
+ * @param Bucket *b - rate limit
+ * @param long bytes - bytes sent since last charge
+ * @return uint64_t - nanoseconds until bucket is out of debt, 0 = next part may be sent now
+ */
+uint64_t bucketCharge(Bucket *b, long bytes) {
+
+    std::lock_guard<std::mutex> lock(b->mtx);
+    uint64_t now = nowNs();
+    b->tokens += (double)(now - b->last) * b->rate;
+    if(b->tokens > b->burst){
+        b->tokens = b->burst;
+    }
+    b->last = now;
+    b->tokens -= (double) bytes;
+    return b->tokens >= 0 ? 0 : (uint64_t)(-b->tokens / b->rate) + 1;
+}
+
+/**
+ * @description - Get rate limit shared by connections from the same address
+ * @param int socket - socket to the client
+ * @return std::shared_ptr<Bucket> - bucket of address, NULL when address is unknown
+ */
+std::shared_ptr<Bucket> clientBucket(int socket) {
+
+    struct sockaddr_in6 addr;
+    socklen_t len = sizeof(addr);
+    if(getpeername(socket, (struct sockaddr *) &addr, &len) == -1){
+        return NULL;
+    }
+    string key((const char *) &addr.sin6_addr, sizeof(addr.sin6_addr));
+
+    lock_guard<std::mutex> lock(clientsMtx);
+    std::shared_ptr<Bucket> b = clientBuckets[key].lock();
+    if(b){
+        return b;
+    }
+    b = std::make_shared<Bucket>();
+    bucketInit(b.get(), clientRate);
+    clientBuckets[key] = b;
+
+    //forget addresses whose downloads ended
+    for(std::map<string, std::weak_ptr<Bucket> >::iterator it = clientBuckets.begin(); it != clientBuckets.end(); ){
+        if(it->second.expired()){
+            clientBuckets.erase(it++);
+        }
+        else{
+            ++it;
+        }
+    }
+    return b;
+}
+
+/**
+ * @description - Give one turn to connections of run queue, those yielding meanwhile wait for next round
+ * @param RunQueue *q - run queue of event loop
+ * @return void
+ */
+void runQueued(RunQueue *q) {
+
+    uint64_t now = nowNs();
+    while(!q->sleeping.empty() && q->sleeping.begin()->first <= now){
+        q->ready.push_back(q->sleeping.begin()->second);
+        q->sleeping.erase(q->sleeping.begin());
+    }
+
+    size_t turns = q->ready.size();
+    while(turns-- > 0){
+        Connection *c = q->ready.front();
+        q->ready.pop_front();
+        c->queued = false;
+        driveConnection(c);
+    }
+}
+
+/**
+ * @description - Get timeout of waiting for events, so queued connections get their turn
+ * @param RunQueue *q - run queue of event loop
+ * @return int - milliseconds, 0 = some connection is ready, -1 = none is queued
+ */
+int runTimeout(RunQueue *q) {
+
+    if(!q->ready.empty()){
+        return 0;
+    }
+    if(q->sleeping.empty()){
+        return -1;
+    }
+    uint64_t now = nowNs();
+    uint64_t at = q->sleeping.begin()->first;
+    return at <= now ? 0 : (int)((at - now + 999999) / 1000000);
+}
+
+/**
+ * @description - Send part of file directly from page cache by sendfile
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes sendfileStep(Connection *c) {
+#if ZEROCOPY
+    off_t offset = c->fileOff;
+    long left = c->dataLength - c->transferred;
+    left = left < SCHED_QUANTUM ? left : SCHED_QUANTUM;     //blocking socket would send all at once, past the scheduler
+    ssize_t bytes_written = sendfile(c->socket, c->file, &c->fileOff, (size_t) left);
+
+    if(bytes_written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return Blocked;
+    }
+    if(bytes_written < 0 && errno == EINTR){
+        return Progress;
+    }
+    if(bytes_written < 0 && (errno == EINVAL || errno == ENOSYS) && c->transferred == 0){
+        c->engine = Splice;     //file system does not support sendfile
+        return Progress;
+    }
+    if(bytes_written <= 0){
+        cerr << "Not entire data sent: " << c->transferred << " - " << c->dataLength << endl;
+        return Done;
+    }
+    if(c->checksum && checksumFile(c, offset, (size_t) bytes_written) == EXIT_FAILURE){
+        cerr << "Reading from file FAILED" << endl;
+        return Done;
+    }
+    c->transferred += bytes_written;
+    return Progress;
+#else
+    c->engine = Copy;
+    return Progress;
+#endif
+}
+
+/**
+ * @description - Move part of file to the pipe and from the pipe to the socket by splice
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes spliceStep(Connection *c) {
+#if ZEROCOPY
+    if(c->checksum || openPipe(c) == EXIT_FAILURE){    //data in pipe can't be read for checksum
+        c->engine = Copy;
+        return Progress;
+    }
+
+    //fill pipe from file
+    if(c->pipeLen == 0){
+        long left = c->dataLength - c->transferred;
+        ssize_t moved = splice(c->file, &c->fileOff, c->pipe[1], NULL,
+                               left < (long) c->pipeSize ? (size_t) left : c->pipeSize, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+
+        if(moved < 0 && errno == EINTR){
+            return Progress;
+        }
+        if(moved < 0 && errno == EINVAL && c->transferred == 0){
+            c->engine = Copy;   //file can't be spliced
+            return Progress;
+        }
+        if(moved <= 0){
+            cerr << "Not entire data sent: " << c->transferred << " - " << c->dataLength << endl;
+            return Done;
+        }
+        c->pipeLen = (size_t) moved;
+    }
+
+    //drain pipe to socket, last part is not corked
+    unsigned int flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+    if(c->transferred + (long) c->pipeLen < c->dataLength){
+        flags |= SPLICE_F_MORE;
+    }
+    ssize_t bytes_written = splice(c->pipe[0], NULL, c->socket, NULL, c->pipeLen, flags);
+
+    if(bytes_written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return Blocked;
+    }
+    if(bytes_written < 0 && errno == EINTR){
+        return Progress;
+    }
+    if(bytes_written <= 0){
+        cerr << "Sending bytes FAILED" << endl;
+        return Done;
+    }
+    c->pipeLen -= bytes_written;
+    c->transferred += bytes_written;
+    return Progress;
+#else
+    c->engine = Copy;
+    return Progress;
+#endif
+}
+
+/**
+ * @description - Send part of downloaded file, read next part when buffer is empty
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes copyStep(Connection *c) {
+
+    if(c->buffOff == c->buffLen){
+
+        //buffer is kept by connection, its data may stay unsent till next step
+        if(c->buffer == NULL && (c->buffer = bufferAcquire()) == NULL){
+            cerr << "Not enough memory for buffer" << endl;
+            return Done;
+        }
+        long left = c->dataLength - c->transferred;
+        ssize_t bytes_read = pread(c->file, c->buffer, left < (long) bufferSize() ? (size_t) left : bufferSize(), c->fileOff);
+
+        if (bytes_read == 0) { //file is shorter than announced
+            cerr << "Not entire data sent: " << c->transferred << " - " << c->dataLength << endl;
+            return Done;
+        }
+        if (bytes_read < 0) {
+            cerr << "Reading from file FAILED" << endl;
+            return Done;
+        }
+        c->buffLen = (size_t) bytes_read;
+        c->buffOff = 0;
+        c->fileOff += bytes_read;
+        if(c->checksum){
+            c->crc = crc32c(c->crc, c->buffer, c->buffLen);
+        }
+    }
+
+    ssize_t bytes_written = send(c->socket, c->buffer + c->buffOff, c->buffLen - c->buffOff, 0);
+
+    if(bytes_written < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return Blocked;
+    }
+    if(bytes_written < 0 && errno == EINTR){
+        return Progress;
+    }
+    if (bytes_written <= 0) {
+        cerr << "Sending bytes FAILED" << endl;
+        return Done;
+    }
+    c->buffOff += bytes_written;
+    c->transferred += bytes_written;
+    return Progress;
+}
+
+/**
+ * @description - Add data sent without copying to checksum, they are read again from page cache
+ * @param Connection *c - connection to the client
+ * @param off_t offset - offset of sent data in file
+ * @param size_t len - bytes of sent data
+ * @return int - success = 0, failure = 1
+ */
+int checksumFile(Connection *c, off_t offset, size_t len) {
+
+    char *buffer = threadBuffer();  //just checksummed, so buffer can be shared
+    if(buffer == NULL){
+        return EXIT_FAILURE;
+    }
+
+    while(len > 0){
+        ssize_t bytes = pread(c->file, buffer, len < bufferSize() ? len : bufferSize(), offset);
+        if(bytes <= 0){
+            return EXIT_FAILURE;
+        }
+        c->crc = crc32c(c->crc, buffer, (size_t) bytes);
+        offset += bytes;
+        len -= (size_t) bytes;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Choose engine for new transfer
+ * @param bool regular - file is regular file
+ * @return Engine - io_uring if enabled, zero-copy engine if built, otherwise copying
+ */
+Engine defaultEngine(bool regular) {
+
+#if URING
+    if(uringMode && ringUsable){
+        return IoUring;
+    }
+#endif
+#if ZEROCOPY
+    return regular ? SendFile : Splice;
+#else
+    (void) regular;
+    return Copy;
+#endif
+}
+
+/**
+ * @description - Send rest of response and data of downloaded file from memory by one writev
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes memoryStep(Connection *c) {
+
+    struct iovec iov[2];
+    int count = 0;
+    size_t respLeft = c->response.length() - c->respSent;
+    if(c->phase == SendResp && respLeft > 0){
+        iov[count].iov_base = (void *)(c->response.data() + c->respSent);
+        iov[count++].iov_len = respLeft;
+    }
+    else{
+        respLeft = 0;
+    }
+    if(c->dataLength > c->transferred){
+        long left = c->dataLength - c->transferred;
+        iov[count].iov_base = (void *)(c->memory + c->fileOff);
+        iov[count++].iov_len = (size_t)(left < SCHED_QUANTUM ? left : SCHED_QUANTUM);   //like sendfile
+    }
+    if(count == 0){
+        c->phase = Finished;
+        return Progress;
+    }
+
+    ssize_t bytes = writev(c->socket, iov, count);
+
+    if(bytes < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return Blocked;
+    }
+    if(bytes < 0 && errno == EINTR){
+        return Progress;
+    }
+    if(bytes <= 0){    //EFAULT when mapped file was truncated meanwhile
+        cerr << "ERROR: Sending response FAILED" << endl;
+        return Done;
+    }
+
+    //response is sent first, the rest are data
+    size_t resp = (size_t) bytes < respLeft ? (size_t) bytes : respLeft;
+    if(c->checksum && c->engine == Mapped){     //mapping of file truncated meanwhile can't be touched, pread just fails
+        if(checksumFile(c, c->fileOff, (size_t) bytes - resp) == EXIT_FAILURE){
+            cerr << "Reading from file FAILED" << endl;
+            return Done;
+        }
+    }
+    else if(c->checksum){
+        c->crc = crc32c(c->crc, c->memory + c->fileOff, (size_t) bytes - resp);
+    }
+    c->respSent += resp;
+    c->transferred += bytes - (ssize_t) resp;
+    c->fileOff += bytes - (ssize_t) resp;
+    if(c->respSent == c->response.length()){
+        c->phase = Download;
+    }
+    return Progress;
+}
+
+/**
+ * @description - Send part of downloaded file as encoded blocks, next block is read and encoded when previous is sent
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes deflateStep(Connection *c) {
+
+    static thread_local char data[ENC_BLOCK];     //encoded in the same step, so buffer can be shared
+
+    if(c->blockOff == c->blockLen){
+        long left = c->dataLength - c->transferred;
+        size_t len = left < ENC_BLOCK ? (size_t) left : ENC_BLOCK;
+        ssize_t bytes = pread(c->file, data, len, c->fileOff);
+        if(bytes <= 0){
+            cerr << "Reading file FAILED" << endl;
+            return Done;    //client detects incomplete file
+        }
+
+        //incompressible data are sent raw without trying for some blocks
+        c->blockLen = encodeBlock(data, (size_t) bytes, c->block.data(), c->rawBlocks > 0 ? 0 : compressLevel);
+        if(c->rawBlocks > 0){
+            c->rawBlocks--;
+        }
+        else if(c->blockLen == ENC_HEADER + (size_t) bytes){
+            c->rawBlocks = ENC_SKIP;
+        }
+        c->blockOff = 0;
+        c->blockOrig = (size_t) bytes;
+        c->fileOff += bytes;
+        if(c->checksum){
+            c->crc = crc32c(c->crc, data, (size_t) bytes);  //checksum is of original data
+        }
+    }
+
+    int flags = c->transferred + (long) c->blockOrig < c->dataLength ? MSG_MORE : 0;
+    ssize_t sent = send(c->socket, c->block.data() + c->blockOff, c->blockLen - c->blockOff, flags);
+
+    if(sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return Blocked;
+    }
+    if(sent < 0 && errno == EINTR){
+        return Progress;
+    }
+    if(sent <= 0){
+        cerr << "Downloading FAILED" << endl;
+        return Done;
+    }
+    c->blockOff += sent;
+    if(c->blockOff == c->blockLen){
+        c->transferred += (long) c->blockOrig;  //progress counts original bytes
+    }
+    return Progress;
+}
+
+/**
+ * @description - Receive next encoded block of upload, decode it and write it to the file
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes inflateStep(Connection *c) {
+
+    static thread_local char data[ENC_BLOCK];     //written out in the same step, so buffer can be shared
+
+    bool complete;
+    StepRes res = receiveBlock(c, &complete);
+    if(res == Done){
+        finishUpload(c);    //client stopped sending or sent invalid block
+        return Progress;
+    }
+    if(!complete){
+        return res;
+    }
+
+    size_t payload, original;
+    blockHeader(c->block.data(), &payload, &original);
+    const char *decoded = decodeBlock(c->block.data(), data);
+    if(decoded == NULL || (long) original > c->dataLength - c->transferred){
+        cerr << "Corrupted block of encoded data" << endl;
+        finishUpload(c);
+        return Progress;
+    }
+    if(c->checksum){
+        c->crc = crc32c(c->crc, decoded, original);
+    }
+
+    for(size_t written = 0; written < original; ){
+        ssize_t bytes = pwrite(c->file, decoded + written, original - written, c->fileOff);
+        if(bytes <= 0){
+            cerr << "Writing to file FAILED" << endl;
+            finishUpload(c);
+            return Progress;
+        }
+        written += (size_t) bytes;
+        c->fileOff += bytes;
+        c->transferred += bytes;
+    }
+    c->blockLen = 0;
+    return Progress;
+}
+
+/**
+ * @description - Receive part of encoded block, bytes buffered behind request are taken first
+ * @param Connection *c - connection to the client
+ * @param bool *complete - set when whole block is in block buffer of connection
+ * @return StepRes - result of step, Done when connection was closed or block is not valid
+ */
+StepRes receiveBlock(Connection *c, bool *complete) {
+
+    *complete = false;
+
+    //header tells length of payload
+    size_t need = ENC_HEADER;
+    if(c->blockLen >= ENC_HEADER){
+        size_t payload, original;
+        if(blockHeader(c->block.data(), &payload, &original) != 0){
+            return Done;
+        }
+        need += payload;
+    }
+
+    bool received;
+    StepRes res = receiveBytes(c, need, &received);
+    *complete = received && need > ENC_HEADER;
+    return res;
+}
+
+/**
+ * @description - Receive data to block of connection until it has given length, buffered bytes of request go first
+ * @param Connection *c - connection to the client
+ * @param size_t need - bytes block has to have, block is big enough
+ * @param bool *complete - block has all bytes, nothing was received in this step
+ * @return StepRes - result of step, Done when client closed connection
+ */
+StepRes receiveBytes(Connection *c, size_t need, bool *complete) {
+
+    *complete = c->blockLen == need;
+    if(*complete){
+        return Progress;
+    }
+
+    size_t buffered = c->reqLen < need - c->blockLen ? c->reqLen : need - c->blockLen;
+    if(buffered > 0){
+        memcpy(c->block.data() + c->blockLen, c->request, buffered);
+        consumeRequest(c, buffered);
+        c->blockLen += buffered;
+        return Progress;
+    }
+
+    ssize_t received = recv(c->socket, c->block.data() + c->blockLen, need - c->blockLen, 0);
+
+    if(received < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+        return Blocked;
+    }
+    if(received < 0 && errno == EINTR){
+        return Progress;
+    }
+    if(received <= 0){
+        return Done;
+    }
+    c->blockLen += received;
+    return Progress;
+}
+
+/**
+ * @description - Receive chunk list of deduplicated upload, then copy chunks server already has
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes indexStep(Connection *c) {
+
+    //block grows just by received records, list which never comes takes no memory
+    if(c->blockLen == c->block.size() && c->block.size() < c->listLen){
+        size_t grown = c->block.size() < CHUNK_LIST_FIRST ? CHUNK_LIST_FIRST : 2 * c->block.size();
+        c->block.resize(grown < c->listLen ? grown : c->listLen);
+    }
+    bool complete;
+    StepRes res = receiveBytes(c, c->block.size(), &complete);
+    if(res == Done){
+        finishUpload(c);
+        return Progress;
+    }
+    if(complete && c->block.size() == c->listLen){
+        c->phase = Upload;
+        findChunks(c);
+    }
+    return res;
+}
+
+/**
+ * @description - Check chunk list, copy known chunks to uploaded file and ask client for the others by bitmap
+ * @param Connection *c - connection to the client, block holds the list
+ * @return void
+ */
+void findChunks(Connection *c) {
+
+    //list has to describe the whole file before anything is written
+    size_t n = c->listLen / CHUNK_RECORD;
+    c->chunks.resize(n);
+    off_t offset = 0;
+    for(size_t i = 0; i < n; i++){
+        const char *record = c->block.data() + i * CHUNK_RECORD;
+        Chunk &chunk = c->chunks[i];
+        chunk.hash.assign(record, CHUNK_HASH);
+        chunk.offset = offset;
+        chunk.length = recordLength(record);
+        if(chunk.length == 0 || chunk.length > CHUNK_MAX){
+            break;
+        }
+        offset += chunk.length;
+    }
+    if(offset != c->dataLength){
+        cerr << "Invalid chunk list" << endl;
+        finishUpload(c);
+        return;
+    }
+
+    //places are taken under lock at once, files are checked when they are opened
+    vector<ChunkPlace> places(n);
+    vector<bool> known(n, false);
+    {
+        std::lock_guard<std::mutex> lock(chunkIndex->mtx);
+        for(size_t i = 0; i < n; i++){
+            auto it = chunkIndex->places.find(c->chunks[i].hash);
+            if(it != chunkIndex->places.end()){
+                places[i] = it->second;
+                known[i] = true;
+            }
+        }
+    }
+
+    //identical file is linked, both names share its data
+    bool whole = n > 0 && known[0] && places[0].size == c->dataLength;
+    for(size_t i = 0; whole && i < n; i++){
+        whole = known[i] && places[i].path == places[0].path && places[i].ino == places[0].ino
+                && places[i].offset == c->chunks[i].offset;
+    }
+    struct stat info;
+    if(whole && stat(places[0].path.c_str(), &info) == 0 && samePlace(places[0], info)){
+        close(c->file);
+        c->file = -1;
+        if(unlink(c->partPath.c_str()) == 0 && link(places[0].path.c_str(), c->partPath.c_str()) == 0){
+            c->file = open(c->partPath.c_str(), O_RDONLY);
+        }
+        if(c->file != -1){
+            c->engine = Chunks;
+            c->transferred = c->dataLength;
+            queueResponse(c, ACK, Upload, (long)((n + 7) / 8));
+            c->response.append((n + 7) / 8, '\0');
+            return;
+        }
+        c->file = open(c->partPath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);    //chunks are copied then
+        if(c->file == -1){
+            cerr << "Unable to open file" << endl;
+            queueResponse(c, NACK, Closing);
+            return;
+        }
+    }
+
+    //known chunks are copied from their files, chunk whose file changed is received
+    int src = -1;
+    string srcPath;
+    vector<string> stale;
+    for(size_t i = 0; i < n; i++){
+        if(!known[i]){
+            continue;
+        }
+        if(src == -1 || places[i].path != srcPath){
+            if(src != -1){
+                close(src);
+            }
+            srcPath = places[i].path;
+            src = open(srcPath.c_str(), O_RDONLY);
+            if(src != -1 && (fstat(src, &info) != 0 || !samePlace(places[i], info))){
+                close(src);
+                src = -1;
+            }
+        }
+        Chunk &chunk = c->chunks[i];
+        if(src == -1 || !samePlace(places[i], info)
+           || copyChunk(src, places[i].offset, c->file, chunk.offset, chunk.length) == EXIT_FAILURE){
+            known[i] = false;
+            stale.push_back(chunk.hash);
+            continue;
+        }
+        c->transferred += chunk.length;
+    }
+    if(src != -1){
+        close(src);
+    }
+    if(!stale.empty()){
+        std::lock_guard<std::mutex> lock(chunkIndex->mtx);
+        for(const string &hash : stale){
+            chunkIndex->places.erase(hash);     //file stored with chunk again will add it back
+        }
+    }
+
+    //bit i set = client sends chunk i
+    string bitmap((n + 7) / 8, '\0');
+    c->missing.clear();
+    for(size_t i = 0; i < n; i++){
+        if(!known[i]){
+            bitmap[i / 8] |= (char)(1 << (i % 8));
+            c->missing.push_back(i);
+        }
+    }
+    c->engine = Chunks;
+    c->chunkNext = 0;
+    c->block.resize(CHUNK_MAX);
+    c->blockLen = 0;
+    queueResponse(c, ACK, Upload, (long) bitmap.size());
+    c->response.append(bitmap);
+}
+
+/**
+ * @description - Copy chunk between files, in kernel when possible (filesystem may share the extent)
+ * @param int src - file with chunk
+ * @param off_t from - offset of chunk in src
+ * @param int dst - uploaded file
+ * @param off_t to - offset of chunk in dst
+ * @param size_t len - length of chunk
+ * @return int - success = 0, failure = 1
+ */
+int copyChunk(int src, off_t from, int dst, off_t to, size_t len) {
+
+    char *buffer = threadBuffer();  //used just within this call
+    if(buffer == NULL){
+        return EXIT_FAILURE;
+    }
+
+    while(len > 0){
+#if ZEROCOPY
+        ssize_t copied = copy_file_range(src, &from, dst, &to, len, 0);
+        if(copied > 0){
+            len -= copied;
+            continue;
+        }
+        if(copied == 0 || (errno != EXDEV && errno != EINVAL && errno != ENOSYS && errno != EOPNOTSUPP)){
+            return EXIT_FAILURE;
+        }
+#endif
+        ssize_t bytes = pread(src, buffer, len < bufferSize() ? len : bufferSize(), from);
+        if(bytes <= 0){
+            return EXIT_FAILURE;
+        }
+        for(ssize_t written = 0; written < bytes; ){
+            ssize_t w = pwrite(dst, buffer + written, (size_t)(bytes - written), to);
+            if(w <= 0){
+                return EXIT_FAILURE;
+            }
+            written += w;
+            to += w;
+        }
+        from += bytes;
+        len -= bytes;
+    }
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Receive next missing chunk of deduplicated upload whole, check its hash and write it
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes chunkStep(Connection *c) {
+
+    Chunk &chunk = c->chunks[c->missing[c->chunkNext]];
+    bool complete;
+    StepRes res = receiveBytes(c, chunk.length, &complete);
+    if(res == Done){
+        finishUpload(c);
+        return Progress;
+    }
+    if(!complete){
+        return res;
+    }
+
+    unsigned char hash[CHUNK_HASH];
+    SHA256((const unsigned char *) c->block.data(), chunk.length, hash);
+    if(memcmp(hash, chunk.hash.data(), CHUNK_HASH) != 0){
+        cerr << "Chunk does not match its hash" << endl;
+        finishUpload(c);
+        return Progress;
+    }
+
+    for(size_t written = 0; written < chunk.length; ){
+        ssize_t bytes = pwrite(c->file, c->block.data() + written, chunk.length - written, chunk.offset + written);
+        if(bytes <= 0){
+            cerr << "Writing to file FAILED" << endl;
+            finishUpload(c);
+            return Progress;
+        }
+        written += bytes;
+    }
+    c->transferred += chunk.length;
+    c->chunkNext++;
+    c->blockLen = 0;
+    return Progress;
+}
+
+/**
+ * @description - Open old copy of uploaded file and compute signatures of its blocks
+ * @param Connection *c - connection to the client, path is name of uploaded file
+ * @param string &signatures - records of blocks in order of file, DELTA_RECORD bytes each
+ * @return int - success = 0, failure = 1 when there is no usable copy
+ */
+int signFile(Connection *c, string &signatures) {
+
+    int fd = open(c->path.c_str(), O_RDONLY);
+    struct stat info;
+    if(fd == -1 || fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0){
+        if(fd != -1){
+            close(fd);
+        }
+        return EXIT_FAILURE;
+    }
+    size_t block = deltaBlock((long) info.st_size);
+    size_t blocks = ((size_t) info.st_size + block - 1) / block;
+    if(blocks > DELTA_BLOCKS_MAX){
+        close(fd);
+        return EXIT_FAILURE;
+    }
+
+    //whole blocks are read at once, block may be bigger than small transfer buffer
+    char *buffer = threadBuffer();
+    size_t span = bufferSize() / block * block;
+    vector<char> own;
+    if(buffer == NULL || span == 0){
+        own.resize(block);
+        buffer = own.data();
+        span = block;
+    }
+    char record[DELTA_RECORD];
+    signatures.reserve(blocks * DELTA_RECORD);
+    for(off_t offset = 0; offset < info.st_size; ){
+        size_t len = info.st_size - offset < (off_t) span ? (size_t)(info.st_size - offset) : span;
+        for(size_t got = 0; got < len; ){
+            ssize_t bytes = pread(fd, buffer + got, len - got, offset + (off_t) got);
+            if(bytes <= 0){
+                cerr << "Reading from file FAILED" << endl;
+                close(fd);
+                return EXIT_FAILURE;
+            }
+            got += bytes;
+        }
+        for(size_t pos = 0; pos < len; pos += block){
+            size_t n = len - pos < block ? len - pos : block;
+            uint32_t weak = htobe32(weakSum(buffer + pos, n));
+            memcpy(record, &weak, 4);
+            strongSum(buffer + pos, n, (unsigned char *)(record + 4));
+            signatures.append(record, DELTA_RECORD);
+        }
+        offset += (off_t) len;
+    }
+
+    c->basis = fd;
+    c->basisBlock = block;
+    c->basisSize = info.st_size;
+    return EXIT_SUCCESS;
+}
+
+/**
+ * @description - Receive next instruction of delta upload whole and apply it to uploaded file
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes deltaStep(Connection *c) {
+
+    //header tells type and length of instruction
+    size_t need = DELTA_HEADER;
+    uint32_t first = 0, count = 0;
+    int type = 0;
+    if(c->blockLen >= DELTA_HEADER){
+        type = readDelta(c->block.data(), &first, &count);
+        if(type == DELTA_DATA && count <= DELTA_LITERAL){
+            need += count;
+        }
+    }
+
+    bool complete;
+    StepRes res = receiveBytes(c, need, &complete);
+    if(res == Done){
+        finishUpload(c);
+        return Progress;
+    }
+    if(!complete){
+        return res;
+    }
+    c->blockLen = 0;
+
+    //instruction can't write behind announced length
+    long left = c->dataLength - c->transferred;
+    long len = -1;
+    if(type == DELTA_COPY){
+        size_t blocks = ((size_t) c->basisSize + c->basisBlock - 1) / c->basisBlock;
+        off_t from = (off_t) first * (off_t) c->basisBlock;
+        if(count > 0 && first < blocks && count <= blocks - first){
+            len = (long) count * (long) c->basisBlock < c->basisSize - from ? (long) count * (long) c->basisBlock
+                                                                             : (long)(c->basisSize - from);
+        }
+        if(len > left || (len > 0 && copyChunk(c->basis, from, c->file, c->fileOff, (size_t) len) == EXIT_FAILURE)){
+            len = -1;
+        }
+    }
+    else if(type == DELTA_DATA && count > 0 && count <= DELTA_LITERAL && (long) count <= left){
+        len = (long) count;
+        for(long written = 0; written < len; ){
+            ssize_t bytes = pwrite(c->file, c->block.data() + DELTA_HEADER + written, (size_t)(len - written), c->fileOff + written);
+            if(bytes <= 0){
+                len = -1;
+                break;
+            }
+            written += bytes;
+        }
+    }
+    if(len <= 0){
+        cerr << "Invalid delta instruction" << endl;
+        finishUpload(c);
+        return Progress;
+    }
+    c->fileOff += len;
+    c->transferred += len;
+    return Progress;
+}
+
+/**
+ * @description - Remember chunks of stored file, chunk keeps file it was stored with first, so identical files are linked
+ * @param Connection *c - connection of finished deduplicated upload
+ * @param const struct stat &info - attributes of stored file
+ * @return void
+ */
+void indexChunks(Connection *c, const struct stat &info) {
+
+    std::lock_guard<std::mutex> lock(chunkIndex->mtx);
+    for(const Chunk &chunk : c->chunks){
+        auto it = chunkIndex->places.find(chunk.hash);
+        if(it == chunkIndex->places.end() ? chunkIndex->places.size() >= CHUNK_INDEX_MAX : it->second.path != c->path){
+            continue;   //index is full / chunk is in other file, new version of the same file replaces it
+        }
+        ChunkPlace &p = chunkIndex->places[chunk.hash];
+        p.path = c->path;
+        p.offset = chunk.offset;
+        p.length = chunk.length;
+        p.dev = info.st_dev;
+        p.ino = info.st_ino;
+        p.size = info.st_size;
+        p.mtime = info.st_mtim;
+    }
+}
+
+/**
+ * @description - Check whether file still holds chunks it was stored with
+ * @param const ChunkPlace &p - place of chunk
+ * @param const struct stat &info - current attributes of file
+ * @return bool - file was not changed nor replaced since it was stored
+ */
+bool samePlace(const ChunkPlace &p, const struct stat &info) {
+
+    return p.dev == info.st_dev && p.ino == info.st_ino && p.size == info.st_size
+           && p.mtime.tv_sec == info.st_mtim.tv_sec && p.mtime.tv_nsec == info.st_mtim.tv_nsec;
+}
+
+/**
+ * @description - Get mapping of file shared with its other downloads, file is mapped when none exists
+ * @param int fd - opened file
+ * @param const struct stat &info - attributes of opened file
+ * @return std::shared_ptr<Mapping> - mapping of whole file, NULL when it can't be mapped
+ */
+std::shared_ptr<Mapping> mapFile(int fd, const struct stat &info) {
+
+    lock_guard<std::mutex> lock(mappingMtx);
+
+    std::pair<dev_t, ino_t> key(info.st_dev, info.st_ino);
+    std::shared_ptr<Mapping> m = mappings[key].lock();
+    if(m && m->size == info.st_size && m->mtime.tv_sec == info.st_mtim.tv_sec
+       && m->mtime.tv_nsec == info.st_mtim.tv_nsec){
+        return m;
+    }
+
+    //file is read once from the beginning, kernel reads ahead aggressively
+    void *addr = mmap(NULL, (size_t) info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(addr == MAP_FAILED){
+        mappings.erase(key);
+        return NULL;
+    }
+    madvise(addr, (size_t) info.st_size, MADV_SEQUENTIAL);
+    madvise(addr, (size_t) info.st_size, MADV_WILLNEED);
+
+    Mapping *raw = new Mapping;
+    raw->dev = info.st_dev;
+    raw->ino = info.st_ino;
+    raw->size = info.st_size;
+    raw->mtime = info.st_mtim;
+    raw->addr = (char *) addr;
+    m = std::shared_ptr<Mapping>(raw, &unmapFile);  //older version stays mapped while it's being sent
+    mappings[key] = m;
+
+    //forget files whose downloads ended
+    for(std::map<std::pair<dev_t, ino_t>, std::weak_ptr<Mapping> >::iterator it = mappings.begin(); it != mappings.end(); ){
+        if(it->second.expired()){
+            mappings.erase(it++);
+        }
+        else{
+            ++it;
+        }
+    }
+    return m;
+}
+
+/**
+ * @description - Unmap file when its last download ended
+ * @param Mapping *m - mapping to be freed
+ * @return void
+ */
+void unmapFile(Mapping *m) {
+
+    munmap(m->addr, (size_t) m->size);
+    delete m;
+}
+
+/**
+ * @description - Create empty file cache
+ * @param size_t budget - max bytes of cached data, split among shards
+ * @return FileCache * - new cache
+ */
+FileCache *createCache(size_t budget) {
+
+    FileCache *fc = new FileCache;
+    fc->shardBudget = budget / CACHE_SHARDS;
+    for(int i = 0; i < CACHE_SHARDS; i++){
+        fc->shards[i].hand = 0;
+        fc->shards[i].bytes = 0;
+    }
+    return fc;
+}
+
+/**
+ * @description - Get content of small regular file from cache, file is read and cached on miss
+ * @param const string &name - name of file
+ * @param const struct stat &info - current attributes of file, cached content of other version is dropped
+ * @return std::shared_ptr<const string> - content of file, NULL when it can't be cached
+ */
+std::shared_ptr<const string> cacheGet(const string &name, const struct stat &info) {
+
+    CacheShard *sh = &fileCache->shards[std::hash<string>()(name) % CACHE_SHARDS];
+    if((size_t) info.st_size > fileCache->shardBudget){
+        return NULL;
+    }
+
+    {
+        lock_guard<std::mutex> lock(sh->mtx);
+        unordered_map<string, size_t>::iterator it = sh->index.find(name);
+        if(it != sh->index.end()){
+            CacheEntry &e = sh->ring[it->second];
+            if(sameVersion(e, info)){
+                e.referenced = true;
+                return e.data;
+            }
+            cacheRemove(sh, it->second);    //file was changed or replaced
+        }
+    }
+
+    //miss, file is read without holding the lock
+    int fd = open(name.c_str(), O_RDONLY);
+    if(fd == -1){
+        return NULL;
+    }
+    std::shared_ptr<string> data = std::make_shared<string>((size_t) info.st_size, '\0');
+    size_t done = 0;
+    while(done < data->size()){
+        ssize_t bytes = pread(fd, &(*data)[done], data->size() - done, (off_t) done);
+        if(bytes <= 0){
+            break;
+        }
+        done += (size_t) bytes;
+    }
+
+    //content is cached just when file did not change while it was read
+    struct stat after;
+    bool valid = done == data->size() && fstat(fd, &after) == 0;
+    close(fd);
+    CacheEntry entry;
+    entry.name = name;
+    entry.dev = info.st_dev;
+    entry.ino = info.st_ino;
+    entry.size = info.st_size;
+    entry.mtime = info.st_mtim;
+    entry.data = data;
+    entry.referenced = false;
+    if(!valid || !sameVersion(entry, after)){
+        return NULL;
+    }
+
+    lock_guard<std::mutex> lock(sh->mtx);
+    cacheInsert(sh, entry, fileCache->shardBudget);
+    return data;
+}
+
+/**
+ * @description - Add entry to shard, entries not hit since last pass of clock hand are evicted to make space
+ * @param CacheShard *sh - locked shard
+ * @param CacheEntry &entry - new entry
+ * @param size_t budget - max bytes of shard
+ * @return void
+ */
+void cacheInsert(CacheShard *sh, CacheEntry &entry, size_t budget) {
+
+    unordered_map<string, size_t>::iterator it = sh->index.find(entry.name);
+    if(it != sh->index.end()){
+        cacheRemove(sh, it->second);    //other thread cached it meanwhile
+    }
+
+    while(sh->bytes + entry.data->size() > budget && !sh->ring.empty()){
+        if(sh->hand >= sh->ring.size()){
+            sh->hand = 0;
+        }
+        CacheEntry &e = sh->ring[sh->hand];
+        if(e.referenced){
+            e.referenced = false;
+            sh->hand++;
+        }
+        else{
+            cacheRemove(sh, sh->hand);
+        }
+    }
+
+    sh->index[entry.name] = sh->ring.size();
+    sh->bytes += entry.data->size();
+    sh->ring.push_back(entry);
+}
+
+/**
+ * @description - Remove entry from shard, last entry of ring takes its position
+ * @param CacheShard *sh - locked shard
+ * @param size_t pos - position of entry in ring
+ * @return void
+ */
+void cacheRemove(CacheShard *sh, size_t pos) {
+
+    sh->bytes -= sh->ring[pos].data->size();
+    sh->index.erase(sh->ring[pos].name);
+    if(pos != sh->ring.size() - 1){
+        sh->ring[pos] = sh->ring.back();
+        sh->index[sh->ring[pos].name] = pos;
+    }
+    sh->ring.pop_back();
+}
+
+/**
+ * @description - Check whether cached content belongs to current version of file
+ * @param const CacheEntry &e - cached entry
+ * @param const struct stat &info - current attributes of file
+ * @return bool - file was not changed nor replaced since it was cached
+ */
+bool sameVersion(const CacheEntry &e, const struct stat &info) {
+
+    return e.dev == info.st_dev && e.ino == info.st_ino && e.size == info.st_size
+           && e.mtime.tv_sec == info.st_mtim.tv_sec && e.mtime.tv_nsec == info.st_mtim.tv_nsec;
+}
+
+/**
+ * @description - Run next batch of io_uring transfer, blocking threads wait for it, event loops are woken by completion
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes ringStep(Connection *c) {
+#if URING
+    UringTransfer *t = &c->ring;
+
+    if(loopRing == NULL){
+        Uring *r = threadRing();
+        if(r == NULL){  //io_uring is not available, continue by other engine
+            c->engine = c->phase == Upload ? defaultEngine(false) : defaultEngine(true);
+            return Progress;
+        }
+        int res = uringStep(r, t);
+        c->transferred = c->dataLength - t->length + t->done;
+        if(res != 0){
+            uringRelease(r, t);
+            return ringFailed(c);
+        }
+        return Progress;
+    }
+
+    if(t->pending > 0 || c->ringWaiting){  //batch in flight or waiting for buffers
+        return Blocked;
+    }
+    if(t->failed){
+        uringRelease(&loopRing->ring, t);
+        return ringFailed(c);
+    }
+    if(uringStart(&loopRing->ring, t) == 0){
+        c->ringWaiting = true;
+        loopRing->waiting.push_back(c);
+    }
+    return Blocked;     //batch is submitted at the end of loop's iteration
+#else
+    c->engine = Copy;
+    return Progress;
+#endif
+}
+
+/**
+ * @description - End transfer which failed in io_uring
+ * @param Connection *c - connection to the client
+ * @return StepRes - result of step
+ */
+StepRes ringFailed(Connection *c) {
+
+    if(c->phase == Upload){
+        cerr << "Receiving data FAILED" << endl;
+        finishUpload(c);
+        return Progress;
+    }
+    cerr << "Not entire data sent: " << c->transferred << " - " << c->dataLength << endl;
+    return Done;
+}
+
+/**
+ * @description - Read monotonic clock for metrics
+ * @return uint64_t - nanoseconds
+ */
+uint64_t nowNs() {
+
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + (uint64_t) ts.tv_nsec;
+}
+
+/**
+ * @description - Get metrics of calling thread, they are created and registered by its first call
+ * @return Metrics * - metrics written just by this thread
+ */
+Metrics *threadMetrics() {
+
+    static thread_local Metrics *m = NULL;
+    if(m == NULL){
+        m = new Metrics();  //value initialized, all zeros; never freed, threads of server live till its end
+        std::lock_guard<std::mutex> lock(metricsMtx);
+        allMetrics.push_back(m);
+    }
+    return m;
+}
+
+/**
+ * @description - Add to counter of calling thread, plain load and store as no other thread writes it
+ * @param Counter which - counter
+ * @param uint64_t n - value to be added
+ * @return void
+ */
+void countMetric(Counter which, uint64_t n) {
+
+    if(!metricsOn){
+        return;
+    }
+    std::atomic<uint64_t> &value = threadMetrics()->counters[which];
+    value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/**
+ * @description - Record time elapsed since start to histogram of calling thread
+ * @param Latency which - histogram
+ * @param uint64_t start - nowNs() at the beginning, 0 = nothing is recorded
+ * @return void
+ */
+void recordLatency(Latency which, uint64_t start) {
+
+    if(!metricsOn || start == 0){
+        return;
+    }
+    uint64_t ns = nowNs() - start;
+
+    //values below HIST_SUB have own buckets, others share bucket with values of the same leading 4 bits
+    size_t bucket = (size_t) ns;
+    if(ns >= HIST_SUB){
+        int exp = 63 - __builtin_clzll(ns);
+        bucket = (size_t)(exp - 2) * HIST_SUB + (size_t)((ns >> (exp - 3)) & (HIST_SUB - 1));
+    }
+
+    Histogram &h = threadMetrics()->latencies[which];
+    h.buckets[bucket].store(h.buckets[bucket].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    h.count.store(h.count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    h.sum.store(h.sum.load(std::memory_order_relaxed) + ns, std::memory_order_relaxed);
+}
+
+/**
+ * @description - Sum metrics of all threads and format them in Prometheus text format
+ * @return string - body of metrics response
+ */
+string metricsText() {
+
+    static const char *counterNames[COUNTERS][2] = {
+        {"server_accepted_connections_total", "Accepted connections"},
+        {"server_rejected_connections_total", "Connections rejected as overloaded"},
+        {"server_upload_requests_total", "Upload requests"},
+        {"server_download_requests_total", "Download requests"},
+        {"server_received_bytes_total", "Bytes of uploaded files"},
+        {"server_sent_bytes_total", "Bytes of downloaded files"},
+        {"server_sync_batches_total", "Flushes of uploaded files, one flushes more uploads in group mode"}
+    };
+    static const char *latencyNames[LATENCIES][2] = {
+        {"server_admission_wait_seconds", "Time accepted connection waits for worker thread"},
+        {"server_request_handling_seconds", "Time to parse request and prepare response"},
+        {"server_first_byte_seconds", "Time from complete request to first byte of response"},
+        {"server_upload_seconds", "Time from complete request to end of upload"},
+        {"server_download_seconds", "Time from complete request to end of download"},
+        {"server_sync_seconds", "Time from complete upload to upload being durable"}
+    };
+    static const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+
+    uint64_t counters[COUNTERS] = {0};
+    uint64_t responses[REQANS] = {0};
+    vector<uint64_t> buckets(LATENCIES * HIST_BUCKETS, 0);
+    uint64_t count[LATENCIES] = {0}, sum[LATENCIES] = {0};
+    {
+        std::lock_guard<std::mutex> lock(metricsMtx);
+        for(Metrics *m : allMetrics){
+            for(int i = 0; i < COUNTERS; i++){
+                counters[i] += m->counters[i].load(std::memory_order_relaxed);
+            }
+            for(int i = 0; i < REQANS; i++){
+                responses[i] += m->responses[i].load(std::memory_order_relaxed);
+            }
+            for(int i = 0; i < LATENCIES; i++){
+                for(int b = 0; b < HIST_BUCKETS; b++){
+                    buckets[i * HIST_BUCKETS + b] += m->latencies[i].buckets[b].load(std::memory_order_relaxed);
+                }
+                count[i] += m->latencies[i].count.load(std::memory_order_relaxed);
+                sum[i] += m->latencies[i].sum.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    ostringstream out;
+    for(int i = 0; i < COUNTERS; i++){
+        out << "# HELP " << counterNames[i][0] << " " << counterNames[i][1] << "\n";
+        out << "# TYPE " << counterNames[i][0] << " counter\n";
+        out << counterNames[i][0] << " " << counters[i] << "\n";
+    }
+    out << "# HELP server_responses_total Responses by code of protocol\n";
+    out << "# TYPE server_responses_total counter\n";
+    for(int i = ACK; i <= Overloaded; i++){
+        out << "server_responses_total{code=\"" << i << "\"} " << responses[i] << "\n";
+    }
+    out << "# HELP server_active_connections Connections opened at the moment\n";
+    out << "# TYPE server_active_connections gauge\n";
+    out << "server_active_connections " << activeConnections.load(std::memory_order_relaxed) << "\n";
+
+    //quantile is upper bound of bucket where it falls, so it is at most 12.5 % above real value
+    for(int i = 0; i < LATENCIES; i++){
+        out << "# HELP " << latencyNames[i][0] << " " << latencyNames[i][1] << "\n";
+        out << "# TYPE " << latencyNames[i][0] << " summary\n";
+        for(double q : quantiles){
+            uint64_t rank = (uint64_t)(q * (double) count[i] + 0.5);
+            uint64_t seen = 0;
+            uint64_t bound = 0;
+            for(int b = 0; b < HIST_BUCKETS && count[i] > 0; b++){
+                seen += buckets[i * HIST_BUCKETS + b];
+                if(seen >= rank && seen > 0){
+                    bound = b < HIST_SUB ? (uint64_t) b + 1
+                                         : (uint64_t)(HIST_SUB + b % HIST_SUB + 1) << (b / HIST_SUB - 1);
+                    break;
+                }
+            }
+            out << latencyNames[i][0] << "{quantile=\"" << q << "\"} " << (double) bound / 1e9 << "\n";
+        }
+        out << latencyNames[i][0] << "_sum " << (double) sum[i] / 1e9 << "\n";
+        out << latencyNames[i][0] << "_count " << count[i] << "\n";
+    }
+    return out.str();
+}
+
+/**
+ * @description - Create listening socket of metrics endpoint, just local clients can connect
+ * @param unsigned short int port - port of metrics endpoint
+ * @return int - listening socket, -1 on failure
+ */
+int createMetricsListener(unsigned short int port) {
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if(listener == -1){
+        cerr << "Opening metrics socket FAILED" << endl;
+        return -1;
+    }
+    int yes = 1;
+    setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, (void *)&yes, sizeof(yes));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    if(bind(listener, (struct sockaddr *) &addr, sizeof(addr)) == -1 || listen(listener, 16) == -1){
+        cerr << "Binding metrics socket FAILED" << endl;
+        close(listener);
+        return -1;
+    }
+    return listener;
+}
+
+/**
+ * @description - Answer every connection of metrics endpoint by HTTP response with current metrics
+ * @param int listener - listening socket of metrics endpoint
+ * @return void
+ */
+void metricsThread(int listener) {
+
+    while(1){
+        int client = accept(listener, NULL, NULL);
+        if(client < 0){
+            continue;
+        }
+
+        //request is read just to be answered, any path gets metrics
+        struct timeval timeout = {1, 0};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, (void *)&timeout, sizeof(timeout));
+        char request[MAX_BUFF_SIZE];
+        recv(client, request, sizeof(request), 0);
+
+        string body = metricsText();
+        ostringstream response;
+        response << "HTTP/1.0 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " << body.size()
+                 << "\r\nConnection: close\r\n\r\n" << body;
+        string msg = response.str();
+        for(size_t sent = 0; sent < msg.size(); ){
+            ssize_t bytes = send(client, msg.data() + sent, msg.size() - sent, 0);
+            if(bytes <= 0){
+                break;
+            }
+            sent += (size_t) bytes;
+        }
+        close(client);
+    }
+}
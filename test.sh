@@ -37,11 +37,47 @@ echo "This is content of a file, which will be downloaded" > fileToDownload
 
 
 
-#run server
-./server -p 12241 &
+#start server in the current folder and wait until it listens, its PID is in TASK_PID
+#   $1 - port, other arguments are options of server
+startServer() {
+    ./server -p "$@" &
+
+    TASK_PID=$!
+    echo "running server $*: $TASK_PID"
+
+    #port is listening when /proc lists it in state 0A, connection would be served as client
+    local port=$(printf ":%04X " $1)
+    for i in $(seq 50); do
+        if grep -q "$port[0-9A-F:]* 0A " /proc/net/tcp /proc/net/tcp6 2>/dev/null; then
+            return 0
+        fi
+        sleep 0.1
+    done
+    echo "Testing terminated, because server did not start"
+    kill $TASK_PID
+    exit 1
+}
+
+#kill server started by startServer and wait until its port is free
+stopServer() {
+    kill $TASK_PID #>/dev/null
+    wait $TASK_PID 2>/dev/null
+}
+
+#compare transferred file with original one, testing is terminated when they differ
+#   $1 - transferred file, $2 - original file
+compareFiles() {
+    cmp "$1" "$2"
+    if [ $? -ne 0 ]; then
+        echo "Testing terminated, because $1 differs from $2"
+        stopServer
+        exit 1
+    fi
+}
 
-TASK_PID=$!
-echo "running server: $TASK_PID"
+
+#run server
+startServer 12241
 
 
 #run tests
@@ -92,7 +128,439 @@ cd ../
 
 
 #kill server process
-kill $TASK_PID #>/dev/null
+stopServer
+
+
+#run event driven server
+startServer 12242 -e
+
+cd ./clientDir/
+rm -f fileToDownload
+
+#run test
+echo "----TEST 04: Download fileToDownload file from event driven server"
+./client -p 12242 -h 127.0.0.1 -d fileToDownload
+compareFiles fileToDownload ../fileToDownload
+echo "----TEST 04 completed"
+echo "---------------------"
+
+echo "----TEST 05: Upload fileToDownload file to event driven server by io_uring"
+./client -p 12242 -h 127.0.0.1 -u fileToDownload -i
+echo "----TEST 05 completed"
+echo "---------------------"
+
+echo "----TEST 06: Upload and download more files over one persistent connection"
+./client -p 12242 -h 127.0.0.1 -u fileToDownload -d fileToTransport -d fileToDownload -j 1
+echo "----TEST 06 completed"
+echo "---------------------"
+
+echo "----TEST 07: Upload whole testFolder directory by two parallel connections"
+./client -p 12242 -h 127.0.0.1 -D ../testFolder -j 2
+echo "----TEST 07 completed"
+echo "---------------------"
+
+echo "----TEST 08: Download fileToDownload file by ranged requests of more streams"
+./client -p 12242 -h 127.0.0.1 -d fileToDownload -s 4
+echo "----TEST 08 completed"
+echo "---------------------"
+
+echo "----TEST 09: Resume upload and download of fileToDownload file"
+./client -p 12242 -h 127.0.0.1 -u fileToDownload -r
+./client -p 12242 -h 127.0.0.1 -d fileToDownload -r
+echo "----TEST 09 completed"
+echo "---------------------"
+
+cd ../
+
+
+#kill server process
+stopServer
+
+
+#run load generator, it starts its own server in benchData directory
+make loadgen >/dev/null
+
+echo "----TEST 10: Benchmark event driven server by load generator"
+./loadgen -p 12250 -c 2 -n 5 -z 1K,64K -k
+echo "----TEST 10 completed"
+echo "---------------------"
+
+
+#create folder for servers of following tests, transferred files are compared with the ones there
+if [ -d "serverDir" ]; then
+    rm -r serverDir
+fi
+
+mkdir -p serverDir
+if [ $? -ne 0 ]; then
+    echo "Testing terminated, because serverDir folder was not created, probably because of rights"
+    exit 1
+fi
+
+cp server ./serverDir/      #copy server to the folder
+cp fileToDownload ./serverDir/
+head -c 1000000 /dev/urandom > ./serverDir/bigFile
+head -c 300000 /dev/urandom > ./clientDir/uploadFile
+
+
+#run server with pool of worker threads
+cd ./serverDir/
+startServer 12243 -t 2 -q 4
+cd ../clientDir/
+
+#run test
+echo "----TEST 11: Upload and download files by more connections than workers of server"
+./client -p 12243 -h 127.0.0.1 -u uploadFile -d bigFile -d fileToDownload -j 4 -P 1
+compareFiles uploadFile ../serverDir/uploadFile
+compareFiles bigFile ../serverDir/bigFile
+echo "----TEST 11 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server for binary requests
+cd ./serverDir/
+startServer 12244 -e
+cd ../clientDir/
+rm -f bigFile fileToDownload
+
+#run test
+echo "----TEST 12: Download and upload files by pipelined binary requests over one connection"
+./client -p 12244 -h 127.0.0.1 -d bigFile -d fileToDownload -u uploadFile -j 1 -P 4
+compareFiles bigFile ../serverDir/bigFile
+compareFiles fileToDownload ../serverDir/fileToDownload
+compareFiles uploadFile ../serverDir/uploadFile
+echo "----TEST 12 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server caching small files
+cd ./serverDir/
+startServer 12245 -e -c 16
+cd ../clientDir/
+rm -f fileToDownload
+
+#run test
+echo "----TEST 13: Download cached file, replace it by upload and download it again"
+./client -p 12245 -h 127.0.0.1 -d fileToDownload
+./client -p 12245 -h 127.0.0.1 -d fileToDownload
+compareFiles fileToDownload ../serverDir/fileToDownload
+echo "This is changed content of a file, which must not be served from cache" > fileToDownload
+./client -p 12245 -h 127.0.0.1 -u fileToDownload
+mv fileToDownload changedFile
+./client -p 12245 -h 127.0.0.1 -d fileToDownload
+compareFiles fileToDownload changedFile
+echo "----TEST 13 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server sending files from memory mappings
+cd ./serverDir/
+head -c 20000000 /dev/urandom > largeFile
+startServer 12246 -e -m
+cd ../clientDir/
+rm -f bigFile
+
+#run test
+echo "----TEST 14: Download files from shared memory mappings, largeFile by more streams"
+./client -p 12246 -h 127.0.0.1 -d largeFile -s 4
+compareFiles largeFile ../serverDir/largeFile
+./client -p 12246 -h 127.0.0.1 -d bigFile
+compareFiles bigFile ../serverDir/bigFile
+echo "----TEST 14 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server compressing downloads
+cd ./serverDir/
+startServer 12247 -e -z 6
+cd ../clientDir/
+seq 1 200000 > textFile
+
+#run test
+echo "----TEST 15: Upload and download textFile file compressed by deflate"
+./client -p 12247 -h 127.0.0.1 -u textFile -z 6
+compareFiles textFile ../serverDir/textFile
+mv textFile originalFile
+./client -p 12247 -h 127.0.0.1 -d textFile -z 6
+compareFiles textFile originalFile
+echo "----TEST 15 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server for verified transfers
+cd ./serverDir/
+startServer 12248 -e
+cd ../clientDir/
+rm -f bigFile
+head -c 500000 /dev/urandom > checkedFile
+
+#run test
+echo "----TEST 16: Upload and download files verified by CRC32C checksums"
+./client -p 12248 -h 127.0.0.1 -u checkedFile -c
+compareFiles checkedFile ../serverDir/checkedFile
+./client -p 12248 -h 127.0.0.1 -d bigFile -c
+compareFiles bigFile ../serverDir/bigFile
+rm -f bigFile
+./client -p 12248 -h 127.0.0.1 -d bigFile -d checkedFile -c
+compareFiles bigFile ../serverDir/bigFile
+echo "----TEST 16 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server for deduplicated uploads
+cd ./serverDir/
+startServer 12249 -e
+cd ../clientDir/
+head -c 2000000 /dev/urandom > dedupFile
+cp dedupFile sameFile
+(echo "new beginning"; cat dedupFile) > shiftedFile
+
+#run test
+echo "----TEST 17: Upload files sharing chunks with already stored file, then replace one of them"
+./client -p 12249 -h 127.0.0.1 -u dedupFile -x
+./client -p 12249 -h 127.0.0.1 -u sameFile -x
+./client -p 12249 -h 127.0.0.1 -u shiftedFile -x
+compareFiles dedupFile ../serverDir/dedupFile
+compareFiles sameFile ../serverDir/sameFile
+compareFiles shiftedFile ../serverDir/shiftedFile
+head -c 1000 /dev/urandom > sameFile
+./client -p 12249 -h 127.0.0.1 -u sameFile
+compareFiles sameFile ../serverDir/sameFile
+compareFiles dedupFile ../serverDir/dedupFile
+echo "----TEST 17 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server for delta uploads
+cd ./serverDir/
+startServer 12251 -e
+cd ../clientDir/
+head -c 2000000 /dev/urandom > deltaFile
+
+#run test
+echo "----TEST 18: Upload deltaFile file, change its middle and end and upload just the differences"
+./client -p 12251 -h 127.0.0.1 -u deltaFile
+echo "changed block" | dd of=deltaFile bs=1 seek=1000000 conv=notrunc 2>/dev/null
+echo "appended line" >> deltaFile
+./client -p 12251 -h 127.0.0.1 -u deltaFile -y
+compareFiles deltaFile ../serverDir/deltaFile
+echo "----TEST 18 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server serving metrics
+cd ./serverDir/
+startServer 12252 -e -M 12253
+cd ../clientDir/
+
+#run test
+echo "----TEST 19: Read metrics of server after upload and download"
+./client -p 12252 -h 127.0.0.1 -u uploadFile -d fileToDownload
+exec 3<>/dev/tcp/127.0.0.1/12253
+printf "GET /metrics HTTP/1.0\r\n\r\n" >&3
+grep "^server_upload_requests_total\|^server_download_requests_total\|^server_received_bytes_total" <&3
+exec 3<&-
+echo "----TEST 19 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server with small transfer buffers
+cd ./serverDir/
+startServer 12254 -e -B 64
+cd ../clientDir/
+rm -f bigFile
+head -c 700000 /dev/urandom > bufferedFile
+
+#run test
+echo "----TEST 20: Upload and download files by transfer buffers of different sizes"
+./client -p 12254 -h 127.0.0.1 -u bufferedFile -B 4096
+compareFiles bufferedFile ../serverDir/bufferedFile
+./client -p 12254 -h 127.0.0.1 -d bigFile -B 1024
+compareFiles bigFile ../serverDir/bigFile
+echo "----TEST 20 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server sending archives
+cd ./serverDir/
+for i in 1 2 3 4 5; do
+    echo "This is tiny file number $i" > tiny$i.txt
+done
+startServer 12255 -e
+cd ../clientDir/
+mkdir -p archiveDir
+cd ./archiveDir/
+
+#run test
+echo "----TEST 21: Download tiny files by one archive stream, selected by pattern and by list"
+../client -p 12255 -h 127.0.0.1 -a 'tiny*.txt'
+for i in 1 2 3 4 5; do
+    compareFiles tiny$i.txt ../../serverDir/tiny$i.txt
+done
+rm -f tiny*.txt
+printf "tiny2.txt\nbigFile\n" | ../client -p 12255 -h 127.0.0.1 -A -
+compareFiles tiny2.txt ../../serverDir/tiny2.txt
+compareFiles bigFile ../../serverDir/bigFile
+echo "----TEST 21 completed"
+echo "---------------------"
+
+cd ../../
+stopServer
+
+
+#run event driven server flushing uploads in groups, then server with pool of workers flushing each upload
+cd ./serverDir/
+startServer 12256 -e -f group
+cd ../clientDir/
+for i in 1 2 3 4; do
+    head -c 100000 /dev/urandom > durableFile$i
+done
+
+#run test
+echo "----TEST 22: Upload files ACKed when durable, flushed in group and one by one"
+./client -p 12256 -h 127.0.0.1 -u durableFile1 -u durableFile2 -u durableFile3 -j 3
+for i in 1 2 3; do
+    compareFiles durableFile$i ../serverDir/durableFile$i
+done
+cd ../serverDir/
+stopServer
+startServer 12257 -t 2 -f file
+cd ../clientDir/
+./client -p 12257 -h 127.0.0.1 -u durableFile4
+compareFiles durableFile4 ../serverDir/durableFile4
+echo "----TEST 22 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server limiting downloads
+cd ./serverDir/
+startServer 12258 -e -R 32768 -r 16384
+cd ../clientDir/
+rm -f largeFile bigFile
+
+#run test
+echo "----TEST 23: Download files by two connections sharing rate limit 16 MiB/s of one client"
+./client -p 12258 -h 127.0.0.1 -d largeFile -d bigFile -j 2
+compareFiles largeFile ../serverDir/largeFile
+compareFiles bigFile ../serverDir/bigFile
+echo "----TEST 23 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server for transfers of coroutine engine
+cd ./serverDir/
+startServer 12259 -e
+cd ../clientDir/
+rm -f bigFile fileToDownload
+for i in 1 2 3 4 5 6 7 8; do
+    head -c $((i * 30000)) /dev/urandom > asyncFile$i
+    echo "u asyncFile$i" >> asyncManifest
+done
+echo "d bigFile" >> asyncManifest
+echo "d fileToDownload" >> asyncManifest
+
+#run test
+echo "----TEST 24: Transfer files listed in manifest by coroutines, four of them at once"
+./client -p 12259 -h 127.0.0.1 -C 4 -l asyncManifest
+for i in 1 2 3 4 5 6 7 8; do
+    compareFiles asyncFile$i ../serverDir/asyncFile$i
+done
+compareFiles bigFile ../serverDir/bigFile
+compareFiles fileToDownload ../serverDir/fileToDownload
+echo "----TEST 24 completed"
+echo "---------------------"
+
+cd ../
+stopServer
+
+
+#run event driven server for program using client library
+cd ./serverDir/
+startServer 12260 -e
+cd ../clientDir/
+rm -f bigFile
+
+#program built as C++11 uploads and downloads memory and files by pool of client library
+cat > libraryTest.cpp << 'EOF_PROGRAM'
+#include <iostream>
+#include <atomic>
+#include "clientlib.h"
+
+int main() {
+    std::atomic<int> failed(0);
+    TransferCallback check = [&failed](const TransferResult &res){
+        std::cout << res.name << ": " << res.size << " bytes, " << (res.error == NULL ? "OK" : res.error) << std::endl;
+        if(res.error != NULL){ failed++; }
+    };
+    std::string data(100000, 'x');
+    std::string copy;
+    ClientPool *pool = poolCreate("127.0.0.1", 12260, 4, 2);
+    if(pool == NULL){
+        return 1;
+    }
+    poolPut(pool, "memoryFile", data.data(), data.size(), check);
+    poolUpload(pool, "uploadFile", check);
+    poolDownload(pool, "bigFile", check);
+    poolWait(pool);
+    poolGet(pool, "memoryFile", &copy, check);
+    poolDestroy(pool);
+    return failed == 0 && copy == data ? 0 : 1;
+}
+EOF_PROGRAM
+g++ -std=c++11 -pthread -I.. libraryTest.cpp ../libclient.a -o libraryTest
+
+#run test
+echo "----TEST 25: Transfer memory and files by program using client library"
+./libraryTest
+if [ $? -ne 0 ]; then
+    echo "Testing terminated, because program using client library failed"
+    cd ../
+    stopServer
+    exit 1
+fi
+compareFiles uploadFile ../serverDir/uploadFile
+compareFiles bigFile ../serverDir/bigFile
+echo "----TEST 25 completed"
+echo "---------------------"
+
+cd ../
+stopServer
 
 
 #clean all created files
@@ -100,5 +568,6 @@ make clean >/dev/null
 
 rm -r testFolder
 rm -r clientDir
+rm -r serverDir
 rm fileToTransport
 rm fileToDownload
@@ -0,0 +1,499 @@
+/**
+ * Task: Client/Server - File Transmissions
+ * Description: io_uring transfer backend shared by client and server
+ */
+
+#ifndef URING_H
+#define URING_H
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <vector>
+
+#include "checksum.h"
+
+#define URING_SLOTS 8                   //buffers in flight per transfer
+#define URING_BUFF_SIZE (128 * 1024)    //size of one registered buffer
+
+/*One submitted operation, its address is user_data of the sqe*/
+struct UringOp{
+    struct UringTransfer *owner;    //transfer the operation belongs to
+    int res;                        //result from cqe
+};
+
+/*State of one file <-> socket transfer driven by io_uring*/
+struct UringTransfer{
+    int in;                         //descriptor data are read from
+    int out;                        //descriptor data are written to
+    bool inSocket;                  //input is socket (recv), otherwise file at inOff
+    bool outSocket;                 //output is socket (send), otherwise file at outOff
+    off_t inOff;                    //offset of next read from file
+    off_t outOff;                   //offset of next write to file
+    long left;                      //bytes not yet requested from input
+    long done;                      //bytes written to output
+    long length;                    //bytes of whole transfer
+    int carryBuf;                   //buffer with data read but not written, -1 if none
+    size_t carryOff;                //offset of those data in the buffer
+    size_t carryLen;                //length of those data
+    unsigned slots;                 //read/write pairs in flight
+    bool carryQueued;               //batch starts with write of carried data
+    int buf[URING_SLOTS];           //buffer of each pair
+    size_t len[URING_SLOTS];        //requested length of each pair
+    UringOp ops[2 * URING_SLOTS + 1];
+    unsigned pending;               //operations without completion
+    bool failed;                    //some operation failed
+    void *user;                     //owner of transfer, f.e.: connection
+    uint32_t *crc;                  //checksum updated by data in order they were read, NULL if not computed
+};
+
+/*Submission/completion rings mapped from kernel and pool of registered buffers*/
+struct Uring{
+    int fd;
+    unsigned sqEntries;
+    unsigned *sqHead, *sqTail, *sqMask, *sqArray;
+    unsigned *cqHead, *cqTail, *cqMask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sqRing, *cqRing;
+    size_t sqRingLen, cqRingLen, sqesLen;
+    unsigned localTail;             //tail of sqes prepared but not published
+    unsigned toSubmit;              //sqes prepared since last submit
+    char *buffers;                  //bufCount buffers of bufSize bytes
+    size_t bufSize;
+    unsigned bufCount;
+    bool fixed;                     //buffers are registered, READ/WRITE_FIXED can be used
+    std::vector<int> freeBufs;
+};
+
+/**
+ * @description - Set up io_uring instance and register pool of buffers
+ * @param Uring *r - ring to be initialized
+ * @param unsigned entries - size of submission queue
+ * @param unsigned bufCount - number of buffers in pool
+ * @param size_t bufSize - size of one buffer
+ * @return int - success = 0, failure = 1
+ */
+static inline int uringInit(Uring *r, unsigned entries, unsigned bufCount, size_t bufSize) {
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->toSubmit = 0;
+    r->freeBufs.clear();
+
+    r->fd = (int) syscall(__NR_io_uring_setup, entries, &p);
+    if(r->fd < 0){
+        return 1;
+    }
+    r->sqEntries = p.sq_entries;
+
+    //map rings, both may share one mapping
+    r->sqRingLen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cqRingLen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        if(r->cqRingLen > r->sqRingLen){ r->sqRingLen = r->cqRingLen; }
+        r->cqRingLen = r->sqRingLen;
+    }
+    r->sqRing = mmap(NULL, r->sqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if(r->sqRing == MAP_FAILED){
+        close(r->fd);
+        return 1;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP){
+        r->cqRing = r->sqRing;
+    }
+    else{
+        r->cqRing = mmap(NULL, r->cqRingLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if(r->cqRing == MAP_FAILED){
+            munmap(r->sqRing, r->sqRingLen);
+            close(r->fd);
+            return 1;
+        }
+    }
+    r->sqesLen = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = (struct io_uring_sqe *) mmap(NULL, r->sqesLen, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if(r->sqes == MAP_FAILED){
+        if(r->cqRing != r->sqRing){ munmap(r->cqRing, r->cqRingLen); }
+        munmap(r->sqRing, r->sqRingLen);
+        close(r->fd);
+        return 1;
+    }
+
+    char *sq = (char *) r->sqRing;
+    char *cq = (char *) r->cqRing;
+    r->sqHead = (unsigned *)(sq + p.sq_off.head);
+    r->sqTail = (unsigned *)(sq + p.sq_off.tail);
+    r->sqMask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sqArray = (unsigned *)(sq + p.sq_off.array);
+    r->cqHead = (unsigned *)(cq + p.cq_off.head);
+    r->cqTail = (unsigned *)(cq + p.cq_off.tail);
+    r->cqMask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    r->localTail = *r->sqTail;
+
+    //buffers are registered, kernel doesn't have to map them for every operation
+    r->bufSize = bufSize;
+    r->bufCount = bufCount;
+    r->buffers = (char *) mmap(NULL, bufCount * bufSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(r->buffers == MAP_FAILED){
+        munmap(r->sqes, r->sqesLen);
+        if(r->cqRing != r->sqRing){ munmap(r->cqRing, r->cqRingLen); }
+        munmap(r->sqRing, r->sqRingLen);
+        close(r->fd);
+        return 1;
+    }
+    std::vector<struct iovec> iovs(bufCount);
+    for(unsigned i = 0; i < bufCount; i++){
+        iovs[i].iov_base = r->buffers + i * bufSize;
+        iovs[i].iov_len = bufSize;
+        r->freeBufs.push_back((int) i);
+    }
+    r->fixed = syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_BUFFERS, iovs.data(), bufCount) == 0;
+    return 0;
+}
+
+/**
+ * @description - Tear down io_uring instance and its buffers
+ * @param Uring *r - initialized ring
+ * @return void
+ */
+static inline void uringFree(Uring *r) {
+
+    munmap(r->buffers, r->bufCount * r->bufSize);
+    munmap(r->sqes, r->sqesLen);
+    if(r->cqRing != r->sqRing){ munmap(r->cqRing, r->cqRingLen); }
+    munmap(r->sqRing, r->sqRingLen);
+    close(r->fd);
+    r->freeBufs.clear();
+}
+
+/**
+ * @description - Create eventfd signalled on every completion, so ring can be watched by epoll
+ * @param Uring *r - initialized ring
+ * @return int - non-blocking eventfd, -1 on failure
+ */
+static inline int uringEventFd(Uring *r) {
+
+    int efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(efd == -1){
+        return -1;
+    }
+    if(syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_EVENTFD, &efd, 1) != 0){
+        close(efd);
+        return -1;
+    }
+    return efd;
+}
+
+/**
+ * @description - Get free submission queue entry, it's published by uringSubmit
+ * @param Uring *r - initialized ring
+ * @return struct io_uring_sqe * - cleared entry, NULL when queue is full
+ */
+static inline struct io_uring_sqe *uringSqe(Uring *r) {
+
+    unsigned head = __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE);
+    if(r->localTail - head >= r->sqEntries){
+        return NULL;
+    }
+    unsigned index = r->localTail & *r->sqMask;
+    struct io_uring_sqe *sqe = &r->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    r->sqArray[index] = index;
+    r->localTail++;
+    r->toSubmit++;
+    return sqe;
+}
+
+/**
+ * @description - Submit prepared entries and optionally wait for completions
+ * @param Uring *r - initialized ring
+ * @param unsigned wait - number of completions to wait for
+ * @return int - success = 0, failure = 1
+ */
+static inline int uringSubmit(Uring *r, unsigned wait) {
+
+    __atomic_store_n(r->sqTail, r->localTail, __ATOMIC_RELEASE);
+    do{
+        //kernel waits only when all entries were submitted, otherwise submit the rest again
+        int ret = (int) syscall(__NR_io_uring_enter, r->fd, r->toSubmit, wait, wait > 0 ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+        if(ret < 0){
+            if(errno == EINTR){ continue; }
+            return 1;
+        }
+        if(ret == 0 && r->toSubmit > 0){
+            return 1;
+        }
+        r->toSubmit -= (unsigned) ret;
+    } while(r->toSubmit > 0);
+    return 0;
+}
+
+/**
+ * @description - Fill submission entry with read or write of part of buffer
+ * @param Uring *r - initialized ring
+ * @param struct io_uring_sqe *sqe - entry to be filled
+ * @param bool write - write operation, otherwise read
+ * @param bool socket - descriptor is socket, send/recv waiting for whole length is used
+ * @param int fd - descriptor
+ * @param off_t off - offset in file
+ * @param int buf - index of buffer
+ * @param size_t bufOff - offset in buffer
+ * @param size_t len - length of data
+ * @param UringOp *op - result of operation is stored here
+ * @return void
+ */
+static inline void uringPrep(Uring *r, struct io_uring_sqe *sqe, bool write, bool socket, int fd, off_t off,
+                             int buf, size_t bufOff, size_t len, UringOp *op) {
+
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)(r->buffers + (size_t) buf * r->bufSize + bufOff);
+    sqe->len = (unsigned) len;
+    sqe->user_data = (uint64_t)(uintptr_t) op;
+    if(socket){
+        sqe->opcode = write ? IORING_OP_SEND : IORING_OP_RECV;
+        sqe->msg_flags = MSG_WAITALL;
+    }
+    else if(r->fixed){
+        sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+        sqe->off = (uint64_t) off;
+        sqe->buf_index = (uint16_t) buf;
+    }
+    else{
+        sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+        sqe->off = (uint64_t) off;
+    }
+}
+
+/**
+ * @description - Prepare transfer of length bytes between descriptors
+ * @param UringTransfer *t - transfer to be prepared
+ * @param int in - descriptor data are read from
+ * @param bool inSocket - input is socket
+ * @param int out - descriptor data are written to
+ * @param bool outSocket - output is socket
+ * @param off_t offset - offset in file where transfer starts
+ * @param long length - bytes to be transferred
+ * @param void *user - owner of transfer
+ * @return void
+ */
+static inline void uringSetup(UringTransfer *t, int in, bool inSocket, int out, bool outSocket, off_t offset, long length,
+                              void *user) {
+
+    t->in = in;
+    t->out = out;
+    t->inSocket = inSocket;
+    t->outSocket = outSocket;
+    t->inOff = inSocket ? 0 : offset;
+    t->outOff = outSocket ? 0 : offset;
+    t->left = length;
+    t->done = 0;
+    t->length = length;
+    t->carryBuf = -1;
+    t->carryOff = t->carryLen = 0;
+    t->slots = 0;
+    t->carryQueued = false;
+    t->pending = 0;
+    t->failed = false;
+    t->user = user;
+    t->crc = NULL;
+}
+
+/**
+ * @description - Queue next batch of transfer as one chain: write of carried data, then read -> write pairs
+ * @param Uring *r - initialized ring
+ * @param UringTransfer *t - transfer without batch in flight
+ * @return int - number of queued operations, 0 when there's no free buffer or entry
+ */
+static inline int uringStart(Uring *r, UringTransfer *t) {
+
+    unsigned want = 0;
+    long left = t->left;
+    while(want < URING_SLOTS && left > 0 && want < r->freeBufs.size()){
+        left -= (long) r->bufSize;
+        want++;
+    }
+    unsigned ops = 2 * want + (t->carryLen > 0 ? 1 : 0);
+    if(ops == 0 || r->localTail - __atomic_load_n(r->sqHead, __ATOMIC_ACQUIRE) + ops > r->sqEntries){
+        return 0;
+    }
+
+    struct io_uring_sqe *sqe = NULL;
+    unsigned n = 0;
+    off_t outOff = t->outOff;
+    t->carryQueued = t->carryLen > 0;
+    if(t->carryQueued){
+        sqe = uringSqe(r);
+        uringPrep(r, sqe, true, t->outSocket, t->out, outOff, t->carryBuf, t->carryOff, t->carryLen, &t->ops[n]);
+        outOff += (off_t) t->carryLen;
+        t->ops[n++].owner = t;
+    }
+    for(t->slots = 0; t->slots < want; t->slots++){
+        size_t len = t->left < (long) r->bufSize ? (size_t) t->left : r->bufSize;
+        int buf = r->freeBufs.back();
+        r->freeBufs.pop_back();
+        t->buf[t->slots] = buf;
+        t->len[t->slots] = len;
+
+        if(sqe != NULL){ sqe->flags |= IOSQE_IO_LINK; }
+        sqe = uringSqe(r);
+        uringPrep(r, sqe, false, t->inSocket, t->in, t->inOff, buf, 0, len, &t->ops[n]);
+        t->ops[n++].owner = t;
+        sqe->flags |= IOSQE_IO_LINK;
+        sqe = uringSqe(r);
+        uringPrep(r, sqe, true, t->outSocket, t->out, outOff, buf, 0, len, &t->ops[n]);
+        t->ops[n++].owner = t;
+
+        t->inOff += (off_t) len;
+        outOff += (off_t) len;
+        t->left -= (long) len;
+    }
+    t->pending = n;
+    return (int) n;
+}
+
+/**
+ * @description - Store results of all available completions
+ * @param Uring *r - initialized ring
+ * @param std::vector<UringTransfer *> *finished - transfers whose whole batch completed, can be NULL
+ * @return void
+ */
+static inline void uringReap(Uring *r, std::vector<UringTransfer *> *finished) {
+
+    unsigned head = *r->cqHead;
+    unsigned tail = __atomic_load_n(r->cqTail, __ATOMIC_ACQUIRE);
+    while(head != tail){
+        struct io_uring_cqe *cqe = &r->cqes[head & *r->cqMask];
+        UringOp *op = (UringOp *)(uintptr_t) cqe->user_data;
+        op->res = cqe->res;
+        if(--op->owner->pending == 0 && finished != NULL){
+            finished->push_back(op->owner);
+        }
+        head++;
+    }
+    __atomic_store_n(r->cqHead, head, __ATOMIC_RELEASE);
+}
+
+/**
+ * @description - Process results of completed batch, short read/write breaks chain, its data are carried to next batch
+ * @param Uring *r - initialized ring
+ * @param UringTransfer *t - transfer with whole batch completed
+ * @return int - success = 0, failure = 1
+ */
+static inline int uringCollect(Uring *r, UringTransfer *t) {
+
+    unsigned n = 0;
+    bool broken = false;    //rest of chain was cancelled
+
+    if(t->carryQueued){
+        int w = t->ops[n++].res;
+        if(w < 0){
+            t->failed = true;
+            w = 0;
+        }
+        t->carryOff += (size_t) w;
+        t->carryLen -= (size_t) w;
+        t->done += w;
+        t->outOff += w;
+        if(t->carryLen > 0){
+            broken = true;
+        }
+        else{
+            r->freeBufs.push_back(t->carryBuf);
+            t->carryBuf = -1;
+        }
+        t->carryQueued = false;
+    }
+
+    for(unsigned s = 0; s < t->slots; s++, n += 2){
+        int rd = t->ops[n].res;
+        int wr = t->ops[n + 1].res;
+        size_t len = t->len[s];
+
+        if(broken || rd <= 0){  //not read at all, request it again in next batch
+            if(rd < 0 && rd != -ECANCELED){ t->failed = true; }
+            if(rd == 0 && !broken){ t->failed = true; } //input ended before whole length
+            t->left += (long) len;
+            t->inOff -= (off_t) len;
+            r->freeBufs.push_back(t->buf[s]);
+            broken = true;
+            continue;
+        }
+        if((size_t) rd < len){      //short read, the rest will be read again
+            t->left += (long)(len - (size_t) rd);
+            t->inOff -= (off_t)(len - (size_t) rd);
+        }
+        if(t->crc != NULL){
+            *t->crc = crc32c(*t->crc, r->buffers + (size_t) t->buf[s] * r->bufSize, (size_t) rd);
+        }
+        if(wr == -ECANCELED || (wr >= 0 && wr < rd)){  //keep unwritten data for next batch
+            size_t written = wr > 0 ? (size_t) wr : 0;
+            t->done += (long) written;
+            t->outOff += (off_t) written;
+            t->carryBuf = t->buf[s];
+            t->carryOff = written;
+            t->carryLen = (size_t) rd - written;
+            broken = true;
+            continue;
+        }
+        if(wr < 0){
+            t->failed = true;
+            r->freeBufs.push_back(t->buf[s]);
+            broken = true;
+            continue;
+        }
+        t->done += wr;
+        t->outOff += wr;
+        r->freeBufs.push_back(t->buf[s]);
+    }
+    t->slots = 0;
+    return t->failed ? 1 : 0;
+}
+
+/**
+ * @description - Give back buffer held by unfinished transfer
+ * @param Uring *r - initialized ring
+ * @param UringTransfer *t - transfer without batch in flight
+ * @return void
+ */
+static inline void uringRelease(Uring *r, UringTransfer *t) {
+
+    if(t->carryBuf != -1){
+        r->freeBufs.push_back(t->carryBuf);
+        t->carryBuf = -1;
+        t->carryLen = 0;
+    }
+}
+
+/**
+ * @description - Run one batch of transfer and wait for its completion, for blocking callers
+ * @param Uring *r - initialized ring used just by the caller
+ * @param UringTransfer *t - transfer without batch in flight
+ * @return int - success = 0, failure = 1
+ */
+static inline int uringStep(Uring *r, UringTransfer *t) {
+
+    int ops = uringStart(r, t);
+    if(ops == 0){
+        return 1;
+    }
+    if(uringSubmit(r, (unsigned) ops) != 0){
+        return 1;
+    }
+    while(t->pending > 0){
+        uringReap(r, NULL);
+        if(t->pending > 0 && uringSubmit(r, 1) != 0){
+            return 1;
+        }
+    }
+    return uringCollect(r, t);
+}
+
+#endif //URING_H